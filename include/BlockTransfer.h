@@ -0,0 +1,67 @@
+/***********************************************************
+ * BlockTransfer.h
+ * A binary block transfer protocol for pulling log files
+ * off the logger over UART1 with CRC checked blocks,
+ * windowed acknowledgements and resume from any offset.
+ *
+ * Every frame (in both directions) looks like:
+ *
+ *   SOH | type | length (2) | payload (length bytes) | CRC (2)
+ *
+ * All multi-byte numbers are sent MSB first (like modbus) and
+ * the CRC is a CRC-16/CCITT over the type, length and payload.
+ *
+ * Host to logger frames:
+ *   'S' start  - offset (4), window (1), flags (1, can be
+ *                left off).  Start (or restart) sending the
+ *                file at offset, with at most window blocks
+ *                outstanding.  With BT_START_COMPRESS in the
+ *                flags, blocks that shrink come as 'Z' frames
+ *   'A' ack    - offset (4).  Everything before offset arrived
+ *   'N' nak    - offset (4).  Send again starting at offset
+ *   'Q' quit   - no payload.  Stop the transfer
+ *
+ * Logger to host frames:
+ *   'I' info   - file size (4), block size (2)
+ *   'D' data   - offset (4), then up to block size bytes of
+ *                the file
+ *   'Z' packed - offset (4), length (2), then the block of
+ *                length bytes at offset compressed (see
+ *                LogCompress.h) against the block size bytes
+ *                of the file before offset (or all of them if
+ *                offset is less than that)
+ *   'E' end    - file size (4).  Everything has been acked
+ *
+ * A host that loses the link just runs again with the offset
+ * of what it already has to resume.
+ ***********************************************************/
+
+// The byte that starts every frame
+#define BT_SOH				0x01
+
+// The frame types
+#define BT_FRAME_START		'S'
+#define BT_FRAME_ACK		'A'
+#define BT_FRAME_NAK		'N'
+#define BT_FRAME_QUIT		'Q'
+#define BT_FRAME_INFO		'I'
+#define BT_FRAME_DATA		'D'
+#define BT_FRAME_PACKED		'Z'
+#define BT_FRAME_END		'E'
+
+// The start frame flags
+#define BT_START_COMPRESS	0x01
+
+// The number of file bytes in a full data block (one SD sector)
+#define BT_BLOCK_SIZE		512
+
+// The largest number of blocks that can be outstanding
+#define BT_MAX_WINDOW		8
+
+// This function waits for a host to send a start frame and then
+// sends the named file using the block protocol.  It returns the
+// offset the host has acknowledged up to, or -1 if the file could
+// not be opened or the host never started.  A sample that comes due
+// is taken between frames (see logFileYield).  The file system must
+// already be initialized.
+long sendLogFileBlocks(char *fileName);
@@ -0,0 +1,32 @@
+/***********************************************************
+ * Burst.h
+ * A high rate sampling mode for commissioning and leak
+ * tests.  The flow is read at a fixed rate (1Hz or faster)
+ * with the single transaction snapshot read and kept in a
+ * RAM ring buffer.  Every few readings are rolled up into
+ * one log record and the records are written to the card
+ * only in whole sectors.
+ ***********************************************************/
+
+// The number of raw readings kept in the RAM ring buffer
+#define BURST_BUFFER_SIZE	128
+
+// One raw reading in the ring buffer
+typedef struct {
+	// Milliseconds since the burst started
+	unsigned long ms;
+	// The flow rate in l/s
+	float flowRate;
+} BURST_SAMPLE;
+
+// This function runs a burst.  A reading is taken every intervalMs
+// milliseconds for durationSeconds seconds (or until a key is hit on
+// the terminal) and every decimation readings are written to the log
+// file as one record.  The file system must already be initialized.
+// Returns the number of readings taken.
+unsigned int runBurst(char *fileName, unsigned long intervalMs, unsigned long durationSeconds,
+	unsigned int decimation);
+
+// This function prints the raw readings from the last burst that are
+// still in the ring buffer, oldest first
+void printBurstSamples(void);
@@ -0,0 +1,13 @@
+/***********************************************************
+ * Checksum.h
+ * Checksum functions that are shared by the log file and
+ * terminal transfer code
+ ***********************************************************/
+
+// The starting value for a CRC-16/CCITT calculation
+#define CRC16_CCITT_INIT	0xFFFF
+
+// This function adds length bytes of data to a running CRC-16/CCITT
+// (polynomial 0x1021) and returns the new CRC.  Start a new CRC with
+// CRC16_CCITT_INIT.
+unsigned int crc16Ccitt(unsigned int crc, const unsigned char *data, unsigned int length);
@@ -0,0 +1,49 @@
+/***********************************************************
+ * Commands.h
+ * The terminal commands.  Each command is an entry in a
+ * table sorted by its four letter code, so finding one is
+ * a binary search and adding one is a new handler and a
+ * new line in the table.
+ ***********************************************************/
+
+// What a command handler returns, stay at the TLR> prompt or leave it
+#define COMMAND_STAY	0
+#define COMMAND_EXIT	1
+
+// This packs a four letter command code into a number that sorts the
+// same way the letters do
+#define COMMAND_KEY(a,b,c,d)	((((unsigned long)(a)) << 24) | (((unsigned long)(b)) << 16) | \
+	(((unsigned long)(c)) << 8) | ((unsigned long)(d)))
+
+// A command handler.  It gets the command buffer (which it may reuse to
+// read replies from the user) and the buffer to put the message that is
+// printed after it, and returns COMMAND_STAY or COMMAND_EXIT.
+typedef int (*COMMAND_HANDLER)(char *command, char *toPrint);
+
+// One entry in the command table
+typedef struct {
+	// The first four letters of the command packed with COMMAND_KEY
+	unsigned long key;
+	// The whole command as it is typed
+	const char *name;
+	// The function that runs it
+	COMMAND_HANDLER handler;
+	// One line about what it does for the help listing
+	const char *help;
+	// The flow meter registers it reads.  registerCount is 0 if it reads
+	// none, or if it reads several separate blocks (gfal), in which case
+	// the blocks are listed in the help line instead.
+	unsigned int firstRegister;
+	unsigned int registerCount;
+} COMMAND;
+
+// This function finds the table entry for the command typed, or NULL if
+// there is not one
+const COMMAND *findCommand(const char *command);
+
+// This function runs the command typed.  An unknown command puts a
+// message in toPrint.  Returns COMMAND_STAY or COMMAND_EXIT.
+int runCommand(char *command, char *toPrint);
+
+// This function prints the list of commands from the table
+void printCommandHelp(void);
@@ -0,0 +1,87 @@
+/***********************************************************
+ * Config.h
+ * The logger settings, kept in RAM and loaded from and
+ * saved to CONFIG.TXT on the SD card
+ ***********************************************************/
+
+// The settings for the watch mode are part of the config
+#include "Watch.h"
+
+// The name of the config file on the card
+#define CONFIG_FILE_NAME		"CONFIG.TXT"
+
+// The longest file name the config can hold (8.3 plus the terminator)
+#define CONFIG_FILE_NAME_MAX	13
+
+// The longest line in the config file that is looked at
+#define CONFIG_LINE_MAX			48
+
+// The settings that come out of an empty card
+#define CONFIG_DEFAULT_SAMPLE_SECONDS		3600UL
+#define CONFIG_DEFAULT_SAMPLES_TO_AVERAGE	4
+#define CONFIG_DEFAULT_AVERAGING_WINDOW_MS	3000UL
+#define CONFIG_DEFAULT_LOG_FILE				"DATALOG.TXT"
+
+// The shortest and longest sample intervals (3 seconds and a week).  The
+// shortest only fits a sample with no averaging window, a window needs
+// the interval to be longer by it (see CONFIG_SAMPLE_OVERHEAD_MS), so
+// the default 3 second window needs at least 6.
+#define CONFIG_MIN_SAMPLE_SECONDS			3UL
+#define CONFIG_MAX_SAMPLE_SECONDS			604800UL
+
+// What a sample takes on top of its averaging window (the Modbus reads,
+// the card and the timestamp), with room to spare.  The interval has to
+// be longer than the window and this, or the alarms would come in faster
+// than the samples could be taken.
+#define CONFIG_SAMPLE_OVERHEAD_MS			2000UL
+
+// All of the settings that survive a reset.  This RAM copy is what the
+// rest of the program uses, so the card is only read at boot.
+typedef struct {
+	// Seconds between samples (CONFIG_MIN_SAMPLE_SECONDS to
+	// CONFIG_MAX_SAMPLE_SECONDS)
+	unsigned long sampleSeconds;
+	// How long (milliseconds) the flow readings of a sample are spread over
+	unsigned long averagingWindowMs;
+	// How many flow readings go into each sample
+	unsigned int samplesToAverage;
+	// The modbus address of the flow meter
+	unsigned char slaveAddress;
+	// The name of the log file
+	char logFileName[CONFIG_FILE_NAME_MAX];
+	// The watch mode settings
+	WATCH_SETTINGS watch;
+	// The RTCC drift calibration (RTCC_CAL_MIN to RTCC_CAL_MAX), worked
+	// out against the meter clock
+	signed char rtccCalibration;
+} LOGGER_CONFIG;
+
+// The current settings
+extern LOGGER_CONFIG loggerConfig;
+
+// This function puts the default settings in loggerConfig
+void configDefaults(void);
+
+// This function returns 1 if an interval is in range and longer than a
+// sample takes with the averaging window given
+int configIntervalValid(unsigned long seconds, unsigned long windowMs);
+
+// This function returns 1 if a log file name is a legal 8.3 name (one
+// to eight name characters, and an extension of one to three after a
+// dot if there is one)
+int configFileNameValid(const char *name);
+
+// This function reads CONFIG.TXT into loggerConfig.  Anything missing
+// from the file keeps the value it had.  An interval too short for the
+// averaging window goes back to the default.  Returns 1 if the file was
+// there.  The file system must already be initialized.
+int configLoad(void);
+
+// This function writes loggerConfig out to CONFIG.TXT.  Returns 1 if it
+// was written.  The file system must already be initialized.
+int configSave(void);
+
+// This function hands the settings that live in other modules (the
+// modbus address, the watch settings and the clock calibration) over to
+// them
+void configApply(void);
@@ -0,0 +1,43 @@
+/***********************************************************
+ * Cursor.h
+ * Download cursors, how far each client has taken the log
+ * file, kept in CURSORS.TXT on the SD card so a site visit
+ * only has to download what was logged since the last one
+ *
+ * The file is plain text, one client per line:
+ *    client,log file name,offset
+ * for example:
+ *    LAPTOP,DATALOG.TXT,48213
+ ***********************************************************/
+
+// The name of the cursor file on the card
+#define CURSOR_FILE_NAME		"CURSORS.TXT"
+
+// The longest client name (plus the terminator)
+#define CURSOR_NAME_MAX			9
+
+// The client name used when none is given
+#define CURSOR_DEFAULT_CLIENT	"SITE"
+
+// The most clients the file keeps (it has to fit in one sector)
+#define CURSOR_MAX_CLIENTS		8
+
+// This function checks a client name is 1 to CURSOR_NAME_MAX - 1
+// letters and digits.  Returns 1 if it is good.
+int cursorNameValid(const char *client);
+
+// This function looks up where client got up to in the named log file.
+// A client that is not in the file, or whose cursor is for a different
+// log file, gets 0 (the start).  The file system must already be
+// initialized.
+unsigned long cursorLoad(const char *client, const char *fileName);
+
+// This function stores where client has got up to in the named log
+// file, replacing its old cursor.  Returns 1 if it was written, or 0 if
+// the file could not be written or is full.  The file system must
+// already be initialized.
+int cursorSave(const char *client, const char *fileName, unsigned long offset);
+
+// This function forgets every cursor (when the log file is cleared).
+// The file system must already be initialized.
+void cursorClearAll(void);
@@ -0,0 +1,49 @@
+/***********************************************************
+ * Drift.h
+ * Keeps the PIC clock in step with the flow meter clock.
+ * The offset between the two is taken every few hours
+ * from the meter clock read each sample already makes, a
+ * least squares line through the offsets gives the rate
+ * the PIC clock drifts at, and once there is enough of a
+ * span to trust it the RTCC calibration is changed to
+ * cancel it.
+ *
+ * Each change (or check that needed none) is a row in
+ * CLOCK.TXT:
+ *    time,offset,drift,points,old cal,new cal
+ * where the offset is PIC minus meter in seconds at the
+ * last reading and the drift is in ppm (positive when the
+ * PIC clock runs fast).
+ ***********************************************************/
+
+// The file the calibrations are logged to
+#define DRIFT_FILE				"CLOCK.TXT"
+
+// The seconds between offsets that go into the line
+#define DRIFT_CHECK_SECONDS		21600UL
+
+// The fewest offsets, and the shortest span of them, the line is worked
+// out from.  A week of six hourly readings of whole second clocks pins
+// the drift down to about a ppm, half a calibration step.
+#define DRIFT_MIN_POINTS		20
+#define DRIFT_MIN_SPAN_SECONDS	604800UL
+
+// The smallest drift, in calibration steps, that is worth a change
+#define DRIFT_MIN_STEPS			0.75f
+
+// An offset that moved more than this since the last one means one of
+// the clocks was set, so the line starts again
+#define DRIFT_JUMP_SECONDS		60L
+
+// This function returns 1 if an offset is due at this PIC epoch
+int driftDue(unsigned long picEpoch);
+
+// This function adds the offset between the meter clock (yy MM dd hh mm
+// ss as the meter gives it) and the PIC epoch read just after it.  When
+// the line spans long enough the calibration is worked out, set, saved
+// in the config and logged.  The file system must already be
+// initialized.
+void driftAddReading(unsigned char meterDate[], unsigned long picEpoch);
+
+// This function throws the readings away, for when a clock is set by hand
+void driftReset(void);
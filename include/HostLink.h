@@ -0,0 +1,82 @@
+/***********************************************************
+ * HostLink.h
+ * A binary request/response channel on UART1 for host
+ * tools, next to the TLR> prompt.  A request starts with
+ * an escape byte no one types, so a tool can send requests
+ * at the prompt without echo, prompts or text to scrape,
+ * and can send several before reading the replies.
+ *
+ * A request (host to logger) looks like:
+ *
+ *   ESC (0x02) | id | type | length | payload | CRC (2)
+ *
+ * and the reply (logger to host) looks the same with the
+ * type of the request with the top bit set, or
+ * HL_REPLY_ERROR and an error code.  The id is whatever
+ * the host sent, so it can match replies to requests.  A
+ * host can have several requests in flight, as long as
+ * they come to less than the 128 byte receive ring.  The
+ * length is one byte and the CRC is a CRC-16/CCITT (MSB
+ * first) over the id, type, length and payload.
+ *
+ * A reply payload is a list of typed fields, each a tag
+ * and its value, with numbers MSB first like modbus:
+ *   'c' byte      - 1 byte
+ *   'w' word      - 2 bytes
+ *   'l' long      - 4 bytes (signed)
+ *   'f' float     - 4 bytes (IEEE 754)
+ *   's' bytes     - a length byte and that many bytes
+ *
+ * Requests:
+ *   'P' ping      - any payload, echoed back as one 's'
+ *   'T' time      - the PIC time, 6 'c' (yy MM dd hh mm ss)
+ *   'S' snapshot  - registers 3000-3020: 'f' velocity,
+ *                   'f' flow, 'f' flow %, 'w' fault,
+ *                   'l' totalizer, 'f' totalizer fraction
+ *   'R' registers - first register (2), count (1, up to
+ *                   HL_MAX_REGISTERS): one 's' of the raw
+ *                   register bytes
+ *   'L' logger    - 'l' sample seconds, 'l' log file size
+ *                   (-1 if there is no card), 'w' 1 if an
+ *                   alarm is waiting to be serviced
+ ***********************************************************/
+
+// The byte that starts every frame (the same as the line editor
+// hands over on)
+#define HL_ESCAPE			LINE_EDITOR_ESCAPE_CHAR
+
+// The request types
+#define HL_REQUEST_PING		'P'
+#define HL_REQUEST_TIME		'T'
+#define HL_REQUEST_SNAPSHOT	'S'
+#define HL_REQUEST_REGISTERS	'R'
+#define HL_REQUEST_LOGGER	'L'
+
+// A good reply is the request type with this bit set
+#define HL_REPLY_OK			0x80
+
+// The reply type for a request that failed, with one of the
+// error codes below as a 'c' field
+#define HL_REPLY_ERROR		'X'
+#define HL_ERROR_UNKNOWN	1	// Not a request type we know
+#define HL_ERROR_BAD_LENGTH	2	// The payload is the wrong size
+#define HL_ERROR_METER		3	// The flow meter did not answer
+
+// The field tags
+#define HL_FIELD_BYTE		'c'
+#define HL_FIELD_WORD		'w'
+#define HL_FIELD_LONG		'l'
+#define HL_FIELD_FLOAT		'f'
+#define HL_FIELD_BYTES		's'
+
+// The largest request payload
+#define HL_MAX_REQUEST		32
+
+// The most registers one 'R' request can read
+#define HL_MAX_REGISTERS	100
+
+// This function reads the rest of a request after the escape byte
+// from UART1, answers it and returns.  A request that does not
+// arrive in time or has a bad CRC is dropped without a reply (the
+// host times out and sends it again).
+void hostLinkService(void);
@@ -0,0 +1,67 @@
+/***********************************************************
+ * Ledger.h
+ * A daily consumption ledger worked out from the changes in
+ * the flow meter's totalizer between samples.  One short
+ * row per day goes in CONSUME.TXT so a year of billing
+ * data is a small file.
+ *
+ * Each row is:
+ *    date,first total,last total,consumption,samples,flags
+ * with the totals and consumption in totalizer units to
+ * three decimal places.  The flags are - for none, or:
+ *    S  the logger started part way through the day
+ *    P  the meter powered up (register 366 changed)
+ *    R  the totalizer went back to zero (a reset or roll
+ *       over), counting carried on from the new value
+ *    B  the logger was reset part way through the day and
+ *       carried on from the totals saved before it
+ ***********************************************************/
+
+// The file the ledger is kept in
+#define LEDGER_FILE			"CONSUME.TXT"
+
+// The file the day still being added up is saved in
+#define LEDGER_OPEN_FILE	"LEDGOPEN.DAT"
+
+// The ledger flags
+#define LEDGER_FLAG_STARTED		0x01
+#define LEDGER_FLAG_POWER_UP	0x02
+#define LEDGER_FLAG_RESET		0x04
+#define LEDGER_FLAG_RESTARTED	0x08
+
+// A totalizer value held as whole units and thousandths, so it keeps
+// full resolution without needing a 64 bit number or a double
+typedef struct {
+	long whole;
+	int thousandths;
+} LEDGER_TOTAL;
+
+// The day being added up.  This is saved to LEDGER_OPEN_FILE as is
+// after every sample so a reset does not lose it.
+typedef struct {
+	// The day
+	unsigned char year;
+	unsigned char month;
+	unsigned char day;
+	// The LEDGER_FLAG_xxx flags
+	unsigned char flags;
+	// The first and last totals of the day and the consumption so far
+	LEDGER_TOTAL first;
+	LEDGER_TOTAL last;
+	LEDGER_TOTAL consumption;
+	// The number of samples
+	unsigned int samples;
+	// The meter power up count at the last sample
+	unsigned int powerUps;
+} LEDGER_DAY;
+
+// This function picks up the day that was being added up before the
+// logger was reset, from LEDGER_OPEN_FILE.  Call it once at boot with
+// the file system initialized.
+void ledgerRestore(void);
+
+// This function adds one totalizer reading to the ledger.  When the
+// reading is on a new day, the row for the day before is appended to
+// the ledger file.  The file system must already be initialized.
+void ledgerAddSample(unsigned char year, unsigned char month, unsigned char day,
+	long totalizerInteger, float totalizerFraction, unsigned int powerUps);
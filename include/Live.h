@@ -0,0 +1,18 @@
+/***********************************************************
+ * Live.h
+ * A live monitor for commissioning.  The process values
+ * are read with the single transaction snapshot read and
+ * streamed to the terminal as one short line per reading
+ * until a key is hit.
+ ***********************************************************/
+
+// The slowest rate the live monitor can be asked for
+#define LIVE_MAX_INTERVAL_MS	60000UL
+
+// This function streams the live readings, one every intervalMs
+// milliseconds (0 for as fast as the meter answers), until a key is
+// hit on the terminal.  A line that will not fit in the transmit ring
+// buffer is dropped rather than waited for, so the terminal never
+// slows the readings down.  The number of lines sent and dropped are
+// put in linesSent and linesDropped.
+void runLiveMonitor(unsigned long intervalMs, unsigned long *linesSent, unsigned long *linesDropped);
@@ -0,0 +1,60 @@
+/***********************************************************
+ * LogCompress.h
+ * A small LZ compressor for sending the log file over the
+ * terminal.  Each block is compressed on its own with the
+ * block before it as history, so the window only has to
+ * hold two sectors and either end can start again at any
+ * block.
+ *
+ * The compressed block is a stream of bits, most
+ * significant first, padded with zeros to a whole byte.
+ * Each item is either
+ *
+ *   0 | code (4)               a literal.  Codes 0 to 14
+ *                              are the characters in
+ *                              lzLiteralCodes, code 15 is
+ *                              followed by the byte (8)
+ *   1 | distance - 1 (10) | length - 3 (2)
+ *   1 | distance - 1 (10) | 3 (2) | length - 6 (6)
+ *                              a match, copying length
+ *                              bytes (3 to 69) from
+ *                              distance bytes back (1 to
+ *                              1024, into the history if
+ *                              need be)
+ *
+ * The digits and hex of the log records take 5 bits as
+ * literals instead of 9.
+ ***********************************************************/
+
+// How far back a match can reach (the history and the block)
+#define LZ_WINDOW_SIZE		1024
+
+// The shortest and longest matches
+#define LZ_MIN_MATCH		3
+#define LZ_LONG_MATCH		6
+#define LZ_MAX_MATCH		69
+
+// The number of short literal codes
+#define LZ_LITERAL_CODES	15
+
+// The characters with short literal codes
+extern const unsigned char lzLiteralCodes[LZ_LITERAL_CODES];
+
+// The most a block of length bytes can grow to (13 bits for every
+// literal), so an output buffer this size always holds the result
+#define LZ_MAX_OUTPUT(length)	(((length) * 13 + 7) / 8)
+
+// This function compresses window[start] up to window[end], with
+// window[0] up to window[start] as history it can match against (end
+// can be at most LZ_WINDOW_SIZE).  Returns the compressed length, or 0
+// if it would not fit in outSize.
+unsigned int lzCompress(const unsigned char *window, unsigned int start, unsigned int end,
+	unsigned char *out, unsigned int outSize);
+
+// This function decompresses a block into window[start] up to
+// window[end] (end - start is the length of the block before it was
+// compressed), with window[0] up to window[start] as the history it was
+// compressed against.  Returns 1, or 0 if the compressed data is
+// damaged.
+int lzDecompress(unsigned char *window, unsigned int start, unsigned int end,
+	const unsigned char *in, unsigned int inLength);
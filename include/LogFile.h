@@ -0,0 +1,106 @@
+/***********************************************************
+ * LogFile.h
+ * Functions for moving the contents of the log files on the
+ * SD card out to the terminal
+ ***********************************************************/
+
+// The log records carry the statistics of the flow readings
+#include "Statistics.h"
+
+// The log records are stamped to the millisecond
+#include "Timer.h"
+
+// The size of the chunks that are read from the log file.  This
+// matches the SD sector size so each read is one whole sector
+#define LOG_CHUNK_SIZE		512
+
+// The buffer that sectors of the log file are read into.  It is shared
+// by everything that moves log files out the terminal, since only one
+// of those can run at a time
+extern unsigned char logChunkBuffer[LOG_CHUNK_SIZE];
+
+// The longest line formatLogRecord will produce (with the terminator)
+#define LOG_RECORD_MAX		128
+
+// The number of bytes at the end of the log file that are checked for
+// a torn write when the file system is mounted.  Only the last write can
+// be torn, so this just has to cover the last sector.
+#define LOG_RECOVERY_BYTES	LOG_CHUNK_SIZE
+
+// The most records the tail command will go back for
+#define LOG_TAIL_MAX		500
+
+// Each record ends with this and the CRC-16/CCITT (four hex digits) of
+// everything before it on the line
+#define LOG_RECORD_CRC_MARK	'*'
+
+// Records that were found damaged are marked by overwriting their first
+// character with this
+#define LOG_RECORD_BAD_MARK	'#'
+
+// The things recoverLogFile can do to the tail of the log file
+#define LOG_RECOVERY_CLEAN		0
+#define LOG_RECOVERY_MARKED		1
+#define LOG_RECOVERY_TRUNCATED	2
+#define LOG_RECOVERY_FAILED		-1
+
+// This function formats one log record (one line of the log file) into
+// recordBuffer, stamped with the time the flow was read to the
+// millisecond (2010-06-30T12:00:00.123) and ending with the record's
+// CRC.  Returns the length of the record.
+int formatLogRecord(char *recordBuffer, const TIMER_STAMP *stamp, RUNNING_STATS *flowStats,
+	long totalizer, float transTemp, unsigned char battCap, unsigned char powerStat,
+	unsigned int faultStatus);
+
+// This function checks one line of the log file (length bytes, not
+// counting the newline).  A line with a CRC has to match it, a line
+// without one (the header or records from before the CRCs) only has to
+// be printable.  Returns 1 if the line is good.
+int checkLogRecord(const unsigned char *line, unsigned int length);
+
+// This function checks the tail of a log file after a power loss.
+// Damaged records are marked with LOG_RECORD_BAD_MARK and a torn last
+// record is ended with a newline so the next append starts clean.  If
+// the end of the file is blank (the directory entry got ahead of the
+// data) the file size is cut back to the last byte written.  Only the
+// last LOG_RECOVERY_BYTES are read so it takes the same time however
+// long the log is.  Returns one of the LOG_RECOVERY_xxx values.  The
+// file system must already be initialized.
+int recoverLogFile(char *fileName);
+
+// This function opens a file for append, writes length bytes to it and
+// closes it again.  Returns the number of bytes written.  The file
+// system must already be initialized.
+unsigned int appendToFile(char *fileName, const void *data, unsigned int length);
+
+// This function lets a sample that is due go ahead in the middle of
+// reading a file opened with "r" (see schedulerYield).  If none is due
+// it just returns the file.  Otherwise the file is closed around the
+// sample, since the sample mounts the card again and turns SPI1 off,
+// then opened again at offset.  Returns the file, or NULL if it could
+// not be opened again.
+FSFILE *logFileYield(FSFILE *file, char *fileName, unsigned long offset);
+
+// This function dumps the contents of a log file out UART1 with
+// newlines translated to carriage returns.  The file is read a
+// sector at a time and each sector is handed to the interrupt
+// driven transmitter so the next sector is read while the last
+// one is being sent.  A sample that comes due is taken between
+// sectors (see logFileYield).  Returns the number of bytes sent or -1 if
+// the file could not be opened.  The file system must already be
+// initialized.
+long dumpLogFile(char *fileName);
+
+// This function is dumpLogFile from *offset on instead of the start.
+// If the file is now shorter than *offset (it has been cleared since)
+// it starts at the start instead.  *offset is left at the end of what
+// was sent.  Returns the number of bytes sent or -1 if the file could
+// not be opened.  The file system must already be initialized.
+long dumpLogFileFrom(char *fileName, unsigned long *offset);
+
+// This function finds the offset where the last records records of a
+// log file start (0 if the file has fewer than that).  It reads back
+// from the end a sector at a time, so it takes the same time however
+// long the log is.  Returns the offset or -1 if the file could not be
+// read.  The file system must already be initialized.
+long findLastRecords(char *fileName, unsigned int records);
@@ -0,0 +1,97 @@
+/***********************************************************
+ * RTCC.h
+ * Functions for the Real Time Clock and Calendar (RTCC.c)
+ ***********************************************************/
+
+// A date and time in binary, the year is 0 to 99 for 2000 to 2099
+typedef struct {
+	unsigned char year;
+	unsigned char month;
+	unsigned char day;
+	unsigned char hour;
+	unsigned char minute;
+	unsigned char second;
+} RTCC_DATE;
+
+// The seconds in a day
+#define RTCC_SECONDS_PER_DAY	86400UL
+
+// Read the clock into the holding variables, reading it again until two
+// reads agree so a roll-over part way through is never seen.  The
+// getXXX functions return the binary value of each field from the last
+// read.
+void RTCCgrab(void);
+unsigned char getYear(void);
+unsigned char getMonth(void);
+unsigned char getDay(void);
+unsigned char getHour(void);
+unsigned char getMin(void);
+unsigned char getSec(void);
+
+// Put the binary time and date from the last read in date
+void RTCCGetDate(RTCC_DATE *date);
+
+// Read the clock and return it as an epoch, seconds since
+// 2000-01-01T00:00:00 (the getXXX functions then give the same time)
+unsigned long RTCCGetEpoch(void);
+
+// Set the clock to an epoch
+void RTCCSetEpoch(unsigned long epoch);
+
+// Turn a date and time into an epoch and back
+unsigned long epochFromDate(const RTCC_DATE *date);
+void epochToDate(unsigned long epoch, RTCC_DATE *date);
+
+// Check a date and time is a real one (returns 1 if it is)
+int RTCCDateValid(const RTCC_DATE *date);
+
+// A clock with a year before this (2010) has not been set since it
+// was started
+#define RTCC_VALID_YEAR_MIN		10
+
+// Turn on the clock.  Returns 1 if it was still running from before
+// the reset with a valid time, which is kept, or 0 if it was started
+// at a placeholder time and has to be set.
+int RTCCInit(void);
+
+// Write the holding variables to the clock
+void RTCCSet(void);
+
+// Write the alarm holding variables to the alarm (it is left off)
+void RTCCAlarmSet(void);
+
+// The alarm masks, how often the alarm fires (or which fields it
+// compares)
+#define RTCC_ALARM_HALF_SECOND	0x0
+#define RTCC_ALARM_SECOND		0x1
+#define RTCC_ALARM_10_SECONDS	0x2
+#define RTCC_ALARM_MINUTE		0x3
+#define RTCC_ALARM_10_MINUTES	0x4
+#define RTCC_ALARM_HOUR			0x5
+#define RTCC_ALARM_DAY			0x6
+#define RTCC_ALARM_WEEK			0x7
+#define RTCC_ALARM_MONTH		0x8
+#define RTCC_ALARM_YEAR			0x9
+
+// Point the alarm at an epoch with a mask and turn it on, repeating
+// every period of the mask (repeat = 1) or firing once (repeat = 0)
+void RTCCAlarmSetEpoch(unsigned long epoch, unsigned char mask, unsigned char repeat);
+
+// The drift calibration, the CAL bits of RCFGCAL.  Each step is 4
+// clock pulses a minute, about 2.03 ppm, and a positive value makes the
+// clock run faster.  Setting it waits for the seconds to tick over.
+#define RTCC_CAL_PPM_PER_STEP	2.03f
+#define RTCC_CAL_MIN			(-127)
+#define RTCC_CAL_MAX			127
+void RTCCSetCalibration(signed char calibration);
+signed char RTCCGetCalibration(void);
+
+// Set a field in the holding variables (forAlarm = 1 to set
+// the alarm holding variables instead)
+void RTCCSetBinSec(unsigned char Sec, int forAlarm);
+void RTCCSetBinMin(unsigned char Min, int forAlarm);
+void RTCCSetBinHour(unsigned char Hour, int forAlarm);
+void RTCCSetBinDay(unsigned char Day, int forAlarm);
+void RTCCSetBinMonth(unsigned char Month, int forAlarm);
+void RTCCSetBinYear(unsigned char Year, int forAlarm);
+void RTCCCalculateWeekDay(void);
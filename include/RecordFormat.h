@@ -0,0 +1,49 @@
+/***********************************************************
+ * RecordFormat.h
+ * Small number formatters for the log records and terminal
+ * replies.  They do the float fields in fixed point so the
+ * records do not need the floating point printf.  Each one
+ * writes at out, puts a terminator after what it wrote and
+ * returns a pointer to that terminator so calls can be
+ * chained along a buffer.
+ ***********************************************************/
+
+// The number of decimal places for the flow fields in the log records
+#define RECORD_FLOW_DECIMALS	3
+
+// The number of decimal places for the temperature in the log records
+#define RECORD_TEMP_DECIMALS	2
+
+// The most decimal places formatFixed will do
+#define FORMAT_FIXED_MAX_DECIMALS	6
+
+// A buffer this size holds anything formatFixed writes
+#define FORMAT_FIXED_MAX		24
+
+// The length of a timestamp (2010-06-30T12:00:00) without the terminator
+#define FORMAT_TIMESTAMP_LENGTH	19
+
+// This function writes an unsigned number in decimal, padded on the
+// left with pad up to width characters
+char *formatUnsigned(char *out, unsigned long value, unsigned char width, char pad);
+
+// This function writes a 16 bit number as four upper case hex digits
+char *formatHex16(char *out, unsigned int value);
+
+// This function writes a signed number in decimal
+char *formatSigned(char *out, long value);
+
+// This function writes an unsigned number in octal, padded on the left
+// with spaces up to width characters
+char *formatOctal(char *out, unsigned int value, unsigned char width);
+
+// This function writes a float rounded to a number of decimal places
+// (the same digits as printf's %.Nf).  Values too big for a long, and
+// NaNs, are written as "ovf".
+char *formatFixed(char *out, float value, unsigned char decimals);
+
+// This function writes a timestamp as 20YY-MM-DDTHH:MM:SS.  The date
+// part is kept from the last call and only formatted again when the
+// date changes.
+char *formatTimestamp(char *out, unsigned char year, unsigned char month, unsigned char day,
+	unsigned char hour, unsigned char minute, unsigned char second);
@@ -0,0 +1,79 @@
+/***********************************************************
+ * Rollup.h
+ * Hourly, daily and monthly summaries of the flow samples
+ * that are kept up to date as each sample is logged, so
+ * long range summaries can be read without going through
+ * every record in the log.
+ *
+ * Each level is a file of fixed size records in time order
+ * so any record can be found with a seek.
+ *
+ * The periods still being added up are saved to
+ * ROLLOPEN.DAT after every sample and picked up again
+ * after a reset, so a brown out does not lose them.  A
+ * period that was picked up that way carries the
+ * restarted flag.
+ ***********************************************************/
+
+// The rollup levels
+#define ROLLUP_HOURLY		0
+#define ROLLUP_DAILY		1
+#define ROLLUP_MONTHLY		2
+#define ROLLUP_LEVELS		3
+
+// The files the rollups are kept in (one per level)
+#define ROLLUP_HOURLY_FILE	"HOURLY.DAT"
+#define ROLLUP_DAILY_FILE	"DAILY.DAT"
+#define ROLLUP_MONTHLY_FILE	"MONTHLY.DAT"
+
+// The file the periods still being added up are saved in
+#define ROLLUP_OPEN_FILE	"ROLLOPEN.DAT"
+
+// The rollup flags
+#define ROLLUP_FLAG_RESTARTED	0x01
+
+// One rollup record.  This is written to the card as is and is
+// kept at 32 bytes so a sector holds exactly 16 of them.
+typedef struct {
+	// The start of the period (day is 1 for a month, hour is 0
+	// for a day or month)
+	unsigned char year;
+	unsigned char month;
+	unsigned char day;
+	unsigned char hour;
+	// The number of samples in the period
+	unsigned int count;
+	// All the fault status bits seen in the period OR'd together
+	unsigned int faultBits;
+	// Flow statistics for the period (l/s).  The sum is of the
+	// sample means, the min and max are of the individual readings
+	float minFlow;
+	float maxFlow;
+	float sumFlow;
+	// The totalizer at the start and end of the period (l x100)
+	long totalizerStart;
+	long totalizerEnd;
+	// ROLLUP_FLAG_RESTARTED if the logger was reset part way through
+	unsigned char flags;
+	// Spare so the record stays 32 bytes
+	unsigned char reserved[3];
+} ROLLUP;
+
+// The size of a rollup record on the card
+#define ROLLUP_RECORD_SIZE	32
+
+// This function adds one sample (the mean, minimum and maximum of its
+// flow readings) to the hourly, daily and monthly rollups.  When a
+// sample falls in a new period, the finished period is appended to its
+// rollup file.  The file system must already be initialized.
+void rollupAddSample(unsigned char year, unsigned char month, unsigned char day,
+	unsigned char hour, float meanFlow, float minFlow, float maxFlow, long totalizer,
+	unsigned int faultStatus);
+
+// This function prints up to count records of a rollup level to the
+// terminal starting at the first record at or after the given time.
+// The start record is found with a binary search of the rollup file.
+// The period still being accumulated is printed at the end if it is
+// in range.  Returns the number of records printed.
+int rollupPrintRange(unsigned char level, unsigned char year, unsigned char month,
+	unsigned char day, unsigned char hour, int count);
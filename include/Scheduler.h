@@ -0,0 +1,47 @@
+/***********************************************************
+ * Scheduler.h
+ * Runs the sampling in the background while a terminal
+ * session is open, one job at a time so the Modbus and SD
+ * card buffers are never used by two things at once
+ ***********************************************************/
+
+// The shared things a job can hold (OR'd together)
+#define SCHEDULER_MODBUS	0x01	// The Modbus buffer and UART2
+#define SCHEDULER_FILES		0x02	// The SD card, SPI1 and the FSIO buffers
+#define SCHEDULER_ALL		(SCHEDULER_MODBUS | SCHEDULER_FILES)
+
+// The function to mark shared things as in use so no sample is started
+// until they are released
+void schedulerClaim(unsigned char resources);
+
+// The function to release shared things and take any sample that was
+// held up waiting for them
+void schedulerRelease(unsigned char resources);
+
+// The function to service the RTCC alarm if it has fired since the last
+// call, as long as nothing the sample needs is claimed.  An alarm that
+// comes in while something is claimed is kept and serviced later (several
+// make one late sample).
+void schedulerRun(void);
+
+// The function to tell whether an RTCC alarm is waiting to be serviced,
+// so a long running command only has to put down what it is doing for
+// schedulerYield when there is a sample to take
+int schedulerPending(void);
+
+// The function for a long running command to let any sample that is due
+// go ahead, at a point where it is not in the middle of using the meter
+// or the card.  What the command had claimed is claimed again after.
+void schedulerYield(void);
+
+// The function to read a line from the terminal, running the scheduler
+// while the user is typing.  If nothing is typed for 90 seconds the line
+// ends with the cancel character (0x18), the same as getsU1.  Requests
+// from host tools (see HostLink.h) are answered while it waits.
+char *schedulerGetLine(char *s, int len);
+
+// The function for a command to read the answer to a question, with the
+// same timeout as schedulerGetLine so samples are taken while the user
+// thinks.  Host requests are not answered in the middle of a command,
+// their escape byte is dropped the same as getsU1 does.
+char *schedulerGetReply(char *s, int len);
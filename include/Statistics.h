@@ -0,0 +1,29 @@
+/***********************************************************
+ * Statistics.h
+ * A streaming aggregator that keeps the count, mean,
+ * variance, minimum and maximum of a series of values
+ * without storing the values
+ ***********************************************************/
+#ifndef _STATISTICS_H
+#define _STATISTICS_H
+
+// The running statistics of a series of values
+typedef struct {
+	unsigned int count;
+	float mean;
+	// The sum of squared differences from the mean (Welford's M2)
+	float m2;
+	float min;
+	float max;
+} RUNNING_STATS;
+
+// Clear the statistics to start a new series
+void statsReset(RUNNING_STATS *stats);
+
+// Add a value to the statistics
+void statsAdd(RUNNING_STATS *stats, float value);
+
+// Return the sample standard deviation (0 for fewer than two values)
+float statsStdDev(RUNNING_STATS *stats);
+
+#endif
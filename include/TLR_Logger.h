@@ -0,0 +1,31 @@
+/***********************************************************
+ * TLR_Logger.h
+ * The parts of the main program that the terminal commands
+ * use
+ ***********************************************************/
+
+// A flag to indicate that the UART 1 is active (terminal session is active)
+extern int terminalActive;
+
+// Whether the PIC clock holds a real time (set from the meter clock or
+// by hand, or kept through the reset)
+extern unsigned char clockValid;
+
+// Set by the RTCC alarm until the main loop services it
+extern volatile int alarmFired;
+
+// The function to do whatever is due when the RTCC alarm fires (a sample,
+// or a watch poll in watch mode)
+void serviceAlarm(void);
+
+// This is the function to read in all the data from the flow meter and
+// record it in the log file
+void readAndLogSample(void);
+
+// The function to return the number of seconds between alarms for an
+// alarm mask
+unsigned long alarmMaskSeconds(unsigned char mask);
+
+// The function to point the RTCC alarm at the watch poll interval if
+// watch mode is on, or the normal sample interval if it is not
+void applyAlarmMask(void);
@@ -0,0 +1,94 @@
+/***********************************************************
+ * Timer.h
+ * A free running 32 bit tick counter (Timer2/3) used to
+ * space out reads and time how long things take, and a
+ * once a second interrupt (Timer1) that wakes the PIC out
+ * of Idle so waits can time out.  Timer1 is put in step
+ * with the RTCC seconds so the two together give times to
+ * the millisecond.
+ ***********************************************************/
+#ifndef _TIMER_H
+#define _TIMER_H
+
+// The timer runs from the instruction clock through a 1:256
+// prescaler, so at 16MHz it ticks 62500 times a second
+#define TIMER_TICKS_PER_SECOND	(GetInstructionClock() / 256)
+
+// Turn on the tick counter if it is not already running.  The
+// count is not reset so this is safe to call from anywhere.
+void timerStart(void);
+
+// Turn off the tick counter to save power before idling
+void timerStop(void);
+
+// Return the current tick count
+unsigned long timerGetTicks(void);
+
+// Convert a number of ticks to milliseconds
+unsigned long timerTicksToMs(unsigned long ticks);
+
+// Convert a number of milliseconds to ticks
+unsigned long timerMsToTicks(unsigned long ms);
+
+// Wait until the tick count reaches the given value
+void timerWaitUntil(unsigned long ticks);
+
+// The frequency of the secondary oscillator that Timer1 runs from
+#define TIMER_SOSC_HZ			32768
+
+// Turn on the once a second interrupt if it is not already running.
+// The count is not reset so this is safe to call from anywhere.
+void timerSecondsStart(void);
+
+// Turn off the once a second interrupt
+void timerSecondsStop(void);
+
+// Turn off the once a second interrupt before idling but leave Timer1
+// running from the crystal, so it stays at the same place in the second
+// as the RTCC without waking the PIC.  timerSecondsStart turns it back on.
+void timerSecondsPause(void);
+
+// Return the number of seconds counted so far (it rolls over, so only
+// use the difference between two counts)
+unsigned int timerSecondsGet(void);
+
+// A time to the millisecond, the RTCC epoch (seconds since 2000) and the
+// milliseconds into that second
+typedef struct {
+	unsigned long epoch;
+	unsigned int ms;
+} TIMER_STAMP;
+
+// The RTCC calibration adds or drops 2.03ppm a step that Timer1 does not
+// see.  They are put back in step once the seconds since the sync times
+// the calibration steps reaches this, about 20ms apart.
+#define TIMER_STAMP_CAL_STEP_SECONDS	9852UL
+
+// How far from either end of a Timer1 second the RTCC is read to match
+// the second counts up after a pause (1/16 second, more than the 20ms
+// the two can drift apart)
+#define TIMER_STAMP_COUNT_MARGIN		(TIMER_SOSC_HZ / 16)
+
+// Put Timer1 in step with the RTCC.  It waits for the RTCC half second
+// bit to change (up to half a second), sets Timer1 to the same place in
+// the second and notes the RTCC time.  Starts Timer1 if it is not
+// running.
+void timerStampSync(void);
+
+// Take the time to the millisecond, the RTCC second plus the seconds and
+// part second Timer1 has counted since.  The stamps only go forward
+// while Timer1 runs.  It syncs first if Timer1 has not been synced since
+// it was started or the clock was set.  After a pause it only reads the
+// RTCC second again, which waits at most TIMER_STAMP_COUNT_MARGIN.
+void timerStampTake(TIMER_STAMP *stamp);
+
+// Put Timer1 back in step with the RTCC if the calibration may have
+// moved them apart (see TIMER_STAMP_CAL_STEP_SECONDS).  It can wait up
+// to half a second so call it after the stamps have been taken.
+void timerStampRefresh(void);
+
+// Drop the sync so the next stamp puts Timer1 back in step, for when the
+// RTCC has been set
+void timerStampInvalidate(void);
+
+#endif
@@ -5,6 +5,25 @@
 
 // Define backspace character
 #define BACKSPACE 0x8
+
+// What lineEditorPoll returns, still typing, the line is done, or the
+// escape byte that starts a host frame arrived
+#define LINE_EDITOR_BUSY	0
+#define LINE_EDITOR_DONE	1
+#define LINE_EDITOR_ESCAPE	2
+
+// The byte that a host tool sends to start a binary frame at the
+// prompt (see HostLink.h).  It is never typed by a person.
+#define LINE_EDITOR_ESCAPE_CHAR	0x02
+
+// A line being typed in at the terminal
+typedef struct {
+	// Where the line goes and how big that is (with the terminator)
+	char *buffer;
+	int size;
+	// How many characters are in it so far
+	int length;
+} LINE_EDITOR;
             
 // The function that initializes UART1 (115200@32MHz, 8, N, 1, CTS/RTS )
 void initU1( void);
@@ -12,16 +31,49 @@ void initU1( void);
 // send a character to serial port 1 through UART1
 int putU1( int c);
 
+// queue a block of characters to be sent out UART1 by the transmit
+// interrupt and return the number queued
+unsigned int writeU1( const unsigned char *data, unsigned int length);
+
+// wait until everything queued by writeU1 has been sent to UART1
+int flushU1( void);
+
+// return how many more characters writeU1 can queue without waiting
+unsigned int spaceU1( void);
+
+// A method that returns a zero if nothing has arrived
+// on UART1 and a 1 if something has arrived.
+int charArrivedAtUART1(void);
+
+// take the next character that has arrived on UART1, or return -1
+// if there is not one.  This never waits.
+int readU1( void);
+
 // wait for a new character to arrive to the serial port
-// attached to UART1
+// attached to UART1.  The PIC idles while it waits.  Returns the
+// cancel character (0x18) if nothing arrives for 90 seconds.
 char getU1( void);
 
 // send a null terminated string to the serial port
 // attached to UART1
 void putsU1( char *s);
 
+// start editing a new line in the buffer given (size includes the
+// terminator)
+void lineEditorStart( LINE_EDITOR *editor, char *buffer, int size);
+
+// take whatever characters have arrived on UART1 into the line being
+// edited, echoing them and handling backspace.  This never waits.
+// Returns LINE_EDITOR_DONE once return is pressed or the buffer is
+// full, LINE_EDITOR_ESCAPE when the escape byte arrives (the rest of
+// the frame is left waiting on UART1 and the line carries on after
+// it), or LINE_EDITOR_BUSY.
+int lineEditorPoll( LINE_EDITOR *editor);
+
 // receive a null terminated string in a buffer of len char
-// from the serial port attached to UART1
+// from the serial port attached to UART1.  The PIC idles between
+// characters.  If nothing is typed for 90 seconds the line ends
+// with the cancel character (0x18).
 char * getsU1( char *s, int n);
 
 // useful macros
@@ -0,0 +1,50 @@
+/***********************************************************
+ * Watch.h
+ * A low energy watch mode that polls just the flow and
+ * fault status on a short interval and decides when
+ * something has happened that is worth a full log record
+ ***********************************************************/
+#ifndef _WATCH_H
+#define _WATCH_H
+
+// The reasons a watch poll can fire an event (OR'd together)
+#define WATCH_EVENT_NONE		0x00
+#define WATCH_EVENT_FLOW_HIGH	0x01
+#define WATCH_EVENT_FLOW_LOW	0x02
+#define WATCH_EVENT_FLOW_CHANGE	0x04
+#define WATCH_EVENT_FAULT		0x08
+
+// The watch settings
+typedef struct {
+	// 1 if watch mode is on
+	unsigned char enabled;
+	// The RTCC alarm mask to poll at (0x2 = 10 seconds, 0x3 = 1 minute)
+	unsigned char pollMask;
+	// Fire when the flow goes above this (l/s)
+	float flowHigh;
+	// Fire when the flow goes below this (l/s)
+	float flowLow;
+	// How far back past a threshold the flow has to come before that
+	// threshold can fire again (l/s)
+	float deadband;
+	// Fire when the flow moves this far from the last full record
+	// (l/s, 0 to turn off)
+	float changeDeadband;
+	// How many polls to keep logging a full record at every poll after
+	// an event
+	unsigned int holdPolls;
+} WATCH_SETTINGS;
+
+// The current watch settings
+extern WATCH_SETTINGS watchSettings;
+
+// This function reads the flow and fault status and compares them to
+// the thresholds.  Returns the WATCH_EVENT_xxx bits for anything that
+// fired (WATCH_EVENT_NONE if nothing did or the read failed).
+unsigned char watchPoll(void);
+
+// This function tells the watch what flow went into the last full
+// record so flow change events are measured from there
+void watchRecordLogged(float flowRate);
+
+#endif
@@ -4,6 +4,104 @@
 // for interactions with 
 #define MODBUS_SIZE		253
 
+// The modbus address the flow meter answers to out of the box
+#define MODBUS_DEFAULT_SLAVE_ADDRESS	0x01
+
+// The modbus address of the flow meter that every command is sent to
+extern unsigned char modbusSlaveAddress;
+
+// The buffer every request is built in and every reply is read into
+extern unsigned char buffer[MODBUS_SIZE];
+
+// The process values that are read together in one transaction
+// by readProcessSnapshot (registers 3000 to 3020)
+typedef struct {
+	// Actual velocity in mm/s (register 3000)
+	float velocity;
+	// Flow rate in l/s (register 3002)
+	float flowRate;
+	// Insulation value (register 3004)
+	float insulationValue;
+	// Flow rate as a percent of Qn (register 3012)
+	float flowratePercent;
+	// Fault status (register 3016)
+	unsigned int faultStatus;
+	// Totalizer 1 integer and fractional (0 up to 1) parts (registers 3017-3020)
+	long totalizer1Integer;
+	float totalizer1Fraction;
+} PROCESS_SNAPSHOT;
+
+// The function to read the process values (registers 3000 to 3020) in
+// a single transaction.  Returns 1 if the snapshot was read OK.
+int readProcessSnapshot(PROCESS_SNAPSHOT *snapshot);
+
+// The most registers one read can ask for.  The reply is the address,
+// function code, byte count, two bytes a register and the CRC, and has
+// to fit in buffer, which comes to one less than the Modbus limit of 125.
+#define MODBUS_MAX_REGISTERS	((MODBUS_SIZE - 5) / 2)
+
+// The function to read a run of holding registers in one transaction.
+// Register N is then at buffer spot 3 + 2 x (N - firstRegister).
+// Returns 1 if they were read OK.
+int readHoldingRegisters(unsigned int firstRegister, unsigned int count);
+
+// Everything the gfal dashboard shows, read with as few transactions as
+// the register map allows
+typedef struct {
+	// The process values (registers 3000 to 3020)
+	PROCESS_SNAPSHOT process;
+	// Battery capacity in % and power status (registers 3030 and 3031)
+	unsigned char batteryCapacity;
+	unsigned char powerStatus;
+	// The meter clock, yy MM dd hh mm ss (register 3033)
+	unsigned char meterDate[6];
+	// Transmitter temperature in degrees C (register 3042)
+	float transmitterTemp;
+	// Operating hours (register 80)
+	unsigned long operatingHours;
+	// Flow rate and total flow units (registers 210 and 216)
+	unsigned char flowUnits[13];
+	unsigned char totalUnits[13];
+	// Qn, calibration factor and date, low flow cutoff (registers 226,
+	// 228, 230 and 239)
+	float qn;
+	float calibrationFactor;
+	unsigned char calibrationDate[6];
+	float lowFlowCutoff;
+	// Number of power ups (register 366)
+	unsigned int powerUps;
+	// Highest and lowest flow and highest day consumption with their
+	// dates (registers 407 to 421)
+	float highestFlow;
+	unsigned char highestFlowDate[6];
+	float lowestFlow;
+	unsigned char lowestFlowDate[6];
+	float highestDayConsumption;
+	unsigned char highestDayConsumptionDate[6];
+	// Date of the last meter log entry (register 476)
+	unsigned char lastLogDate[6];
+	// Comm module type (register 822)
+	unsigned char commModuleType;
+	// The register blocks that were read OK (a bit for each, in the
+	// order above, MODBUS_DASHBOARD_BLOCKS of them)
+	unsigned char blocksRead;
+} METER_DASHBOARD;
+
+// The number of transactions readMeterDashboard makes
+#define MODBUS_DASHBOARD_BLOCKS	6
+
+// The bits in blocksRead
+#define DASHBOARD_PROCESS		0x01	// 3000 to 3020
+#define DASHBOARD_STATUS		0x02	// 3030 to 3043
+#define DASHBOARD_HOURS			0x04	// 80 to 81
+#define DASHBOARD_SETUP			0x08	// 210 to 240
+#define DASHBOARD_HISTORY		0x10	// 366 to 478
+#define DASHBOARD_MODULE		0x20	// 822
+
+// The function to read everything the dashboard shows.  Returns the
+// number of register blocks that were read OK.
+unsigned char readMeterDashboard(METER_DASHBOARD *dashboard);
+
 // The function to read the actual velocity in mm/s (register 3000)
 float readActualVelocity(void);
 
@@ -34,6 +132,10 @@ float readQn(void);
 // information is read from register 3033.
 void readActualDateAndTime(unsigned char[]);
 
+// The function to read the date and time of the flow meter (register
+// 3033) into date as yy MM dd hh mm ss.  Returns 1 if it was read OK.
+int readMeterClock(unsigned char date[]);
+
 // This is the function to write (set) the date and time of the
 // flow meter.
 void setActualDateAndTime(unsigned char[]);
@@ -103,8 +205,8 @@ void readLastLogDate(unsigned char []);
 // ----------------------------------------------------------------------
 // NOTE: Methods below here are not tested
 // ----------------------------------------------------------------------
-// The function to read the fractional portion of the total flow (register 3017)
-long readTotalizer1Fraction(void);
+// The function to read the fractional portion of the total flow (register 3019)
+float readTotalizer1Fraction(void);
 
 // The function to read the fractional portion of the total flow (register 3021)
 long readTotalizer2Fraction(void);
@@ -0,0 +1,413 @@
+/*******************************************************
+ * BlockTransfer.c
+ * The logger side of the binary block transfer protocol
+ * (see BlockTransfer.h for the frame layout)
+ *******************************************************/
+
+// Include library for processor
+#include <p24fj256gb110.h>
+
+// Include Microchips SD File Library
+#include "FSIO.h"
+
+// Include the UART library for the terminal
+#include "UART.h"
+
+// Include the CRC functions
+#include "Checksum.h"
+
+// Include the log file functions (for the shared sector buffer)
+#include "LogFile.h"
+
+// Include the log download compressor
+#include "LogCompress.h"
+
+// Include the header for this file
+#include "BlockTransfer.h"
+
+// Include the string library
+#include <string.h>
+
+// How many times around the send loop we go with no word from the
+// host before we assume a frame was lost and go back to the last
+// acknowledged offset
+#define BT_ACK_TIMEOUT		3333333
+
+// How long to wait for the host to send the start frame
+#define BT_START_TIMEOUT	60000000
+
+// How many timeouts in a row before we give up on the host
+#define BT_MAX_RETRIES		10
+
+// The largest payload the host ever sends us
+#define BT_MAX_RX_PAYLOAD	6
+
+// The states of the receive frame parser
+#define BT_RX_SOH			0
+#define BT_RX_TYPE			1
+#define BT_RX_LENGTH_HI		2
+#define BT_RX_LENGTH_LO		3
+#define BT_RX_PAYLOAD		4
+#define BT_RX_CRC_HI		5
+#define BT_RX_CRC_LO		6
+
+// The shortest payload each host frame can have, a frame shorter than
+// that would leave its offset or window to the bytes of an older frame
+#define BT_START_MIN_PAYLOAD	5
+#define BT_OFFSET_MIN_PAYLOAD	4
+
+// The receive frame parser state and the last frame that was received
+unsigned char btRxState = BT_RX_SOH;
+unsigned char btRxType;
+unsigned int btRxLength;
+unsigned int btRxIndex;
+unsigned int btRxCRC;
+unsigned char btRxFrame[3 + BT_MAX_RX_PAYLOAD];
+
+// For a compressed download, the block before the one being sent (the
+// history) followed by that block, and the block compressed
+unsigned char btWindow[LZ_WINDOW_SIZE];
+unsigned char btPacked[LZ_MAX_OUTPUT(BT_BLOCK_SIZE)];
+
+// This function returns 1 if the frame just received is long enough for
+// its type
+int btRxLongEnough(void) {
+	switch (btRxType) {
+		case BT_FRAME_START:
+			return btRxLength >= BT_START_MIN_PAYLOAD;
+		case BT_FRAME_ACK:
+		case BT_FRAME_NAK:
+			return btRxLength >= BT_OFFSET_MIN_PAYLOAD;
+		default:
+			return 1;
+	}
+}
+
+// This function pulls any characters waiting on UART1 through the frame
+// parser.  It returns the type of a frame once a complete frame with a
+// good CRC and a long enough payload has arrived (the payload is then at
+// btRxFrame + 3), or zero.
+unsigned char btPollFrame(void) {
+	while (charArrivedAtUART1()) {
+		unsigned char c = readU1();
+		switch (btRxState) {
+			case BT_RX_SOH:
+				// Skip anything (like echoed text) until a frame starts
+				if (c == BT_SOH)
+					btRxState = BT_RX_TYPE;
+				break;
+			case BT_RX_TYPE:
+				btRxType = c;
+				btRxFrame[0] = c;
+				btRxState = BT_RX_LENGTH_HI;
+				break;
+			case BT_RX_LENGTH_HI:
+				btRxLength = ((unsigned int)c) << 8;
+				btRxFrame[1] = c;
+				btRxState = BT_RX_LENGTH_LO;
+				break;
+			case BT_RX_LENGTH_LO:
+				btRxLength |= c;
+				btRxFrame[2] = c;
+				btRxIndex = 0;
+				if (btRxLength > BT_MAX_RX_PAYLOAD)
+					btRxState = BT_RX_SOH;
+				else if (btRxLength == 0)
+					btRxState = BT_RX_CRC_HI;
+				else
+					btRxState = BT_RX_PAYLOAD;
+				break;
+			case BT_RX_PAYLOAD:
+				btRxFrame[3 + btRxIndex] = c;
+				btRxIndex++;
+				if (btRxIndex == btRxLength)
+					btRxState = BT_RX_CRC_HI;
+				break;
+			case BT_RX_CRC_HI:
+				btRxCRC = ((unsigned int)c) << 8;
+				btRxState = BT_RX_CRC_LO;
+				break;
+			case BT_RX_CRC_LO:
+				btRxCRC |= c;
+				btRxState = BT_RX_SOH;
+				if ((btRxCRC == crc16Ccitt(CRC16_CCITT_INIT, btRxFrame, 3 + btRxLength)) &&
+					btRxLongEnough())
+					return btRxType;
+				break;
+			default:
+				btRxState = BT_RX_SOH;
+				break;
+		}
+	}
+	return 0;
+}
+
+// This function returns the 4 byte offset at the start of the payload
+// of the last frame received
+unsigned long btRxOffset(void) {
+	return (((unsigned long)btRxFrame[3]) << 24) | (((unsigned long)btRxFrame[4]) << 16) |
+		(((unsigned long)btRxFrame[5]) << 8) | btRxFrame[6];
+}
+
+// This function writes a 4 byte number MSB first
+void btPutLong(unsigned char *to, unsigned long value) {
+	to[0] = value >> 24;
+	to[1] = value >> 16;
+	to[2] = value >> 8;
+	to[3] = value;
+}
+
+// This function queues bytes for the transmitter.  While it waits for
+// room in the transmit buffer it keeps feeding the receive frame parser
+// so acks are not lost to a receive overrun.  Any frame that completes
+// while waiting is returned in *rxType (if nothing else already is).
+// Returns 0 if the transmitter stalled.
+int btSendBytes(const unsigned char *data, unsigned int length, unsigned char *rxType) {
+	while (length > 0) {
+		unsigned int room = spaceU1();
+		unsigned long timeoutCounter = 0;
+		while (room == 0) {
+			if (*rxType == 0)
+				*rxType = btPollFrame();
+			timeoutCounter++;
+			if (timeoutCounter > BT_ACK_TIMEOUT)
+				return 0;
+			room = spaceU1();
+		}
+		if (room > length)
+			room = length;
+		writeU1(data, room);
+		data += room;
+		length -= room;
+	}
+	return 1;
+}
+
+// This function sends one frame.  The payload is sent in two parts so
+// a data block can be sent straight out of the sector buffer.
+int btSendFrame(unsigned char type, const unsigned char *head, unsigned int headLength,
+	const unsigned char *body, unsigned int bodyLength, unsigned char *rxType) {
+	// Build the frame header
+	unsigned char header[4];
+	unsigned int length = headLength + bodyLength;
+	header[0] = BT_SOH;
+	header[1] = type;
+	header[2] = length >> 8;
+	header[3] = length;
+
+	// Run the CRC over everything after the SOH
+	unsigned int crc = crc16Ccitt(CRC16_CCITT_INIT, &header[1], 3);
+	crc = crc16Ccitt(crc, head, headLength);
+	crc = crc16Ccitt(crc, body, bodyLength);
+	unsigned char trailer[2] = {crc >> 8, crc};
+
+	// And send it
+	return btSendBytes(header, 4, rxType) && btSendBytes(head, headLength, rxType) &&
+		btSendBytes(body, bodyLength, rxType) && btSendBytes(trailer, 2, rxType);
+}
+
+// This function waits for a host to start and then sends the file
+long sendLogFileBlocks(char *fileName) {
+	// The mode to open the file in (r = read-only)
+	char readArg[] = "r";
+
+	// Open the file
+	FSFILE *logFile = FSfopen(fileName, readArg);
+	if (logFile == NULL)
+		return -1;
+	unsigned long fileSize = logFile->size;
+
+	// Start the parser fresh and wait for the host to ask for the file
+	btRxState = BT_RX_SOH;
+	unsigned char rxType = 0;
+	unsigned long waitCounter = 0;
+	while (rxType != BT_FRAME_START) {
+		// Let a sample go ahead if one is due
+		logFile = logFileYield(logFile, fileName, 0);
+		if (logFile == NULL)
+			return -1;
+		rxType = btPollFrame();
+		waitCounter++;
+		if ((rxType == BT_FRAME_QUIT) || (waitCounter > BT_START_TIMEOUT)) {
+			FSfclose(logFile);
+			return -1;
+		}
+	}
+
+	// The offset everything has been acked up to, the next offset to send,
+	// and where the file is positioned for reading
+	unsigned long ackedOffset = 0;
+	unsigned long nextOffset = 0;
+	unsigned long readOffset = 0;
+	unsigned long windowBytes = 0;
+	unsigned long idleCounter = 0;
+	int retries = 0;
+	int sendInfo = 0;
+	int compress = 0;
+	unsigned char blockHeader[6];
+
+	// For a compressed download, how much history is in btWindow and the
+	// offset it runs up to
+	unsigned int historyLength = 0;
+	unsigned long historyEnd = 0;
+
+	// Loop until everything is acked or the host goes away
+	while (1) {
+		// Let a sample go ahead if one is due.  The host hears nothing
+		// while it is taken and asks to start again from what it has.
+		logFile = logFileYield(logFile, fileName, readOffset);
+		if (logFile == NULL)
+			break;
+
+		// Act on any frame that came in
+		if (rxType == BT_FRAME_START) {
+			// Start or restart at the offset the host asked for
+			ackedOffset = btRxOffset();
+			if (ackedOffset > fileSize)
+				ackedOffset = fileSize;
+			nextOffset = ackedOffset;
+			unsigned char window = btRxFrame[7];
+			if (window < 1)
+				window = 1;
+			if (window > BT_MAX_WINDOW)
+				window = BT_MAX_WINDOW;
+			windowBytes = (unsigned long)window * BT_BLOCK_SIZE;
+			// Older hosts leave the flags off
+			compress = (btRxLength > 5) && (btRxFrame[8] & BT_START_COMPRESS);
+			sendInfo = 1;
+			retries = 0;
+		} else if (rxType == BT_FRAME_ACK) {
+			// Move the acked offset forward (ignore stale acks)
+			unsigned long offset = btRxOffset();
+			if ((offset > ackedOffset) && (offset <= nextOffset)) {
+				ackedOffset = offset;
+				retries = 0;
+				idleCounter = 0;
+			}
+		} else if (rxType == BT_FRAME_NAK) {
+			// Go back and send again from where the host asks
+			unsigned long offset = btRxOffset();
+			if ((offset >= ackedOffset) && (offset <= nextOffset)) {
+				ackedOffset = offset;
+				nextOffset = offset;
+				idleCounter = 0;
+			}
+		} else if (rxType == BT_FRAME_QUIT) {
+			break;
+		}
+		rxType = 0;
+
+		// Tell the host how big the file is
+		if (sendInfo) {
+			btPutLong(blockHeader, fileSize);
+			blockHeader[4] = BT_BLOCK_SIZE >> 8;
+			blockHeader[5] = BT_BLOCK_SIZE & 0xFF;
+			if (!btSendFrame(BT_FRAME_INFO, blockHeader, 6, NULL, 0, &rxType))
+				break;
+			sendInfo = 0;
+		}
+
+		// If everything is acked, we are done
+		if (ackedOffset == fileSize) {
+			btPutLong(blockHeader, fileSize);
+			btSendFrame(BT_FRAME_END, blockHeader, 4, NULL, 0, &rxType);
+			break;
+		}
+
+		if ((nextOffset < fileSize) && (nextOffset - ackedOffset < windowBytes) && compress) {
+			// There is room in the window so send the next block compressed.
+			// The history has to be the block before it, so if we have gone
+			// back read that in first
+			if (historyEnd != nextOffset) {
+				historyLength = BT_BLOCK_SIZE;
+				if (nextOffset < historyLength)
+					historyLength = nextOffset;
+				if (FSfseek(logFile, nextOffset - historyLength, SEEK_SET) != 0)
+					break;
+				if (FSfread(btWindow, 1, historyLength, logFile) != historyLength)
+					break;
+				readOffset = nextOffset;
+				historyEnd = nextOffset;
+			}
+			if (readOffset != nextOffset) {
+				if (FSfseek(logFile, nextOffset, SEEK_SET) != 0)
+					break;
+				readOffset = nextOffset;
+			}
+			unsigned int blockLength = BT_BLOCK_SIZE;
+			if (fileSize - nextOffset < blockLength)
+				blockLength = fileSize - nextOffset;
+			blockLength = FSfread(&btWindow[historyLength], 1, blockLength, logFile);
+			readOffset += blockLength;
+			if (blockLength == 0)
+				break;
+
+			// Send it compressed if that makes it smaller, otherwise as it is
+			btPutLong(blockHeader, nextOffset);
+			unsigned int packedLength = 0;
+			if (blockLength > 2)
+				packedLength = lzCompress(btWindow, historyLength, historyLength + blockLength,
+					btPacked, blockLength - 2);
+			if (packedLength > 0) {
+				blockHeader[4] = blockLength >> 8;
+				blockHeader[5] = blockLength & 0xFF;
+				if (!btSendFrame(BT_FRAME_PACKED, blockHeader, 6, btPacked, packedLength, &rxType))
+					break;
+			} else {
+				if (!btSendFrame(BT_FRAME_DATA, blockHeader, 4, &btWindow[historyLength],
+					blockLength, &rxType))
+					break;
+			}
+			nextOffset += blockLength;
+			idleCounter = 0;
+
+			// This block is the history for the next one
+			memmove(btWindow, &btWindow[historyLength], blockLength);
+			historyLength = blockLength;
+			historyEnd = nextOffset;
+		} else if ((nextOffset < fileSize) && (nextOffset - ackedOffset < windowBytes)) {
+			// There is room in the window so send the next block.  Only seek
+			// when going back, otherwise the file is already there
+			if (readOffset != nextOffset) {
+				if (FSfseek(logFile, nextOffset, SEEK_SET) != 0)
+					break;
+				readOffset = nextOffset;
+			}
+			unsigned int blockLength = BT_BLOCK_SIZE;
+			if (fileSize - nextOffset < blockLength)
+				blockLength = fileSize - nextOffset;
+			blockLength = FSfread(logChunkBuffer, 1, blockLength, logFile);
+			readOffset += blockLength;
+			if (blockLength == 0)
+				break;
+
+			// Send it with its offset in front
+			btPutLong(blockHeader, nextOffset);
+			if (!btSendFrame(BT_FRAME_DATA, blockHeader, 4, logChunkBuffer, blockLength, &rxType))
+				break;
+			nextOffset += blockLength;
+			idleCounter = 0;
+		} else {
+			// The window is full (or everything is sent), wait for the host
+			if (rxType == 0)
+				rxType = btPollFrame();
+			idleCounter++;
+			if (idleCounter > BT_ACK_TIMEOUT) {
+				// Nothing heard, assume something was lost and go back
+				retries++;
+				if (retries > BT_MAX_RETRIES)
+					break;
+				nextOffset = ackedOffset;
+				idleCounter = 0;
+			}
+		}
+	}
+
+	// Close the file and let the last frame go out
+	if (logFile != NULL)
+		FSfclose(logFile);
+	flushU1();
+
+	// Return how far the host got
+	return ackedOffset;
+}
@@ -0,0 +1,252 @@
+/*******************************************************
+ * Burst.c
+ * A high rate sampling mode into a RAM ring buffer with
+ * decimation into the log file
+ *******************************************************/
+
+// Include library for processor
+#include <p24fj256gb110.h>
+
+// Include Microchips SD File Library
+#include "FSIO.h"
+
+// Include the UART library for the terminal
+#include "UART.h"
+
+// Include the library for modbus functionality to flow meter
+#include "modbus.h"
+
+// Include the Real Time Clock functions
+#include "RTCC.h"
+
+// Include the tick counter for pacing the readings
+#include "Timer.h"
+
+// Include the log file functions
+#include "LogFile.h"
+
+// Include the fixed point number formatters
+#include "RecordFormat.h"
+
+// Include the scheduler so samples can go ahead during a burst
+#include "Scheduler.h"
+
+// Include the header for this file
+#include "Burst.h"
+
+// Include the string library
+#include <string.h>
+
+// The ring buffer of raw readings, the index the next one goes in,
+// and how many are in it
+BURST_SAMPLE burstSamples[BURST_BUFFER_SIZE];
+unsigned int burstHead = 0;
+unsigned int burstCount = 0;
+
+// How full the sector staging buffer (the shared logChunkBuffer) is
+// and how full it has to be to make the log file end on a sector
+unsigned int burstStageFill = 0;
+unsigned int burstStageLimit = LOG_CHUNK_SIZE;
+
+// This function adds bytes to the sector staging buffer and writes it
+// to the log file each time it reaches the end of a sector
+void burstStage(char *fileName, const char *data, unsigned int length) {
+	while (length > 0) {
+		unsigned int room = burstStageLimit - burstStageFill;
+		if (room > length)
+			room = length;
+		memcpy(&logChunkBuffer[burstStageFill], data, room);
+		burstStageFill += room;
+		data += room;
+		length -= room;
+
+		// A full sector, write it out
+		if (burstStageFill == burstStageLimit) {
+			appendToFile(fileName, logChunkBuffer, burstStageFill);
+			burstStageFill = 0;
+			burstStageLimit = LOG_CHUNK_SIZE;
+		}
+	}
+}
+
+// This function works out how much the next write has to be so that
+// every write after it lands exactly on a sector of the log file.
+// Returns 0 if the log file could not be opened.
+static int burstStageAlign(char *fileName) {
+	char appendArg[] = "a";
+	FSFILE *logFile = FSfopen(fileName, appendArg);
+	if (logFile == NULL)
+		return 0;
+	burstStageFill = 0;
+	burstStageLimit = LOG_CHUNK_SIZE - (logFile->size % LOG_CHUNK_SIZE);
+	FSfclose(logFile);
+	return 1;
+}
+
+// This function formats a record into the sector staging buffer.  When
+// there is room for the longest record it is formatted straight into
+// place, otherwise it goes through recordBuffer and is split across the
+// sector boundary.
+void burstStageRecord(char *fileName, char *recordBuffer, TIMER_STAMP *groupStamp,
+	RUNNING_STATS *groupStats, long groupTotalizer, float transTemp, unsigned char battCap,
+	unsigned char powerStat, unsigned int groupFaults) {
+	if (burstStageLimit - burstStageFill >= LOG_RECORD_MAX) {
+		burstStageFill += formatLogRecord((char *)&logChunkBuffer[burstStageFill], groupStamp,
+			groupStats, groupTotalizer, transTemp, battCap, powerStat, groupFaults);
+		if (burstStageFill == burstStageLimit) {
+			appendToFile(fileName, logChunkBuffer, burstStageFill);
+			burstStageFill = 0;
+			burstStageLimit = LOG_CHUNK_SIZE;
+		}
+	} else {
+		int length = formatLogRecord(recordBuffer, groupStamp, groupStats, groupTotalizer,
+			transTemp, battCap, powerStat, groupFaults);
+		burstStage(fileName, recordBuffer, length);
+	}
+}
+
+// This function runs a burst
+unsigned int runBurst(char *fileName, unsigned long intervalMs, unsigned long durationSeconds,
+	unsigned int decimation) {
+	// The buffer a record is formatted into when it has to be split
+	// across a sector
+	char recordBuffer[LOG_RECORD_MAX];
+
+	// Start with an empty ring buffer
+	burstHead = 0;
+	burstCount = 0;
+
+	// Line the writes up with the sectors of the log file
+	if (!burstStageAlign(fileName))
+		return 0;
+
+	// The slow changing values are read once for the whole burst
+	float transTemp = readTransmitterTemp();
+	unsigned char battCap = readBatteryCapacity();
+	unsigned char powerStat = readPowerStatus();
+
+	// The time of the first reading going into the current record, and
+	// the statistics of them
+	TIMER_STAMP groupStamp;
+	TIMER_STAMP readingStamp;
+	RUNNING_STATS groupStats;
+	statsReset(&groupStats);
+	unsigned int groupFaults = 0;
+	long groupTotalizer = 0;
+
+	// Work out the schedule
+	if (intervalMs == 0)
+		intervalMs = 1;
+	if (decimation == 0)
+		decimation = 1;
+	unsigned long readingsWanted = (durationSeconds * 1000) / intervalMs;
+	unsigned long intervalTicks = timerMsToTicks(intervalMs);
+	timerStart();
+	unsigned long burstStart = timerGetTicks();
+	unsigned int readingsTaken = 0;
+	unsigned long n;
+	PROCESS_SNAPSHOT snapshot;
+
+	for (n = 0; n < readingsWanted; n++) {
+		// A key on the terminal stops the burst
+		if (charArrivedAtUART1())
+			break;
+
+		// Let a sample go ahead if one is due.  The sample uses the
+		// staging buffer, mounts the card again and turns SPI1 off, so
+		// the record so far and the staged sector are written out first
+		// and the card is started again after.  The readings that came
+		// due while it was taken are skipped, not rushed through.
+		if (schedulerPending()) {
+			if (groupStats.count > 0) {
+				burstStageRecord(fileName, recordBuffer, &groupStamp, &groupStats,
+					groupTotalizer, transTemp, battCap, powerStat, groupFaults);
+				statsReset(&groupStats);
+				groupFaults = 0;
+			}
+			if (burstStageFill > 0) {
+				appendToFile(fileName, logChunkBuffer, burstStageFill);
+				burstStageFill = 0;
+			}
+			schedulerYield();
+			PMD1bits.SPI1MD = 0;
+			if (!FSInit() || !burstStageAlign(fileName))
+				break;
+			unsigned long dueNow = (timerGetTicks() - burstStart) / intervalTicks;
+			if (dueNow > n)
+				n = dueNow;
+			if (n >= readingsWanted)
+				break;
+		}
+
+		// Wait for the reading to be due.  It is scheduled from the start
+		// so slow readings do not make the rate drift.
+		timerWaitUntil(burstStart + n * intervalTicks);
+		unsigned long readingTicks = timerGetTicks();
+		timerStampTake(&readingStamp);
+		if (!readProcessSnapshot(&snapshot))
+			continue;
+		readingsTaken++;
+
+		// Keep it in the ring buffer
+		burstSamples[burstHead].ms = timerTicksToMs(readingTicks - burstStart);
+		burstSamples[burstHead].flowRate = snapshot.flowRate;
+		burstHead++;
+		if (burstHead == BURST_BUFFER_SIZE)
+			burstHead = 0;
+		if (burstCount < BURST_BUFFER_SIZE)
+			burstCount++;
+
+		// The record is stamped with the time of its first reading, to the
+		// millisecond so back to back records still sort
+		if (groupStats.count == 0)
+			groupStamp = readingStamp;
+
+		// Roll it into the current record
+		statsAdd(&groupStats, snapshot.flowRate);
+		groupFaults |= snapshot.faultStatus;
+		groupTotalizer = snapshot.totalizer1Integer;
+
+		// When enough readings are in, stage the record
+		if (groupStats.count >= decimation) {
+			burstStageRecord(fileName, recordBuffer, &groupStamp, &groupStats, groupTotalizer,
+				transTemp, battCap, powerStat, groupFaults);
+			statsReset(&groupStats);
+			groupFaults = 0;
+			putU1('.');
+		}
+	}
+
+	// Stage whatever readings are left over as a last record and write
+	// out the partial sector
+	if (groupStats.count > 0) {
+		burstStageRecord(fileName, recordBuffer, &groupStamp, &groupStats, groupTotalizer,
+			transTemp, battCap, powerStat, groupFaults);
+	}
+	if (burstStageFill > 0) {
+		appendToFile(fileName, logChunkBuffer, burstStageFill);
+		burstStageFill = 0;
+	}
+
+	// Return how many readings were taken
+	return readingsTaken;
+}
+
+// This function prints the raw readings still in the ring buffer
+void printBurstSamples(void) {
+	char lineBuffer[48];
+	unsigned int index = (burstHead + BURST_BUFFER_SIZE - burstCount) % BURST_BUFFER_SIZE;
+	unsigned int i;
+	putsU1("Milliseconds,Flow Rate(l/s)\r");
+	for (i = 0; i < burstCount; i++) {
+		char *out = formatUnsigned(lineBuffer, burstSamples[index].ms, 0, '0');
+		*out++ = ',';
+		out = formatFixed(out, burstSamples[index].flowRate, RECORD_FLOW_DECIMALS);
+		*out++ = '\r';
+		*out = '\0';
+		putsU1(lineBuffer);
+		index++;
+		if (index == BURST_BUFFER_SIZE)
+			index = 0;
+	}
+}
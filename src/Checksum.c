@@ -0,0 +1,29 @@
+/*******************************************************
+ * Checksum.c
+ * Checksum functions that are shared by the log file and
+ * terminal transfer code
+ *******************************************************/
+
+// Include the header for this file
+#include "Checksum.h"
+
+// The CRC-16/CCITT remainders for each possible 4 bit value.  Working
+// a nibble at a time keeps the table small (32 bytes of program memory)
+// and is still four times fewer steps than working a bit at a time
+const unsigned int crc16CcittNibbleTable[16] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+// This function adds length bytes of data to a running CRC-16/CCITT
+unsigned int crc16Ccitt(unsigned int crc, const unsigned char *data, unsigned int length) {
+	while (length > 0) {
+		// Work the high nibble then the low nibble of the byte (the mask keeps
+		// this right if int is ever wider than 16 bits)
+		crc = ((crc << 4) & 0xFFFF) ^ crc16CcittNibbleTable[((crc >> 12) ^ (*data >> 4)) & 0x0F];
+		crc = ((crc << 4) & 0xFFFF) ^ crc16CcittNibbleTable[((crc >> 12) ^ (*data & 0x0F)) & 0x0F];
+		data++;
+		length--;
+	}
+	return crc;
+}
@@ -0,0 +1,1126 @@
+/*******************************************************
+ * Commands.c
+ * The terminal commands and the table they are looked
+ * up in
+ *******************************************************/
+
+// Include the PIC24FJ256GB110 Header
+#include <p24fj256gb110.h>
+
+// Include the UART library for comms to flow meter and terminal
+#include "UART.h"
+
+// Include Microchips SD File Library
+#include "FSIO.h"
+
+// Include the library for modbus functionality to flow meter
+#include "modbus.h"
+
+// Include the functions for moving log files to the terminal
+#include "LogFile.h"
+
+// Include the binary block download protocol
+#include "BlockTransfer.h"
+
+// Include the Real Time Clock functions
+#include "RTCC.h"
+
+// Include the hourly, daily and monthly rollups
+#include "Rollup.h"
+
+// Include the tick counter for timing the dashboard reads
+#include "Timer.h"
+
+// Include the high rate burst sampling mode
+#include "Burst.h"
+
+// Include the fixed point number formatters
+#include "RecordFormat.h"
+
+// Include the live monitor
+#include "Live.h"
+
+// Include the settings kept on the card
+#include "Config.h"
+
+// Include the download cursors
+#include "Cursor.h"
+
+// Include the clock drift calibration
+#include "Drift.h"
+
+// Include the background scheduler
+#include "Scheduler.h"
+
+// Include the parts of the main program the commands use
+#include "TLR_Logger.h"
+
+// Include the header for this file
+#include "Commands.h"
+
+// Include the string and number conversion libraries
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+// This function puts the PIC time in toPrint
+static void formatPicTime(char *toPrint) {
+	RTCC_DATE now;
+	RTCCgrab();
+	RTCCGetDate(&now);
+	sprintf(toPrint,"PIC Time = 20%02u-%02u-%02uT%02u:%02u:%02u \r", 
+		now.year, now.month, now.day, now.hour, now.minute, now.second);
+}
+
+// This function puts a date and time read from the flow meter (year,
+// month, day, hour, minute, second) in toPrint after a label
+static void formatMeterDate(char *toPrint, const char *label, unsigned char *date) {
+	sprintf(toPrint,"%s20%02u-%02u-%02uT%02u:%02u:%02u \r", label, date[0],
+		date[1],date[2],date[3],date[4],date[5]);
+}
+
+// This function turns SPI1 on for the card and holds the card, so no
+// sample is started while the command is using it
+static void commandCardOn(void) {
+	schedulerClaim(SCHEDULER_FILES);
+	PMD1bits.SPI1MD = 0;
+}
+
+// This function turns SPI1 off again and lets the card go, taking any
+// sample that was held up
+static void commandCardOff(void) {
+	PMD1bits.SPI1MD = 1;
+	schedulerRelease(SCHEDULER_FILES);
+}
+
+// This function asks the user for a two digit value, uses one of the
+// RTCCSetBin functions to change that part of the PIC time and puts the
+// new time in toPrint
+static void setPicTimePart(char *command, char *toPrint, const char *prompt,
+	void (*setPart)(unsigned char, int)) {
+	// Prompt for the value
+	putsU1((char *)prompt);
+	schedulerGetReply(command,128);
+	// Use the first two characters of the reply
+	char valueAsChar[3] = {command[0],command[1],'\0'};
+	// Grab the current time to refresh the holding variables
+	RTCCgrab();
+	// Change the one part in the holding variables
+	setPart(atoi(valueAsChar),0);
+	// Write the holding variables to the RTCC
+	RTCCSet();
+	// The millisecond stamps have to be put back in step with it
+	timerStampInvalidate();
+	// The alarm is worked out from the clock so set it again
+	applyAlarmMask();
+	// The drift is measured from here on
+	driftReset();
+	clockValid = 1;
+	// Read the clock again for the reply
+	formatPicTime(toPrint);
+}
+
+// The 'resume' command: leave the terminal and go back to logging
+static int commandResume(char *command, char *toPrint) {
+	// Only the whole word, so a typo does not end the session
+	if (strncmp(command,"resume",6) != 0) {
+		sprintf(toPrint,"Sorry, didn't understand %s \r",command);
+		return COMMAND_STAY;
+	}
+	// Clear the terminal active flag
+	terminalActive = 0;
+	putsU1("Exited terminal and resuming normal operation.\r");
+	return COMMAND_EXIT;
+}
+
+// The 'gpdt' command: get the PIC date and time
+static int commandGpdt(char *command, char *toPrint) {
+	// The user has request the date and time from the PIC
+	formatPicTime(toPrint);
+	return COMMAND_STAY;
+}
+
+// The 'gplf' command: get the PIC log file (printed to the terminal)
+static int commandGplf(char *command, char *toPrint) {
+	// The user has requested a dump of the contents of the log file
+	// Turn on SPI1 and hold the card
+	commandCardOn();
+	// Initialize the File system
+	if (FSInit()){
+		// Define the name of the log file
+		char *logFileName = loggerConfig.logFileName;
+
+		// Send the file out the terminal a sector at a time
+		long bytesSent = dumpLogFile(logFileName);
+		if (bytesSent < 0) {
+			putsU1("Could not open log file\r");
+		}
+	}
+	// Write done message to terminal buffer
+	sprintf(toPrint,"Done reading log file\r");
+	// Turn off SPI1 and let the card go
+	commandCardOff();
+	return COMMAND_STAY;
+}
+
+// The 'tail' command: print the last records of the PIC log file
+static int commandTail(char *command, char *toPrint) {
+	// Ten unless asked otherwise
+	unsigned int records = 10;
+	if (command[4] == ' ')
+		records = atoi(&command[5]);
+	if ((records < 1) || (records > LOG_TAIL_MAX)) {
+		sprintf(toPrint,"Sorry, tail can show 1 to %u records.\r", LOG_TAIL_MAX);
+		return COMMAND_STAY;
+	}
+	// Turn on SPI1 and hold the card
+	commandCardOn();
+	// Initialize the File system
+	if (FSInit()){
+		// Define the name of the log file
+		char *logFileName = loggerConfig.logFileName;
+
+		// Find where the records start going back from the end, and send
+		// from there
+		long recordStart = findLastRecords(logFileName, records);
+		unsigned long offset = recordStart;
+		if ((recordStart < 0) || (dumpLogFileFrom(logFileName, &offset) < 0))
+			putsU1("Could not read log file\r");
+	}
+	// Write done message to terminal buffer
+	sprintf(toPrint,"Done reading log file\r");
+	// Turn off SPI1 and let the card go
+	commandCardOff();
+	return COMMAND_STAY;
+}
+
+// The 'gpbd' command: get the PIC log file as a binary block download (for tlrget)
+static int commandGpbd(char *command, char *toPrint) {
+	// The user (most likely the tlrget host program) wants a binary
+	// block download of the log file
+	// Turn on SPI1 and hold the card
+	commandCardOn();
+	// Initialize the File system
+	if (FSInit()){
+		// Define the name of the log file
+		char *logFileName = loggerConfig.logFileName;
+
+		// Tell the host we are ready and run the transfer
+		putsU1("Ready for binary download\r");
+		long bytesAcked = sendLogFileBlocks(logFileName);
+		if (bytesAcked < 0) {
+			sprintf(toPrint,"\rBinary download did not start\r");
+		} else {
+			sprintf(toPrint,"\rBinary download done at offset %ld\r", bytesAcked);
+		}
+	}
+	// Turn off SPI1 and let the card go
+	commandCardOff();
+	return COMMAND_STAY;
+}
+
+// The 'gpnd' command: get the PIC log records that are new since the
+// client's last download
+static int commandGpnd(char *command, char *toPrint) {
+	// The client name can follow the command, the reply to the prompt
+	// below goes in command so keep a copy
+	char client[CURSOR_NAME_MAX] = CURSOR_DEFAULT_CLIENT;
+	if (command[4] == ' ') {
+		if (!cursorNameValid(&command[5])) {
+			sprintf(toPrint,"Sorry, the client name has to be 1 to %d letters or digits.\r",
+				CURSOR_NAME_MAX - 1);
+			return COMMAND_STAY;
+		}
+		strcpy(client, &command[5]);
+	}
+
+	// Turn on SPI1 and hold the card
+	commandCardOn();
+	// Initialize the File system
+	if (FSInit()){
+		// Define the name of the log file
+		char *logFileName = loggerConfig.logFileName;
+
+		// Send from the client's cursor to the end of the file
+		unsigned long startOffset = cursorLoad(client, logFileName);
+		unsigned long endOffset = startOffset;
+		long bytesSent = dumpLogFileFrom(logFileName, &endOffset);
+		if (bytesSent < 0) {
+			sprintf(toPrint,"Could not open log file\r");
+		} else if (bytesSent == 0) {
+			sprintf(toPrint,"No new data for %s\r", client);
+		} else {
+			// The records sent start at endOffset - bytesSent (the start if
+			// the log was cleared since the last download)
+			sprintf(toPrint,"\rSent %ld bytes for %s from offset %lu to %lu.\r", bytesSent,
+				client, endOffset - bytesSent, endOffset);
+			putsU1(toPrint);
+
+			// Only move the cursor on once the client says it has it all.
+			// The card is let go while the user answers so the samples
+			// carry on, and started again for the cursor.
+			commandCardOff();
+			putsU1("Did it all arrive? Move the cursor on (y|[n])\r>");
+			schedulerGetReply(command,128);
+			commandCardOn();
+			if (command[0] == 'y' || command[0] == 'Y') {
+				if (FSInit() && cursorSave(client, logFileName, endOffset))
+					sprintf(toPrint,"OK, %s cursor now at %lu.\r", client, endOffset);
+				else
+					sprintf(toPrint,"Could not save the cursor.\r");
+			} else {
+				sprintf(toPrint,"%s cursor left at %lu.\r", client, startOffset);
+			}
+		}
+	}
+	// Turn off SPI1 and let the card go
+	commandCardOff();
+	return COMMAND_STAY;
+}
+
+// The 'gpru' command: get the PIC hourly, daily or monthly rollups
+static int commandGpru(char *command, char *toPrint) {
+	// Ask which rollup the user wants
+	putsU1("Choose rollup:\rH = Hourly\rD = Daily\rM = Monthly\r>");
+	schedulerGetReply(command,128);
+	unsigned char rollupLevel = ROLLUP_LEVELS;
+	if (command[0] == 'h' || command[0] == 'H') {
+		rollupLevel = ROLLUP_HOURLY;
+	} else if (command[0] == 'd' || command[0] == 'D') {
+		rollupLevel = ROLLUP_DAILY;
+	} else if (command[0] == 'm' || command[0] == 'M') {
+		rollupLevel = ROLLUP_MONTHLY;
+	}
+	if (rollupLevel == ROLLUP_LEVELS) {
+		sprintf(toPrint,"Sorry, did not understand that option.\r");
+	} else {
+		// Ask where to start
+		putsU1("Enter start as YYMMDDHH: i.e. '08123100' for 2008-12-31 midnight\r>");
+		schedulerGetReply(command,128);
+		char startYear[3] = {command[0],command[1],'\0'};
+		char startMonth[3] = {command[2],command[3],'\0'};
+		char startDay[3] = {command[4],command[5],'\0'};
+		char startHour[3] = {command[6],command[7],'\0'};
+		// Ask how many
+		putsU1("How many records (001-999)?\r>");
+		schedulerGetReply(command,128);
+		char countAsChar[4] = {command[0],command[1],command[2],'\0'};
+		int rollupCount = atoi(countAsChar);
+		// Turn on SPI1 and hold the card
+		commandCardOn();
+		// Initialize the File system and print the records
+		int rollupsPrinted = 0;
+		if (FSInit()){
+			rollupsPrinted = rollupPrintRange(rollupLevel, atoi(startYear), atoi(startMonth),
+				atoi(startDay), atoi(startHour), rollupCount);
+		}
+		// Turn off SPI1 and let the card go
+		commandCardOff();
+		sprintf(toPrint,"%d rollup records.\r", rollupsPrinted);
+	}
+	return COMMAND_STAY;
+}
+
+// The 'spyr' command: set the PIC year
+static int commandSpyr(char *command, char *toPrint) {
+	setPicTimePart(command, toPrint, "Enter last two digits of the year: i.e. '08' for 2008\r> ", RTCCSetBinYear);
+	return COMMAND_STAY;
+}
+
+// The 'spmo' command: set the PIC month
+static int commandSpmo(char *command, char *toPrint) {
+	setPicTimePart(command, toPrint, "Enter month in full two digits: i.e. '08' for August\r> ", RTCCSetBinMonth);
+	return COMMAND_STAY;
+}
+
+// The 'spdy' command: set the PIC day of the month
+static int commandSpdy(char *command, char *toPrint) {
+	setPicTimePart(command, toPrint, "Enter day of month in full two digits: i.e. '02' for the 2nd\r> ", RTCCSetBinDay);
+	return COMMAND_STAY;
+}
+
+// The 'sphr' command: set the PIC hour
+static int commandSphr(char *command, char *toPrint) {
+	setPicTimePart(command, toPrint, "Enter hour of day in full two digits (24 hour): i.e. '02' for 2AM\r> ", RTCCSetBinHour);
+	return COMMAND_STAY;
+}
+
+// The 'spmn' command: set the PIC minute
+static int commandSpmn(char *command, char *toPrint) {
+	setPicTimePart(command, toPrint, "Enter minute in full two digits: i.e. '02' for 2 minutes after hour\r> ", RTCCSetBinMin);
+	return COMMAND_STAY;
+}
+
+// The 'spsc' command: set the PIC seconds
+static int commandSpsc(char *command, char *toPrint) {
+	setPicTimePart(command, toPrint, "Enter seconds in full two digits: i.e. '02' for 2 seconds after minute\r>", RTCCSetBinSec);
+	return COMMAND_STAY;
+}
+
+// The 'ptsm' command: pIC take samples now
+static int commandPtsm(char *command, char *toPrint) {
+	// Ask the user how many samples to take
+	putsU1("How many samples do you want to log (01-99)?\r");
+	putsU1("Enter in two digit format (i.e. 02 for two samples)\r>");
+	schedulerGetReply(command,128);
+	// Grab the user's reply
+	char numSampsAsChar[3] = {command[0],command[1],'\0'};
+	// Convert to an integer
+	int numberOfSamplesToTake = atoi(numSampsAsChar);
+	putsU1("OK, starting to sample");
+	int lc;
+	for (lc = 0; lc < numberOfSamplesToTake; lc++) {
+		// Read the log sample
+		readAndLogSample();
+		putU1('.');
+		// Take any sample the alarm asked for in between
+		schedulerYield();
+	}
+	sprintf(toPrint,"OK, done sampling, use gplf to see the samples. \r");
+	return COMMAND_STAY;
+}
+
+// The 'ptbs' command: pIC take a high rate burst of readings
+static int commandPtbs(char *command, char *toPrint) {
+	// Ask how fast to sample
+	putsU1("Milliseconds between readings (0100-9999, i.e. 1000 for 1Hz)?\r>");
+	schedulerGetReply(command,128);
+	char intervalAsChar[5] = {command[0],command[1],command[2],command[3],'\0'};
+	long burstIntervalMs = atol(intervalAsChar);
+	// Ask for how long
+	putsU1("How many seconds should the burst run (0001-9999)?\r>");
+	schedulerGetReply(command,128);
+	char durationAsChar[5] = {command[0],command[1],command[2],command[3],'\0'};
+	long burstSeconds = atol(durationAsChar);
+	// Ask how many readings go in each log record
+	putsU1("How many readings per log record (01-99)?\r>");
+	schedulerGetReply(command,128);
+	char decimationAsChar[3] = {command[0],command[1],'\0'};
+	int burstDecimation = atoi(decimationAsChar);
+	if ((burstIntervalMs < 100) || (burstSeconds < 1) || (burstDecimation < 1)) {
+		sprintf(toPrint,"Sorry, did not understand those values.\r");
+	} else {
+		putsU1("OK, starting burst, hit any key to stop");
+		// Turn on SPI1 and hold the card
+		commandCardOn();
+		unsigned int burstReadings = 0;
+		if (FSInit()){
+			// Define the name of the log file
+			char *logFileName = loggerConfig.logFileName;
+			burstReadings = runBurst(logFileName, burstIntervalMs, burstSeconds, burstDecimation);
+		}
+		// Turn off SPI1 and let the card go
+		commandCardOff();
+		// Throw away the key that stopped it
+		if (charArrivedAtUART1()) {
+			getU1();
+		}
+		sprintf(toPrint,"\rOK, burst done with %u readings, use gpbr to see them.\r", burstReadings);
+	}
+	return COMMAND_STAY;
+}
+
+// The 'live' command: stream the flow to the terminal until a key is hit.
+// The milliseconds between readings can follow it (i.e. live 250).
+static int commandLive(char *command, char *toPrint) {
+	// One a second unless asked otherwise
+	unsigned long liveIntervalMs = 1000;
+	if (command[4] == ' ')
+		liveIntervalMs = atol(&command[5]);
+	if (liveIntervalMs > LIVE_MAX_INTERVAL_MS) {
+		sprintf(toPrint,"Sorry, the most is %lu milliseconds between readings.\r", LIVE_MAX_INTERVAL_MS);
+		return COMMAND_STAY;
+	}
+	putsU1("Live readings, hit any key to stop\r");
+	unsigned long linesSent;
+	unsigned long linesDropped;
+	runLiveMonitor(liveIntervalMs, &linesSent, &linesDropped);
+	sprintf(toPrint,"\rOK, live stopped after %lu readings (%lu not shown, terminal too slow).\r",
+		linesSent + linesDropped, linesDropped);
+	return COMMAND_STAY;
+}
+
+// The 'gpbr' command: get the PIC readings from the last burst
+static int commandGpbr(char *command, char *toPrint) {
+	// Print the raw readings of the last burst
+	printBurstSamples();
+	sprintf(toPrint,"Done printing burst readings\r");
+	return COMMAND_STAY;
+}
+
+// The 'pssi' command: pIC set the sample interval
+static int commandPssi(char *command, char *toPrint) {
+	putsU1("Choose interval that the PIC will sample the flow meter:\r");
+	putsU1("A = Every 10 minutes\rB = Every hour\rC = Once a day\rD = Once a week\r");
+	putsU1("E = Every minute\rF = Every 5 minutes\rG = Every 15 minutes\r");
+	putsU1("or the number of seconds between samples\r>");
+	schedulerGetReply(command,128);
+	unsigned long seconds = 0;
+	if (command[0] == 'a' || command[0] == 'A') {
+		seconds = 600UL;
+	} else if (command[0] == 'b' || command[0] == 'B'){
+		seconds = 3600UL;
+	} else if (command[0] == 'c' || command[0] == 'C'){
+		seconds = 86400UL;
+	} else if (command[0] == 'd' || command[0] == 'D'){
+		seconds = 604800UL;
+	} else if (command[0] == 'e' || command[0] == 'E'){
+		seconds = 60UL;
+	} else if (command[0] == 'f' || command[0] == 'F'){
+		seconds = 300UL;
+	} else if (command[0] == 'g' || command[0] == 'G'){
+		seconds = 900UL;
+	} else if (command[0] >= '0' && command[0] <= '9'){
+		seconds = atol(command);
+	}
+	if ((seconds < CONFIG_MIN_SAMPLE_SECONDS) || (seconds > CONFIG_MAX_SAMPLE_SECONDS)) {
+		sprintf(toPrint,"Sorry, did not understand that option.\r");
+	} else if (!configIntervalValid(seconds, loggerConfig.averagingWindowMs)) {
+		// The samples could not keep up
+		sprintf(toPrint,"Sorry, a sample takes up to %lu ms, the interval has to be longer.\r",
+			loggerConfig.averagingWindowMs + CONFIG_SAMPLE_OVERHEAD_MS);
+	} else {
+		// The alarm is set for the first whole interval from now
+		loggerConfig.sampleSeconds = seconds;
+		applyAlarmMask();
+		sprintf(toPrint,"OK, set to sample every %lu seconds.\r", seconds);
+	}
+	return COMMAND_STAY;
+}
+
+// The 'pswm' command: pIC set the watch mode thresholds
+static int commandPswm(char *command, char *toPrint) {
+	// The buffer for numbers formatted in fixed point
+	char valueText[FORMAT_FIXED_MAX];
+
+	// Ask whether to watch at all
+	putsU1("Choose watch mode:\r");
+	putsU1("A = Off\rB = Poll every 10 seconds\rC = Poll every minute\r>");
+	schedulerGetReply(command,128);
+	if (command[0] == 'a' || command[0] == 'A') {
+		loggerConfig.watch.enabled = 0;
+		configApply();
+		applyAlarmMask();
+		sprintf(toPrint,"OK, watch mode off.\r");
+	} else if ((command[0] == 'b' || command[0] == 'B') ||
+		(command[0] == 'c' || command[0] == 'C')) {
+		unsigned char pollMask = (command[0] == 'b' || command[0] == 'B') ? 0x2 : 0x3;
+		// Ask for the thresholds
+		putsU1("Log when flow goes above (l/s, i.e. 12.5)?\r>");
+		schedulerGetReply(command,128);
+		float flowHigh = atof(command);
+		putsU1("Log when flow goes below (l/s, i.e. -1.0)?\r>");
+		schedulerGetReply(command,128);
+		float flowLow = atof(command);
+		putsU1("Deadband before a threshold can fire again (l/s)?\r>");
+		schedulerGetReply(command,128);
+		float deadband = atof(command);
+		putsU1("Log when flow changes by more than (l/s, 0 for off)?\r>");
+		schedulerGetReply(command,128);
+		float changeDeadband = atof(command);
+		putsU1("How many polls to log every poll after an event (000-999)?\r>");
+		schedulerGetReply(command,128);
+		char holdAsChar[4] = {command[0],command[1],command[2],'\0'};
+		int holdAsInt = atoi(holdAsChar);
+		if ((flowLow >= flowHigh) || (deadband < 0) || (changeDeadband < 0) || (holdAsInt < 0)) {
+			sprintf(toPrint,"Sorry, did not understand those values.\r");
+		} else {
+			loggerConfig.watch.pollMask = pollMask;
+			loggerConfig.watch.flowHigh = flowHigh;
+			loggerConfig.watch.flowLow = flowLow;
+			loggerConfig.watch.deadband = deadband;
+			loggerConfig.watch.changeDeadband = changeDeadband;
+			loggerConfig.watch.holdPolls = holdAsInt;
+			loggerConfig.watch.enabled = 1;
+			configApply();
+			applyAlarmMask();
+			char lowText[FORMAT_FIXED_MAX];
+			formatFixed(valueText, flowHigh, RECORD_FLOW_DECIMALS);
+			formatFixed(lowText, flowLow, RECORD_FLOW_DECIMALS);
+			sprintf(toPrint,"OK, watching every %lu seconds for flow above %s or below %s.\r",
+				alarmMaskSeconds(pollMask), valueText, lowText);
+		}
+	} else {
+		sprintf(toPrint,"Sorry, did not understand that option.\r");
+	}
+	return COMMAND_STAY;
+}
+
+// The 'pscf' command: pIC save the settings to CONFIG.TXT
+static int commandPscf(char *command, char *toPrint) {
+	// Show what will be saved
+	sprintf(toPrint,"Sample every %lu s, %u readings over %lu ms, watch %s\r",
+		loggerConfig.sampleSeconds, loggerConfig.samplesToAverage,
+		loggerConfig.averagingWindowMs, loggerConfig.watch.enabled ? "on" : "off");
+	putsU1(toPrint);
+	// Ask for the settings that have no command of their own
+	sprintf(toPrint,"Log file name (8.3, enter keeps %s)?\r>", loggerConfig.logFileName);
+	putsU1(toPrint);
+	schedulerGetReply(command,128);
+	if (configFileNameValid(command)) {
+		strcpy(loggerConfig.logFileName, command);
+	} else if (command[0] != '\0') {
+		sprintf(toPrint,"Sorry, %s is not an 8.3 name, keeping %s.\r", command,
+			loggerConfig.logFileName);
+		putsU1(toPrint);
+	}
+	sprintf(toPrint,"Flow meter modbus address (001-247, enter keeps %03u)?\r>",
+		loggerConfig.slaveAddress);
+	putsU1(toPrint);
+	schedulerGetReply(command,128);
+	int addressAsInt = atoi(command);
+	if ((addressAsInt >= 1) && (addressAsInt <= 247)) {
+		loggerConfig.slaveAddress = addressAsInt;
+	}
+	configApply();
+	// Write them all to the card
+	commandCardOn();
+	int saved = 0;
+	if (FSInit()){
+		saved = configSave();
+	}
+	commandCardOff();
+	if (saved) {
+		sprintf(toPrint,"OK, settings saved to %s, logging to %s.\r",
+			CONFIG_FILE_NAME, loggerConfig.logFileName);
+	} else {
+		sprintf(toPrint,"Sorry, could not save the settings.\r");
+	}
+	return COMMAND_STAY;
+}
+
+// The 'psaw' command: pIC set the readings per sample and averaging window
+static int commandPsaw(char *command, char *toPrint) {
+	// Ask how many flow readings go into each sample
+	putsU1("How many flow readings per logged sample (01-99)?\r>");
+	schedulerGetReply(command,128);
+	char readingsAsChar[3] = {command[0],command[1],'\0'};
+	int readingsAsInt = atoi(readingsAsChar);
+	// Ask how long to spread them over
+	putsU1("Over how many seconds should they be spread (000-999)?\r>");
+	schedulerGetReply(command,128);
+	char windowAsChar[4] = {command[0],command[1],command[2],'\0'};
+	int windowAsInt = atoi(windowAsChar);
+	if (readingsAsInt < 1) {
+		sprintf(toPrint,"Sorry, need at least one reading.\r");
+	} else if (!configIntervalValid(loggerConfig.sampleSeconds, windowAsInt * 1000UL)) {
+		// The samples could not keep up with the interval
+		sprintf(toPrint,"Sorry, the window has to be at least %lu ms shorter than the %lu second interval.\r",
+			CONFIG_SAMPLE_OVERHEAD_MS, loggerConfig.sampleSeconds);
+	} else {
+		loggerConfig.samplesToAverage = readingsAsInt;
+		loggerConfig.averagingWindowMs = windowAsInt * 1000UL;
+		sprintf(toPrint,"OK, %u readings spread over %d seconds.\r", loggerConfig.samplesToAverage, windowAsInt);
+	}
+	return COMMAND_STAY;
+}
+
+// The 'spcl' command: clear the PIC log file
+static int commandSpcl(char *command, char *toPrint) {
+	putsU1("This command will CLEAR ALL DATA FROM THE LOGS!!!\r");
+	putsU1("ARE YOU SURE YOU WANT TO DO THIS?(y|[n])\r>");
+	schedulerGetReply(command,128);
+	if (command[0] == 'y' || command[0] == 'Y') {
+		// Enable SPI1 and hold the card
+		commandCardOn();
+
+		// Buffer allocation
+		char headerBuffer[255];
+		// Initialize the File system
+		if (FSInit()){
+			// Define a pointer to the log file
+			FSFILE *logFile;
+
+			// A variable to keep track of how many characters were written 
+			int charsWritten;
+
+			// Define the name of the log file
+			char *logFileName = loggerConfig.logFileName;
+
+			// The mode to open the file in (a = append, w = write/over-write
+			char appendArg[] = "w";
+
+			// Open the file
+			logFile = FSfopen(logFileName,appendArg);
+
+			// If the file opened OK, write a header
+			if (logFile != NULL) {
+				// Write to a buffer first
+				charsWritten = sprintf(headerBuffer,"Timestamp,Avg Flow Rate(l/s),Flow Std Dev(l/s),Min Flow Rate(l/s),Max Flow Rate(l/s),Flow Total(lx100),Transmitter Temp(Deg C),Battery Cap(%),Power Status,Fault Code\n");
+				// Write those to a file
+				FSfwrite(headerBuffer,1,charsWritten,logFile);
+
+				// Close the file
+				FSfclose(logFile);
+			}
+
+			// Every client starts again from the new header
+			cursorClearAll();
+		}
+
+		// Disable SPI1 and let the card go
+		commandCardOff();
+		sprintf(toPrint,"OK, log file is cleared.\r");
+	} else {
+		sprintf(toPrint,"Log file NOT cleared.\r");
+	}
+	return COMMAND_STAY;
+}
+
+// The 'gfdt' command: get the flow meter date and time
+static int commandGfdt(char *command, char *toPrint) {
+	unsigned char flowMeterClock[6];
+	readActualDateAndTime(flowMeterClock);
+	formatMeterDate(toPrint, "Flow Meter Date = ", flowMeterClock);
+	return COMMAND_STAY;
+}
+
+// The 'gfcd' command: get the flow meter calibration date
+static int commandGfcd(char *command, char *toPrint) {
+	unsigned char calDate[6];
+	readCalDateAndTime(calDate);
+	formatMeterDate(toPrint, "Flow Meter Calibration Date = ", calDate);
+	return COMMAND_STAY;
+}
+
+// The 'gfcf' command: get the flow meter calibration factor
+static int commandGfcf(char *command, char *toPrint) {
+	// The buffer for numbers formatted in fixed point
+	char valueText[FORMAT_FIXED_MAX];
+
+	formatFixed(valueText, readCalibrationFactor(), 5);
+	sprintf(toPrint,"Calibration Factor = %s \r", valueText);
+	return COMMAND_STAY;
+}
+
+// The 'gfoh' command: get the flow meter operating hours
+static int commandGfoh(char *command, char *toPrint) {
+	sprintf(toPrint,"Operating hours since first power up = %lu \r", 
+		readOperatingHoursSincePowerUp());
+	return COMMAND_STAY;
+}
+
+// The 'gfnp' command: get the flow meter number of power ups
+static int commandGfnp(char *command, char *toPrint) {
+	sprintf(toPrint,"Number of power ups since first power up = %u \r", 
+		readNumberOfPowerUps());
+	return COMMAND_STAY;
+}
+
+// The 'gftf' command: get the flow meter total flow
+static int commandGftf(char *command, char *toPrint) {
+	sprintf(toPrint,"Total flow since stats reset = %ld \r", 
+		readTotalizer1Integer());
+	return COMMAND_STAY;
+}
+
+// The 'gftu' command: get the flow meter total flow units
+static int commandGftu(char *command, char *toPrint) {
+	unsigned char totalFlowUnitsBuffer[13];
+	readTotalFlowUnits(totalFlowUnitsBuffer);
+	sprintf(toPrint,"Units for total flow = %s \r", 
+		totalFlowUnitsBuffer);
+	return COMMAND_STAY;
+}
+
+// The 'gfqn' command: get the flow meter Qn (nominal flow)
+static int commandGfqn(char *command, char *toPrint) {
+	// The buffer for numbers formatted in fixed point
+	char valueText[FORMAT_FIXED_MAX];
+
+	formatFixed(valueText, readQn(), 5);
+	sprintf(toPrint,"Qn (nominal flow) = %s \r", valueText);
+	return COMMAND_STAY;
+}
+
+// The 'gffl' command: get the flow meter current flow rate
+static int commandGffl(char *command, char *toPrint) {
+	// The buffer for numbers formatted in fixed point
+	char valueText[FORMAT_FIXED_MAX];
+
+	// Do a priming read
+	readFlowRate();
+	formatFixed(valueText, readFlowRate(), 5);
+	sprintf(toPrint,"Current flow rate = %s \r", valueText);
+	return COMMAND_STAY;
+}
+
+// The 'gffr' command: get the flow meter flow rate as a percent of Qn
+static int commandGffr(char *command, char *toPrint) {
+	// The buffer for numbers formatted in fixed point
+	char valueText[FORMAT_FIXED_MAX];
+
+	formatFixed(valueText, readFlowratePercentValue(), 2);
+	sprintf(toPrint,"Current flow rate as percent of Qn = %s%% \r", valueText);
+	return COMMAND_STAY;
+}
+
+// The 'gfmx' command: get the flow meter maximum recorded flow rate
+static int commandGfmx(char *command, char *toPrint) {
+	// The buffer for numbers formatted in fixed point
+	char valueText[FORMAT_FIXED_MAX];
+
+	formatFixed(valueText, readHighestFlowRate(), 5);
+	sprintf(toPrint,"Max flow rate recorded = %s \r", valueText);
+	return COMMAND_STAY;
+}
+
+// The 'gfmd' command: get the flow meter date of the maximum flow rate
+static int commandGfmd(char *command, char *toPrint) {
+	unsigned char maxFlowDate[6];
+	readHighestFlowDateAndTime(maxFlowDate);
+	formatMeterDate(toPrint, "Date of maximum recorded flow = ", maxFlowDate);
+	return COMMAND_STAY;
+}
+
+// The 'gfmn' command: get the flow meter minimum recorded flow rate
+static int commandGfmn(char *command, char *toPrint) {
+	// The buffer for numbers formatted in fixed point
+	char valueText[FORMAT_FIXED_MAX];
+
+	formatFixed(valueText, readLowestFlowRate(), 5);
+	sprintf(toPrint,"Minimum flow rate recorded = %s \r", valueText);
+	return COMMAND_STAY;
+}
+
+// The 'gfnd' command: get the flow meter date of the minimum flow rate
+static int commandGfnd(char *command, char *toPrint) {
+	unsigned char minFlowDate[6];
+	readLowestFlowDateAndTime(minFlowDate);
+	formatMeterDate(toPrint, "Date of minimum recorded flow = ", minFlowDate);
+	return COMMAND_STAY;
+}
+
+// The 'gfhc' command: get the flow meter highest consumption in a day
+static int commandGfhc(char *command, char *toPrint) {
+	// The buffer for numbers formatted in fixed point
+	char valueText[FORMAT_FIXED_MAX];
+
+	formatFixed(valueText, readHighestDayConsumption(), 5);
+	sprintf(toPrint,"Highest consumption in day = %s \r", valueText);
+	return COMMAND_STAY;
+}
+
+// The 'gfhd' command: get the flow meter date of the highest day consumption
+static int commandGfhd(char *command, char *toPrint) {
+	unsigned char highestConsumptionDate[6];
+	readHighestDayConsumptionDateAndTime(highestConsumptionDate);
+	formatMeterDate(toPrint, "Date of highest day consumption = ", highestConsumptionDate);
+	return COMMAND_STAY;
+}
+
+// The 'gffc' command: get the flow meter low flow cutoff
+static int commandGffc(char *command, char *toPrint) {
+	// The buffer for numbers formatted in fixed point
+	char valueText[FORMAT_FIXED_MAX];
+
+	formatFixed(valueText, readLowFlowCutoff(), 2);
+	sprintf(toPrint,"Flowrate cutoff (as %% of Qn) = %s%% \r", valueText);
+	return COMMAND_STAY;
+}
+
+// The 'gffu' command: get the flow meter flow rate units
+static int commandGffu(char *command, char *toPrint) {
+	unsigned char flowRateUnitsBuffer[13];
+	readFlowRateUnits(flowRateUnitsBuffer);
+	sprintf(toPrint,"Units for flow rate = %s \r", 
+		flowRateUnitsBuffer);
+	return COMMAND_STAY;
+}
+
+// The 'gfvl' command: get the flow meter current velocity
+static int commandGfvl(char *command, char *toPrint) {
+	// The buffer for numbers formatted in fixed point
+	char valueText[FORMAT_FIXED_MAX];
+
+	formatFixed(valueText, readActualVelocity(), 5);
+	sprintf(toPrint,"Current Velocity = %s \r", valueText);
+	return COMMAND_STAY;
+}
+
+// The 'gftp' command: get the flow meter transmitter temperature
+static int commandGftp(char *command, char *toPrint) {
+	// The buffer for numbers formatted in fixed point
+	char valueText[FORMAT_FIXED_MAX];
+
+	formatFixed(valueText, readTransmitterTemp(), 2);
+	sprintf(toPrint,"Current transmitter temp = %s degrees C.\r", valueText);
+	return COMMAND_STAY;
+}
+
+// The 'gfbt' command: get the flow meter battery capacity
+static int commandGfbt(char *command, char *toPrint) {
+	sprintf(toPrint,"Battery %% of max capacity = %3u%%\r", 
+		readBatteryCapacity());
+	return COMMAND_STAY;
+}
+
+// The 'gfps' command: get the flow meter power status
+static int commandGfps(char *command, char *toPrint) {
+	sprintf(toPrint,"Power Status = %02u\r", 
+		readPowerStatus());
+	return COMMAND_STAY;
+}
+
+// The 'gfft' command: get the flow meter fault status
+static int commandGfft(char *command, char *toPrint) {
+	sprintf(toPrint,"Fault Status = 0x%o\r", 
+		readFaultStatus());
+	return COMMAND_STAY;
+}
+
+// The 'gfmt' command: get the flow meter comm module type
+static int commandGfmt(char *command, char *toPrint) {
+	sprintf(toPrint,"Comm module type = %02u\r", 
+		readCommModuleType());
+	return COMMAND_STAY;
+}
+
+// The 'gfll' command: get the flow meter date of the last log entry
+static int commandGfll(char *command, char *toPrint) {
+	unsigned char latestLogDate[6];
+	readLastLogDate(latestLogDate);
+	formatMeterDate(toPrint, "Date of last log entry = ", latestLogDate);
+	return COMMAND_STAY;
+}
+
+// This function prints one dashboard line with a fixed point value
+static void printDashboardValue(const char *label, float value, unsigned char decimals,
+	const char *units) {
+	char line[80];
+	char valueText[FORMAT_FIXED_MAX];
+	formatFixed(valueText, value, decimals);
+	sprintf(line,"  %-22s %s %s\r", label, valueText, units);
+	putsU1(line);
+}
+
+// This function prints one dashboard line with a meter date
+static void printDashboardDate(const char *label, unsigned char *date) {
+	char line[80];
+	sprintf(line,"  %-22s 20%02u-%02u-%02uT%02u:%02u:%02u\r", label, date[0], date[1],
+		date[2], date[3], date[4], date[5]);
+	putsU1(line);
+}
+
+// The 'gfal' command: get all the flow meter values as a dashboard
+static int commandGfal(char *command, char *toPrint) {
+	char line[80];
+	METER_DASHBOARD dashboard;
+
+	// Time the reads with the tick counter
+	timerStart();
+	unsigned long startTicks = timerGetTicks();
+	unsigned char blocks = readMeterDashboard(&dashboard);
+	unsigned long readMs = timerTicksToMs(timerGetTicks() - startTicks);
+
+	// The process values
+	putsU1("Process\r");
+	if (dashboard.blocksRead & DASHBOARD_PROCESS) {
+		printDashboardValue("Flow rate", dashboard.process.flowRate, 5, "l/s");
+		printDashboardValue("Flow (% of Qn)", dashboard.process.flowratePercent, 2, "%");
+		printDashboardValue("Velocity", dashboard.process.velocity, 5, "mm/s");
+		printDashboardValue("Insulation", dashboard.process.insulationValue, 2, "");
+		sprintf(line,"  %-22s %ld\r", "Totalizer 1", dashboard.process.totalizer1Integer);
+		putsU1(line);
+		sprintf(line,"  %-22s 0x%o\r", "Fault status", dashboard.process.faultStatus);
+		putsU1(line);
+	} else {
+		putsU1("  no reply\r");
+	}
+
+	// The meter status
+	putsU1("Status\r");
+	if (dashboard.blocksRead & DASHBOARD_STATUS) {
+		sprintf(line,"  %-22s %3u%%\r", "Battery capacity", dashboard.batteryCapacity);
+		putsU1(line);
+		sprintf(line,"  %-22s %02u\r", "Power status", dashboard.powerStatus);
+		putsU1(line);
+		printDashboardValue("Transmitter temp", dashboard.transmitterTemp, 2, "degrees C");
+		printDashboardDate("Meter clock", dashboard.meterDate);
+	} else {
+		putsU1("  no reply\r");
+	}
+	if (dashboard.blocksRead & DASHBOARD_HOURS) {
+		sprintf(line,"  %-22s %lu\r", "Operating hours", dashboard.operatingHours);
+		putsU1(line);
+	}
+	if (dashboard.blocksRead & DASHBOARD_MODULE) {
+		sprintf(line,"  %-22s %02u\r", "Comm module type", dashboard.commModuleType);
+		putsU1(line);
+	}
+
+	// The meter set up
+	putsU1("Setup\r");
+	if (dashboard.blocksRead & DASHBOARD_SETUP) {
+		sprintf(line,"  %-22s %s\r", "Flow rate units", dashboard.flowUnits);
+		putsU1(line);
+		sprintf(line,"  %-22s %s\r", "Total flow units", dashboard.totalUnits);
+		putsU1(line);
+		printDashboardValue("Qn (nominal flow)", dashboard.qn, 5, "");
+		printDashboardValue("Low flow cutoff", dashboard.lowFlowCutoff, 2, "% of Qn");
+		printDashboardValue("Calibration factor", dashboard.calibrationFactor, 5, "");
+		printDashboardDate("Calibration date", dashboard.calibrationDate);
+	} else {
+		putsU1("  no reply\r");
+	}
+
+	// The history the meter keeps
+	putsU1("History\r");
+	if (dashboard.blocksRead & DASHBOARD_HISTORY) {
+		sprintf(line,"  %-22s %u\r", "Power ups", dashboard.powerUps);
+		putsU1(line);
+		printDashboardValue("Highest flow", dashboard.highestFlow, 5, "");
+		printDashboardDate("  on", dashboard.highestFlowDate);
+		printDashboardValue("Lowest flow", dashboard.lowestFlow, 5, "");
+		printDashboardDate("  on", dashboard.lowestFlowDate);
+		printDashboardValue("Highest day", dashboard.highestDayConsumption, 5, "");
+		printDashboardDate("  on", dashboard.highestDayConsumptionDate);
+		printDashboardDate("Last log entry", dashboard.lastLogDate);
+	} else {
+		putsU1("  no reply\r");
+	}
+
+	sprintf(toPrint,"Read %u of %u register blocks in %lu ms\r", blocks,
+		MODBUS_DASHBOARD_BLOCKS, readMs);
+	return COMMAND_STAY;
+}
+
+// The 'fsyn' command: set the flow meter clock to the PIC time
+static int commandFsyn(char *command, char *toPrint) {
+	putsU1("Flow Meter Clock will be set to time on PIC\r");
+	RTCC_DATE now;
+	RTCCgrab();
+	RTCCGetDate(&now);
+	unsigned char timeSnapshot[6] = {now.year,now.month,now.day,now.hour,now.minute,now.second};
+	setActualDateAndTime(timeSnapshot);
+	// The drift is measured from here on
+	driftReset();
+	putsU1("OK, time set on flow meter.\r");					
+	return COMMAND_STAY;
+}
+
+// The 'help' command: list the commands
+static int commandHelp(char *command, char *toPrint) {
+	// The list comes from the command table
+	printCommandHelp();
+	return COMMAND_STAY;
+}
+
+// The command table.  This MUST stay sorted by command (the keys sort
+// the same as the letters) because it is binary searched.
+const COMMAND commandTable[] = {
+	{COMMAND_KEY('f','s','y','n'), "fsyn", commandFsyn, "Set the flow meter clock to the PIC time", 3033, 3},
+	{COMMAND_KEY('g','f','a','l'), "gfal", commandGfal, "Get all the flow meter values as a dashboard (registers 3000-3020, 3030-3043, 80-81, 210-240, 366-478 and 822)", 0, 0},
+	{COMMAND_KEY('g','f','b','t'), "gfbt", commandGfbt, "Get the flow meter battery capacity", 3030, 1},
+	{COMMAND_KEY('g','f','c','d'), "gfcd", commandGfcd, "Get the flow meter calibration date", 230, 3},
+	{COMMAND_KEY('g','f','c','f'), "gfcf", commandGfcf, "Get the flow meter calibration factor", 228, 2},
+	{COMMAND_KEY('g','f','d','t'), "gfdt", commandGfdt, "Get the flow meter date and time", 3033, 3},
+	{COMMAND_KEY('g','f','f','c'), "gffc", commandGffc, "Get the flow meter low flow cutoff", 239, 2},
+	{COMMAND_KEY('g','f','f','l'), "gffl", commandGffl, "Get the flow meter current flow rate", 3002, 2},
+	{COMMAND_KEY('g','f','f','r'), "gffr", commandGffr, "Get the flow meter flow rate as a percent of Qn", 3012, 2},
+	{COMMAND_KEY('g','f','f','t'), "gfft", commandGfft, "Get the flow meter fault status", 3016, 1},
+	{COMMAND_KEY('g','f','f','u'), "gffu", commandGffu, "Get the flow meter flow rate units", 210, 6},
+	{COMMAND_KEY('g','f','h','c'), "gfhc", commandGfhc, "Get the flow meter highest consumption in a day", 417, 2},
+	{COMMAND_KEY('g','f','h','d'), "gfhd", commandGfhd, "Get the flow meter date of the highest day consumption", 419, 3},
+	{COMMAND_KEY('g','f','l','l'), "gfll", commandGfll, "Get the flow meter date of the last log entry", 476, 3},
+	{COMMAND_KEY('g','f','m','d'), "gfmd", commandGfmd, "Get the flow meter date of the maximum flow rate", 409, 3},
+	{COMMAND_KEY('g','f','m','n'), "gfmn", commandGfmn, "Get the flow meter minimum recorded flow rate", 412, 2},
+	{COMMAND_KEY('g','f','m','t'), "gfmt", commandGfmt, "Get the flow meter comm module type", 822, 1},
+	{COMMAND_KEY('g','f','m','x'), "gfmx", commandGfmx, "Get the flow meter maximum recorded flow rate", 407, 2},
+	{COMMAND_KEY('g','f','n','d'), "gfnd", commandGfnd, "Get the flow meter date of the minimum flow rate", 414, 3},
+	{COMMAND_KEY('g','f','n','p'), "gfnp", commandGfnp, "Get the flow meter number of power ups", 366, 1},
+	{COMMAND_KEY('g','f','o','h'), "gfoh", commandGfoh, "Get the flow meter operating hours", 80, 2},
+	{COMMAND_KEY('g','f','p','s'), "gfps", commandGfps, "Get the flow meter power status", 3031, 1},
+	{COMMAND_KEY('g','f','q','n'), "gfqn", commandGfqn, "Get the flow meter Qn (nominal flow)", 226, 2},
+	{COMMAND_KEY('g','f','t','f'), "gftf", commandGftf, "Get the flow meter total flow", 3017, 4},
+	{COMMAND_KEY('g','f','t','p'), "gftp", commandGftp, "Get the flow meter transmitter temperature", 3042, 2},
+	{COMMAND_KEY('g','f','t','u'), "gftu", commandGftu, "Get the flow meter total flow units", 216, 6},
+	{COMMAND_KEY('g','f','v','l'), "gfvl", commandGfvl, "Get the flow meter current velocity", 3000, 2},
+	{COMMAND_KEY('g','p','b','d'), "gpbd", commandGpbd, "Get the PIC log file as a binary block download (for tlrget)", 0, 0},
+	{COMMAND_KEY('g','p','b','r'), "gpbr", commandGpbr, "Get the PIC readings from the last burst", 0, 0},
+	{COMMAND_KEY('g','p','d','t'), "gpdt", commandGpdt, "Get the PIC date and time", 0, 0},
+	{COMMAND_KEY('g','p','l','f'), "gplf", commandGplf, "Get the PIC log file (printed to the terminal)", 0, 0},
+	{COMMAND_KEY('g','p','n','d'), "gpnd", commandGpnd, "Get the PIC log records new since the last download (gpnd [client])", 0, 0},
+	{COMMAND_KEY('g','p','r','u'), "gpru", commandGpru, "Get the PIC hourly, daily or monthly rollups", 0, 0},
+	{COMMAND_KEY('h','e','l','p'), "help", commandHelp, "List the commands", 0, 0},
+	{COMMAND_KEY('l','i','v','e'), "live", commandLive, "Stream the flow until a key is hit (live [ms between readings])", 3000, 21},
+	{COMMAND_KEY('p','s','a','w'), "psaw", commandPsaw, "PIC set the readings per sample and averaging window", 0, 0},
+	{COMMAND_KEY('p','s','c','f'), "pscf", commandPscf, "PIC save the settings to CONFIG.TXT", 0, 0},
+	{COMMAND_KEY('p','s','s','i'), "pssi", commandPssi, "PIC set the sample interval", 0, 0},
+	{COMMAND_KEY('p','s','w','m'), "pswm", commandPswm, "PIC set the watch mode thresholds", 3000, 21},
+	{COMMAND_KEY('p','t','b','s'), "ptbs", commandPtbs, "PIC take a high rate burst of readings", 3000, 21},
+	{COMMAND_KEY('p','t','s','m'), "ptsm", commandPtsm, "PIC take samples now", 0, 0},
+	{COMMAND_KEY('r','e','s','u'), "resume", commandResume, "Leave the terminal and go back to logging", 0, 0},
+	{COMMAND_KEY('s','p','c','l'), "spcl", commandSpcl, "Clear the PIC log file", 0, 0},
+	{COMMAND_KEY('s','p','d','y'), "spdy", commandSpdy, "Set the PIC day of the month", 0, 0},
+	{COMMAND_KEY('s','p','h','r'), "sphr", commandSphr, "Set the PIC hour", 0, 0},
+	{COMMAND_KEY('s','p','m','n'), "spmn", commandSpmn, "Set the PIC minute", 0, 0},
+	{COMMAND_KEY('s','p','m','o'), "spmo", commandSpmo, "Set the PIC month", 0, 0},
+	{COMMAND_KEY('s','p','s','c'), "spsc", commandSpsc, "Set the PIC seconds", 0, 0},
+	{COMMAND_KEY('s','p','y','r'), "spyr", commandSpyr, "Set the PIC year", 0, 0},
+	{COMMAND_KEY('t','a','i','l'), "tail", commandTail, "Print the last records of the PIC log file (tail [records])", 0, 0},
+};
+
+// The number of commands in the table
+#define COMMAND_COUNT	(sizeof(commandTable) / sizeof(commandTable[0]))
+
+// This function finds the table entry for the command typed
+const COMMAND *findCommand(const char *command) {
+	// Pack the first four letters (a shorter command packs in its
+	// terminator and so will not match anything)
+	unsigned long key = 0;
+	unsigned char i;
+	for (i = 0; i < 4; i++) {
+		key = (key << 8) | (unsigned char)command[i];
+		if (command[i] == '\0') {
+			key <<= 8 * (3 - i);
+			break;
+		}
+	}
+
+	// Binary search the table
+	unsigned int low = 0;
+	unsigned int high = COMMAND_COUNT;
+	while (low < high) {
+		unsigned int middle = (low + high) / 2;
+		if (commandTable[middle].key == key)
+			return &commandTable[middle];
+		if (commandTable[middle].key < key)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return NULL;
+}
+
+// This function runs the command typed
+int runCommand(char *command, char *toPrint) {
+	const COMMAND *entry = findCommand(command);
+	if (entry == NULL) {
+		if (command[0] != '\0')
+			sprintf(toPrint,"Sorry, didn't understand %s \r",command);
+		return COMMAND_STAY;
+	}
+
+	// The commands hold the card only while they use it, read their
+	// answers with schedulerGetReply and yield in their long loops, so
+	// the samples carry on while they run
+	return entry->handler(command, toPrint);
+}
+
+// This function prints the list of commands from the table
+void printCommandHelp(void) {
+	// Room for the longest help line (gfal, with its register blocks)
+	char line[128];
+	unsigned int i;
+	for (i = 0; i < COMMAND_COUNT; i++) {
+		const COMMAND *entry = &commandTable[i];
+		if (entry->registerCount > 0) {
+			sprintf(line,"%-6s %s (registers %u-%u)\r", entry->name, entry->help,
+				entry->firstRegister, entry->firstRegister + entry->registerCount - 1);
+		} else {
+			sprintf(line,"%-6s %s\r", entry->name, entry->help);
+		}
+		putsU1(line);
+	}
+}
@@ -0,0 +1,247 @@
+/*******************************************************
+ * Config.c
+ * The logger settings and the CONFIG.TXT file they are
+ * kept in
+ *
+ * The file is plain text, one key=value per line, for
+ * example:
+ *    interval=3600
+ *    readings=4
+ *    window=3000
+ *    logfile=DATALOG.TXT
+ *    slave=1
+ *    watch=0
+ *    watchpoll=60
+ *    watchhigh=1000.000
+ *    watchlow=-1000.000
+ *    watchdeadband=0.100
+ *    watchchange=0.000
+ *    watchhold=10
+ *    rtccal=0
+ * Lines starting with # and keys it does not know are
+ * skipped.
+ *******************************************************/
+
+// Include Microchips SD File Library
+#include "FSIO.h"
+
+// Include the library for modbus functionality to flow meter
+#include "modbus.h"
+
+// Include the log file functions (for the shared sector buffer)
+#include "LogFile.h"
+
+// Include the fixed point number formatters
+#include "RecordFormat.h"
+
+// Include the Real Time Clock functions (for the calibration)
+#include "RTCC.h"
+
+// Include the header for this file
+#include "Config.h"
+
+// Include the string and number conversion libraries
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+// The current settings
+LOGGER_CONFIG loggerConfig;
+
+// This function puts the default settings in loggerConfig
+void configDefaults(void) {
+	loggerConfig.sampleSeconds = CONFIG_DEFAULT_SAMPLE_SECONDS;
+	loggerConfig.averagingWindowMs = CONFIG_DEFAULT_AVERAGING_WINDOW_MS;
+	loggerConfig.samplesToAverage = CONFIG_DEFAULT_SAMPLES_TO_AVERAGE;
+	loggerConfig.slaveAddress = MODBUS_DEFAULT_SLAVE_ADDRESS;
+	strcpy(loggerConfig.logFileName, CONFIG_DEFAULT_LOG_FILE);
+	loggerConfig.watch = watchSettings;
+	loggerConfig.rtccCalibration = 0;
+}
+
+// This function checks an interval against the averaging window
+int configIntervalValid(unsigned long seconds, unsigned long windowMs) {
+	if ((seconds < CONFIG_MIN_SAMPLE_SECONDS) || (seconds > CONFIG_MAX_SAMPLE_SECONDS))
+		return 0;
+	unsigned long sampleMs = seconds * 1000UL;
+	return (sampleMs > CONFIG_SAMPLE_OVERHEAD_MS) &&
+		(windowMs < sampleMs - CONFIG_SAMPLE_OVERHEAD_MS);
+}
+
+// This function returns 1 if c can be in a short (8.3) file name
+static int configFileNameChar(char c) {
+	if (((c >= 'A') && (c <= 'Z')) || ((c >= 'a') && (c <= 'z')) || ((c >= '0') && (c <= '9')))
+		return 1;
+	return (c != '\0') && (strchr("$%'-_@~`!(){}^#&", c) != NULL);
+}
+
+// This function checks a log file name is a legal 8.3 name
+int configFileNameValid(const char *name) {
+	unsigned int length = 0;
+	while (configFileNameChar(name[length]))
+		length++;
+	if ((length < 1) || (length > 8))
+		return 0;
+	if (name[length] == '\0')
+		return 1;
+	if (name[length] != '.')
+		return 0;
+	const char *extension = &name[length + 1];
+	length = 0;
+	while (configFileNameChar(extension[length]))
+		length++;
+	return (length >= 1) && (length <= 3) && (extension[length] == '\0');
+}
+
+// This function sets one setting from a key and its value
+static void configSet(char *key, char *value) {
+	if (strcmp(key, "interval") == 0) {
+		// Checked against the window once the whole file is read
+		unsigned long seconds = atol(value);
+		if ((seconds >= CONFIG_MIN_SAMPLE_SECONDS) && (seconds <= CONFIG_MAX_SAMPLE_SECONDS))
+			loggerConfig.sampleSeconds = seconds;
+	} else if (strcmp(key, "readings") == 0) {
+		int readings = atoi(value);
+		if (readings > 0)
+			loggerConfig.samplesToAverage = readings;
+	} else if (strcmp(key, "window") == 0) {
+		loggerConfig.averagingWindowMs = atol(value);
+	} else if (strcmp(key, "logfile") == 0) {
+		// A name the card cannot take would stop the logging, so fall back
+		// to the default
+		if (configFileNameValid(value))
+			strcpy(loggerConfig.logFileName, value);
+		else
+			strcpy(loggerConfig.logFileName, CONFIG_DEFAULT_LOG_FILE);
+	} else if (strcmp(key, "slave") == 0) {
+		int address = atoi(value);
+		if ((address >= 1) && (address <= 247))
+			loggerConfig.slaveAddress = address;
+	} else if (strcmp(key, "watch") == 0) {
+		loggerConfig.watch.enabled = (atoi(value) != 0);
+	} else if (strcmp(key, "watchpoll") == 0) {
+		loggerConfig.watch.pollMask = (atoi(value) == 10) ? 0x2 : 0x3;
+	} else if (strcmp(key, "watchhigh") == 0) {
+		loggerConfig.watch.flowHigh = atof(value);
+	} else if (strcmp(key, "watchlow") == 0) {
+		loggerConfig.watch.flowLow = atof(value);
+	} else if (strcmp(key, "watchdeadband") == 0) {
+		loggerConfig.watch.deadband = atof(value);
+	} else if (strcmp(key, "watchchange") == 0) {
+		loggerConfig.watch.changeDeadband = atof(value);
+	} else if (strcmp(key, "watchhold") == 0) {
+		loggerConfig.watch.holdPolls = atoi(value);
+	} else if (strcmp(key, "rtccal") == 0) {
+		int calibration = atoi(value);
+		if ((calibration >= RTCC_CAL_MIN) && (calibration <= RTCC_CAL_MAX))
+			loggerConfig.rtccCalibration = calibration;
+	}
+}
+
+// This function handles one line of the config file
+static void configParseLine(char *line) {
+	// Skip comments and blank lines
+	if ((line[0] == '#') || (line[0] == '\0'))
+		return;
+
+	// Split at the equals sign
+	char *value = strchr(line, '=');
+	if (value == NULL)
+		return;
+	*value++ = '\0';
+	configSet(line, value);
+}
+
+// This function reads CONFIG.TXT into loggerConfig
+int configLoad(void) {
+	// The mode to open the file in (r = read-only)
+	char readArg[] = "r";
+	char fileName[] = CONFIG_FILE_NAME;
+	char line[CONFIG_LINE_MAX];
+	unsigned int lineLength = 0;
+
+	// Open the file
+	FSFILE *configFile = FSfopen(fileName, readArg);
+	if (configFile == NULL)
+		return 0;
+
+	// Read it a sector at a time and pull the lines out
+	while (!FSfeof(configFile)) {
+		unsigned int bytesRead = FSfread(logChunkBuffer, 1, LOG_CHUNK_SIZE, configFile);
+		if (bytesRead == 0)
+			break;
+		unsigned int i;
+		for (i = 0; i < bytesRead; i++) {
+			char c = logChunkBuffer[i];
+			if ((c == '\n') || (c == '\r')) {
+				line[lineLength] = '\0';
+				configParseLine(line);
+				lineLength = 0;
+			} else if (lineLength < CONFIG_LINE_MAX - 1) {
+				line[lineLength++] = c;
+			}
+		}
+	}
+
+	// The last line might not have a newline
+	line[lineLength] = '\0';
+	configParseLine(line);
+
+	// Close the file
+	FSfclose(configFile);
+
+	// An interval the samples could not keep up with goes back to the
+	// default, and so does the window if even that is too short for it
+	if (!configIntervalValid(loggerConfig.sampleSeconds, loggerConfig.averagingWindowMs)) {
+		loggerConfig.sampleSeconds = CONFIG_DEFAULT_SAMPLE_SECONDS;
+		if (!configIntervalValid(loggerConfig.sampleSeconds, loggerConfig.averagingWindowMs))
+			loggerConfig.averagingWindowMs = CONFIG_DEFAULT_AVERAGING_WINDOW_MS;
+	}
+	return 1;
+}
+
+// This function adds a key and a float value to the file buffer
+static unsigned int configPutFloat(char *out, char *key, float value) {
+	char valueText[FORMAT_FIXED_MAX];
+	formatFixed(valueText, value, RECORD_FLOW_DECIMALS);
+	return sprintf(out, "%s=%s\n", key, valueText);
+}
+
+// This function writes loggerConfig out to CONFIG.TXT
+int configSave(void) {
+	// The mode to open the file in (w = write/over-write)
+	char writeArg[] = "w";
+	char fileName[] = CONFIG_FILE_NAME;
+
+	// Build the whole file in the shared buffer (it is well under a sector)
+	char *out = (char *)logChunkBuffer;
+	unsigned int length = 0;
+	length += sprintf(out + length, "interval=%lu\n", loggerConfig.sampleSeconds);
+	length += sprintf(out + length, "readings=%u\n", loggerConfig.samplesToAverage);
+	length += sprintf(out + length, "window=%lu\n", loggerConfig.averagingWindowMs);
+	length += sprintf(out + length, "logfile=%s\n", loggerConfig.logFileName);
+	length += sprintf(out + length, "slave=%u\n", loggerConfig.slaveAddress);
+	length += sprintf(out + length, "watch=%u\n", loggerConfig.watch.enabled);
+	length += sprintf(out + length, "watchpoll=%u\n", (loggerConfig.watch.pollMask == 0x2) ? 10 : 60);
+	length += configPutFloat(out + length, "watchhigh", loggerConfig.watch.flowHigh);
+	length += configPutFloat(out + length, "watchlow", loggerConfig.watch.flowLow);
+	length += configPutFloat(out + length, "watchdeadband", loggerConfig.watch.deadband);
+	length += configPutFloat(out + length, "watchchange", loggerConfig.watch.changeDeadband);
+	length += sprintf(out + length, "watchhold=%u\n", loggerConfig.watch.holdPolls);
+	length += sprintf(out + length, "rtccal=%d\n", loggerConfig.rtccCalibration);
+
+	// Write it over the old file
+	FSFILE *configFile = FSfopen(fileName, writeArg);
+	if (configFile == NULL)
+		return 0;
+	unsigned int written = FSfwrite(out, 1, length, configFile);
+	FSfclose(configFile);
+	return written == length;
+}
+
+// This function hands settings over to the modules that use them
+void configApply(void) {
+	modbusSlaveAddress = loggerConfig.slaveAddress;
+	watchSettings = loggerConfig.watch;
+	RTCCSetCalibration(loggerConfig.rtccCalibration);
+}
@@ -0,0 +1,138 @@
+/*******************************************************
+ * Cursor.c
+ * The download cursors and the CURSORS.TXT file they are
+ * kept in (see Cursor.h for the layout)
+ *******************************************************/
+
+// Include Microchips SD File Library
+#include "FSIO.h"
+
+// Include the log file functions (for the shared sector buffer)
+#include "LogFile.h"
+
+// Include the header for this file
+#include "Cursor.h"
+
+// Include the string and number conversion libraries
+#include <string.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+// The longest line in the file (name, comma, 8.3 file name, comma, offset
+// and newline)
+#define CURSOR_LINE_MAX		(CURSOR_NAME_MAX + 13 + 12)
+
+// This function checks a client name
+int cursorNameValid(const char *client) {
+	unsigned int length = 0;
+	while (client[length] != '\0') {
+		char c = client[length];
+		if (!(((c >= 'A') && (c <= 'Z')) || ((c >= 'a') && (c <= 'z')) || ((c >= '0') && (c <= '9'))))
+			return 0;
+		length++;
+	}
+	return (length > 0) && (length < CURSOR_NAME_MAX);
+}
+
+// This function reads the whole cursor file into the shared buffer with
+// a terminator on the end.  Returns its length (0 if there is no file).
+static unsigned int cursorReadFile(void) {
+	// The mode to open the file in (r = read-only)
+	char readArg[] = "r";
+	char fileName[] = CURSOR_FILE_NAME;
+
+	FSFILE *cursorFile = FSfopen(fileName, readArg);
+	if (cursorFile == NULL)
+		return 0;
+	unsigned int length = FSfread(logChunkBuffer, 1, LOG_CHUNK_SIZE - 1, cursorFile);
+	FSfclose(cursorFile);
+	logChunkBuffer[length] = '\0';
+	return length;
+}
+
+// This function checks whether the line at line is for client.
+// Returns a pointer to the rest of the line after the client name and
+// its comma, or NULL.
+static char *cursorMatch(char *line, const char *client) {
+	unsigned int length = strlen(client);
+	if ((strncmp(line, client, length) == 0) && (line[length] == ','))
+		return &line[length + 1];
+	return NULL;
+}
+
+// This function looks up a cursor
+unsigned long cursorLoad(const char *client, const char *fileName) {
+	unsigned int length = cursorReadFile();
+	char *line = (char *)logChunkBuffer;
+	char *end = line + length;
+
+	// Go through the lines looking for the client
+	while (line < end) {
+		char *next = strchr(line, '\n');
+		if (next == NULL)
+			next = end;
+		else
+			*next++ = '\0';
+		char *rest = cursorMatch(line, client);
+		if (rest != NULL) {
+			// Split the log file name from the offset, the offset only
+			// counts for the file it was taken from
+			char *offset = strchr(rest, ',');
+			if (offset == NULL)
+				return 0;
+			*offset++ = '\0';
+			if (strcmp(rest, fileName) != 0)
+				return 0;
+			return strtoul(offset, NULL, 10);
+		}
+		line = next;
+	}
+	return 0;
+}
+
+// This function stores a cursor
+int cursorSave(const char *client, const char *fileName, unsigned long offset) {
+	// The mode to open the file in (w = write/over-write)
+	char writeArg[] = "w";
+	char cursorFileName[] = CURSOR_FILE_NAME;
+
+	// Read the old file and squeeze out the client's old line.  What is
+	// kept is always behind what is being read, so it is done in place.
+	unsigned int length = cursorReadFile();
+	char *in = (char *)logChunkBuffer;
+	char *out = in;
+	char *end = in + length;
+	unsigned int clients = 0;
+	while (in < end) {
+		char *next = strchr(in, '\n');
+		next = (next == NULL) ? end : next + 1;
+		if ((next > in + 1) && (cursorMatch(in, client) == NULL)) {
+			memmove(out, in, next - in);
+			out += next - in;
+			if (out[-1] != '\n')
+				*out++ = '\n';
+			clients++;
+		}
+		in = next;
+	}
+
+	// Add the new line on the end
+	length = out - (char *)logChunkBuffer;
+	if ((clients >= CURSOR_MAX_CLIENTS) || (length + CURSOR_LINE_MAX >= LOG_CHUNK_SIZE))
+		return 0;
+	length += sprintf(out, "%s,%s,%lu\n", client, fileName, offset);
+
+	// Write it over the old file
+	FSFILE *cursorFile = FSfopen(cursorFileName, writeArg);
+	if (cursorFile == NULL)
+		return 0;
+	unsigned int written = FSfwrite(logChunkBuffer, 1, length, cursorFile);
+	FSfclose(cursorFile);
+	return written == length;
+}
+
+// This function forgets every cursor
+void cursorClearAll(void) {
+	char cursorFileName[] = CURSOR_FILE_NAME;
+	FSremove(cursorFileName);
+}
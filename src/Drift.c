@@ -0,0 +1,159 @@
+/*******************************************************
+ * Drift.c
+ * The PIC clock drift against the meter clock and the
+ * RTCC calibration that cancels it
+ *******************************************************/
+
+// Include Microchips SD File Library
+#include "FSIO.h"
+
+// Include the log file functions (for appending)
+#include "LogFile.h"
+
+// Include the Real Time Clock functions
+#include "RTCC.h"
+
+// Include the settings kept on the card (the calibration is saved there)
+#include "Config.h"
+
+// Include the fixed point number formatters
+#include "RecordFormat.h"
+
+// Include the header for this file
+#include "Drift.h"
+
+// The number of offsets in the line, and the PIC epoch and offset of the
+// first and last of them
+unsigned int driftPoints = 0;
+unsigned long driftFirstEpoch = 0;
+long driftFirstOffset = 0;
+unsigned long driftLastEpoch = 0;
+long driftLastOffset = 0;
+
+// The sums for the least squares line, with the time in hours and the
+// offset in seconds, both from the first reading so they stay small
+// enough for a float
+float driftSumT = 0;
+float driftSumO = 0;
+float driftSumTT = 0;
+float driftSumTO = 0;
+
+// This function throws the readings away
+void driftReset(void) {
+	driftPoints = 0;
+	driftSumT = 0;
+	driftSumO = 0;
+	driftSumTT = 0;
+	driftSumTO = 0;
+}
+
+// This function returns 1 if an offset is due at this PIC epoch
+int driftDue(unsigned long picEpoch) {
+	return (driftPoints == 0) || (picEpoch < driftLastEpoch) ||
+		(picEpoch - driftLastEpoch >= DRIFT_CHECK_SECONDS);
+}
+
+// This function appends a row to the calibration log
+static void driftWriteRow(unsigned long picEpoch, float ppm, signed char oldCal,
+	signed char newCal) {
+	char row[80];
+	char *out = row;
+	char fileName[] = DRIFT_FILE;
+	RTCC_DATE date;
+	epochToDate(picEpoch, &date);
+
+	out = formatTimestamp(out, date.year, date.month, date.day, date.hour, date.minute,
+		date.second);
+	*out++ = ',';
+	out = formatSigned(out, driftLastOffset);
+	*out++ = ',';
+	out = formatFixed(out, ppm, 2);
+	*out++ = ',';
+	out = formatUnsigned(out, driftPoints, 0, '0');
+	*out++ = ',';
+	out = formatSigned(out, oldCal);
+	*out++ = ',';
+	out = formatSigned(out, newCal);
+	*out++ = '\n';
+
+	appendToFile(fileName, row, out - row);
+}
+
+// This function works out the drift from the line, changes the
+// calibration to cancel it and starts a new line (the drift after the
+// change is measured afresh)
+static void driftCalibrate(unsigned long picEpoch) {
+	float n = driftPoints;
+	float denominator = n * driftSumTT - driftSumT * driftSumT;
+	if (denominator <= 0) {
+		driftReset();
+		return;
+	}
+
+	// The slope is seconds gained an hour, as ppm
+	float slope = (n * driftSumTO - driftSumT * driftSumO) / denominator;
+	float ppm = slope * (1000000.0f / 3600.0f);
+
+	// The PIC running fast needs a negative calibration, round to the
+	// nearest step.  Less than DRIFT_MIN_STEPS is left alone so the noise
+	// in the line does not flip it back and forth between two steps.
+	float steps = -ppm / RTCC_CAL_PPM_PER_STEP;
+	int change = 0;
+	if ((steps >= DRIFT_MIN_STEPS) || (steps <= -DRIFT_MIN_STEPS))
+		change = (int)(steps < 0 ? steps - 0.5f : steps + 0.5f);
+	signed char oldCal = RTCCGetCalibration();
+	int newCal = oldCal + change;
+	if (newCal < RTCC_CAL_MIN)
+		newCal = RTCC_CAL_MIN;
+	if (newCal > RTCC_CAL_MAX)
+		newCal = RTCC_CAL_MAX;
+
+	// Set it and keep it for the next boot
+	if (newCal != oldCal) {
+		RTCCSetCalibration(newCal);
+		loggerConfig.rtccCalibration = newCal;
+		configSave();
+	}
+	driftWriteRow(picEpoch, ppm, oldCal, newCal);
+	driftReset();
+}
+
+// This function adds the offset between the meter clock and the PIC
+void driftAddReading(unsigned char meterDate[], unsigned long picEpoch) {
+	RTCC_DATE date;
+	date.year = meterDate[0];
+	date.month = meterDate[1];
+	date.day = meterDate[2];
+	date.hour = meterDate[3];
+	date.minute = meterDate[4];
+	date.second = meterDate[5];
+	if (!RTCCDateValid(&date))
+		return;
+	long offset = (long)(picEpoch - epochFromDate(&date));
+
+	// Start again if a clock was set (or went back)
+	if ((driftPoints > 0) && ((picEpoch < driftLastEpoch) ||
+		(offset - driftLastOffset > DRIFT_JUMP_SECONDS) ||
+		(driftLastOffset - offset > DRIFT_JUMP_SECONDS)))
+		driftReset();
+
+	// The first reading is where the line is measured from
+	if (driftPoints == 0) {
+		driftFirstEpoch = picEpoch;
+		driftFirstOffset = offset;
+	}
+	float t = (float)(picEpoch - driftFirstEpoch) / 3600.0f;
+	float o = (float)(offset - driftFirstOffset);
+	driftSumT += t;
+	driftSumO += o;
+	driftSumTT += t * t;
+	driftSumTO += t * o;
+	driftPoints++;
+	driftLastEpoch = picEpoch;
+	driftLastOffset = offset;
+
+	// Change the calibration once the line is long enough to trust
+	if ((driftPoints >= DRIFT_MIN_POINTS) &&
+		(picEpoch - driftFirstEpoch >= DRIFT_MIN_SPAN_SECONDS))
+		driftCalibrate(picEpoch);
+}
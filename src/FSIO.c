@@ -4461,6 +4461,7 @@ size_t FSfwrite(const void *ptr, size_t size, size_t n, FSFILE *stream)
     DWORD       l;                     // absolute lba of sector to load
     DWORD       seek, filesize;
     WORD        writeCount = 0;
+    WORD        run;                   // bytes moved in one go
 
     // see if the file was opened in a write mode
     if(!(stream->flags.write))
@@ -4515,17 +4516,28 @@ size_t FSfwrite(const void *ptr, size_t size, size_t n, FSFILE *stream)
         }
 
         gBufferZeroed = FALSE;
-        if(!MDD_SectorRead( l, dsk->buffer) )
+        if ((pos == 0) && ((count >= MEDIA_SECTOR_SIZE) || (seek == stream->size)))
         {
-            FSerrno = CE_BADCACHEREAD;
-            error = CE_BAD_SECTOR_READ;
+            // The sector is about to be written whole, or starts at the
+            // end of the file, so there is nothing in it to keep
+            gLastDataSectorRead = l;
+        }
+        else if (pos != MEDIA_SECTOR_SIZE)
+        {
+            // (Past the end of the sector there is nothing to read, the
+            // next one is loaded in the loop)
+            if(!MDD_SectorRead( l, dsk->buffer) )
+            {
+                FSerrno = CE_BADCACHEREAD;
+                error = CE_BAD_SECTOR_READ;
+            }
+            gLastDataSectorRead = l;
         }
-        gLastDataSectorRead = l;
     }
     // exit loop if EOF reached
     filesize = stream->size;
 
-    // Loop while writing bytes
+    // Loop while writing runs of bytes, each up to the end of a sector
     while (error == CE_GOOD && count > 0)
     {
         if( seek == filesize )
@@ -4574,6 +4586,11 @@ size_t FSfwrite(const void *ptr, size_t size, size_t n, FSFILE *stream)
                 l = Cluster2Sector(dsk,stream->ccls);
                 l += (WORD)stream->sec;      // add the sector number to it
                 gBufferOwner = stream;
+                // A sector that is about to be written whole goes straight
+                // from the caller's buffer, and one that starts at the end
+                // of the file has nothing in it to keep, so neither is read
+                if ((count >= MEDIA_SECTOR_SIZE) || (seek == filesize))
+                    needRead = FALSE;
                 // If we just allocated a new cluster, then the cluster will
                 // contain garbage data, so it doesn't matter what we write to it
                 // Whatever is in the buffer will work fine
@@ -4598,16 +4615,47 @@ size_t FSfwrite(const void *ptr, size_t size, size_t n, FSFILE *stream)
 
         if(error == CE_GOOD)
         {
-            // Write one byte at a time
-            RAMwrite(dsk->buffer, pos++, *(char *)src);
-            src = src + 1; // compiler bug
-            seek++;
-            count--;
-            writeCount++;
+            if ((pos == 0) && (count >= MEDIA_SECTOR_SIZE))
+            {
+                // A whole sector, write it straight from the caller's
+                // buffer without copying it into the data buffer
+                if (gNeedDataWrite)
+                    if (flushData())
+                    {
+                        FSerrno = CE_WRITE_ERROR;
+                        return 0;
+                    }
+                if (!MDD_SectorWrite( l, (BYTE *)src, FALSE))
+                {
+                    FSerrno = CE_WRITE_ERROR;
+                    error = CE_WRITE_ERROR;
+                    break;
+                }
+                // The data buffer no longer matches the sector on the card
+                if (gLastDataSectorRead == l)
+                    gLastDataSectorRead = 0xFFFFFFFF;
+                run = MEDIA_SECTOR_SIZE;
+            }
+            else
+            {
+                // Copy up to the end of the sector in one go
+                run = MEDIA_SECTOR_SIZE - pos;
+                if (count < run)
+                    run = count;
+                memcpy(dsk->buffer + pos, src, run);
+                gNeedDataWrite = TRUE;
+            }
+            src += run;
+            pos += run;
+            seek += run;
+            count -= run;
+            writeCount += run;
             // now increment the size of the part
-            if(stream->flags.FileWriteEOF)
-                filesize++;
-            gNeedDataWrite = TRUE;
+            if (seek > filesize)
+            {
+                stream->flags.FileWriteEOF = TRUE;
+                filesize = seek;
+            }
         }
     } // while count
 
@@ -4744,6 +4792,7 @@ size_t FSfread (void *ptr, size_t size, size_t n, FSFILE *stream)
     WORD    pos;       //position within sector
     CETYPE   error = CE_GOOD;
     WORD    readCount = 0;
+    WORD    run;        // bytes moved in one go
 
     FSerrno = CE_GOOD;
 
@@ -4815,6 +4864,27 @@ size_t FSfread (void *ptr, size_t size, size_t n, FSFILE *stream)
             sec_sel = Cluster2Sector(dsk,stream->ccls);
             sec_sel += (WORD)stream->sec;      // add the sector number to it
 
+            // A whole sector of the file that is all wanted, read it
+            // straight into the caller's buffer and leave the data
+            // buffer as it is
+            if ((len >= MEDIA_SECTOR_SIZE) && (stream->size - seek >= MEDIA_SECTOR_SIZE))
+            {
+                if( !MDD_SectorRead( sec_sel, pointer) )
+                {
+                    // The data buffer was not loaded, so make the next
+                    // read load it
+                    gBufferOwner = NULL;
+                    FSerrno = CE_BAD_SECTOR_READ;
+                    error = CE_BAD_SECTOR_READ;
+                    break;
+                }
+                pos = MEDIA_SECTOR_SIZE;
+                pointer += MEDIA_SECTOR_SIZE;
+                seek += MEDIA_SECTOR_SIZE;
+                readCount += MEDIA_SECTOR_SIZE;
+                len -= MEDIA_SECTOR_SIZE;
+                continue;
+            }
 
             gBufferOwner = stream;
             gBufferZeroed = FALSE;
@@ -4827,12 +4897,19 @@ size_t FSfread (void *ptr, size_t size, size_t n, FSFILE *stream)
             gLastDataSectorRead = sec_sel;
         }
 
-        // copy one byte at a time
-        *pointer = RAMread( dsk->buffer, pos++ );
-        pointer++;
-        seek++;
-        readCount++;
-        len--;
+        // Copy up to the end of the sector, the end of the file or the
+        // bytes wanted, whichever comes first, in one go
+        run = MEDIA_SECTOR_SIZE - pos;
+        if (len < run)
+            run = len;
+        if (stream->size - seek < run)
+            run = stream->size - seek;
+        memcpy(pointer, dsk->buffer + pos, run);
+        pointer += run;
+        pos += run;
+        seek += run;
+        readCount += run;
+        len -= run;
     }
 
     // save off the positon
@@ -0,0 +1,238 @@
+/*******************************************************
+ * HostLink.c
+ * The logger side of the binary request/response channel
+ * for host tools (see HostLink.h for the frame layout)
+ *******************************************************/
+
+// Include library for processor
+#include <p24fj256gb110.h>
+
+// Include Microchips SD File Library
+#include "FSIO.h"
+
+// Include the UART library for the terminal
+#include "UART.h"
+
+// Include the CRC functions
+#include "Checksum.h"
+
+// Include the library for modbus functionality to flow meter
+#include "modbus.h"
+
+// Include the Real Time Clock functions
+#include "RTCC.h"
+
+// Include the tick counter for the byte timeout
+#include "Timer.h"
+
+// Include the settings kept on the card
+#include "Config.h"
+
+// Include the background scheduler
+#include "Scheduler.h"
+
+// Include the parts of the main program the requests report on
+#include "TLR_Logger.h"
+
+// Include the header for this file
+#include "HostLink.h"
+
+// Include the string library
+#include <string.h>
+
+// How long to wait for each byte of a request once it has started
+#define HL_BYTE_TIMEOUT_MS	100
+
+// The largest reply, header, a full length payload and the CRC
+#define HL_MAX_FRAME		(4 + 255 + 2)
+
+// The request being answered and the reply being built
+unsigned char hlRequest[3 + HL_MAX_REQUEST];
+unsigned char hlReply[HL_MAX_FRAME];
+unsigned int hlReplyLength;
+
+// This function waits a short time for the next byte of a request,
+// returns -1 if it does not come
+static int hlReadByte(void) {
+	unsigned long deadline = timerGetTicks() + timerMsToTicks(HL_BYTE_TIMEOUT_MS);
+	int c;
+	while ((c = readU1()) < 0) {
+		if ((long)(deadline - timerGetTicks()) <= 0)
+			return -1;
+	}
+	return c;
+}
+
+// This function adds a 'c' field to the reply
+static void hlAddByte(unsigned char value) {
+	hlReply[hlReplyLength++] = HL_FIELD_BYTE;
+	hlReply[hlReplyLength++] = value;
+}
+
+// This function adds a 'w' field to the reply
+static void hlAddWord(unsigned int value) {
+	hlReply[hlReplyLength++] = HL_FIELD_WORD;
+	hlReply[hlReplyLength++] = value >> 8;
+	hlReply[hlReplyLength++] = value;
+}
+
+// This function adds the four bytes of a number MSB first
+static void hlAddFour(unsigned char tag, unsigned long value) {
+	hlReply[hlReplyLength++] = tag;
+	hlReply[hlReplyLength++] = value >> 24;
+	hlReply[hlReplyLength++] = value >> 16;
+	hlReply[hlReplyLength++] = value >> 8;
+	hlReply[hlReplyLength++] = value;
+}
+
+// This function adds an 'f' field to the reply (the PIC keeps floats
+// LSB first, so the bytes are turned around)
+static void hlAddFloat(float value) {
+	unsigned char *bytes = (unsigned char *)&value;
+	hlReply[hlReplyLength++] = HL_FIELD_FLOAT;
+	hlReply[hlReplyLength++] = bytes[3];
+	hlReply[hlReplyLength++] = bytes[2];
+	hlReply[hlReplyLength++] = bytes[1];
+	hlReply[hlReplyLength++] = bytes[0];
+}
+
+// This function adds an 's' field to the reply
+static void hlAddBytes(const unsigned char *data, unsigned char length) {
+	hlReply[hlReplyLength++] = HL_FIELD_BYTES;
+	hlReply[hlReplyLength++] = length;
+	memcpy(&hlReply[hlReplyLength], data, length);
+	hlReplyLength += length;
+}
+
+// This function turns the reply into an error reply
+static void hlError(unsigned char code) {
+	hlReply[2] = HL_REPLY_ERROR;
+	hlReplyLength = 4;
+	hlAddByte(code);
+}
+
+// This function returns the size of the log file, or -1 if there is
+// no card or no log file
+static long hlLogFileSize(void) {
+	char readArg[] = "r";
+	long size = -1;
+	PMD1bits.SPI1MD = 0;
+	if (FSInit()) {
+		FSFILE *logFile = FSfopen(loggerConfig.logFileName, readArg);
+		if (logFile != NULL) {
+			size = logFile->size;
+			FSfclose(logFile);
+		}
+	}
+	PMD1bits.SPI1MD = 1;
+	return size;
+}
+
+// This function builds the reply to the request in hlRequest
+static void hlAnswer(unsigned char type, unsigned char *payload, unsigned char length) {
+	PROCESS_SNAPSHOT snapshot;
+
+	switch (type) {
+		case HL_REQUEST_PING:
+			hlAddBytes(payload, length);
+			break;
+		case HL_REQUEST_TIME: {
+			RTCC_DATE now;
+			RTCCgrab();
+			RTCCGetDate(&now);
+			hlAddByte(now.year);
+			hlAddByte(now.month);
+			hlAddByte(now.day);
+			hlAddByte(now.hour);
+			hlAddByte(now.minute);
+			hlAddByte(now.second);
+			break;
+		}
+		case HL_REQUEST_SNAPSHOT:
+			if (!readProcessSnapshot(&snapshot)) {
+				hlError(HL_ERROR_METER);
+				break;
+			}
+			hlAddFloat(snapshot.velocity);
+			hlAddFloat(snapshot.flowRate);
+			hlAddFloat(snapshot.flowratePercent);
+			hlAddWord(snapshot.faultStatus);
+			hlAddFour(HL_FIELD_LONG, snapshot.totalizer1Integer);
+			hlAddFloat(snapshot.totalizer1Fraction);
+			break;
+		case HL_REQUEST_REGISTERS: {
+			if ((length != 3) || (payload[2] == 0) || (payload[2] > HL_MAX_REGISTERS)) {
+				hlError(HL_ERROR_BAD_LENGTH);
+				break;
+			}
+			unsigned int firstRegister = (((unsigned int)payload[0]) << 8) | payload[1];
+			unsigned char count = payload[2];
+			if (!readHoldingRegisters(firstRegister, count)) {
+				hlError(HL_ERROR_METER);
+				break;
+			}
+			// The registers are at buffer spot 3 on in the modbus reply
+			hlAddBytes(&buffer[3], 2 * count);
+			break;
+		}
+		case HL_REQUEST_LOGGER:
+			hlAddFour(HL_FIELD_LONG, loggerConfig.sampleSeconds);
+			hlAddFour(HL_FIELD_LONG, hlLogFileSize());
+			hlAddWord(alarmFired);
+			break;
+		default:
+			hlError(HL_ERROR_UNKNOWN);
+			break;
+	}
+}
+
+// This function reads, answers and replies to one request
+void hostLinkService(void) {
+	// Read the id, type and length
+	timerStart();
+	unsigned int i;
+	for (i = 0; i < 3; i++) {
+		int c = hlReadByte();
+		if (c < 0)
+			return;
+		hlRequest[i] = c;
+	}
+	unsigned char length = hlRequest[2];
+	if (length > HL_MAX_REQUEST)
+		return;
+
+	// Then the payload and the CRC
+	for (i = 0; i < length; i++) {
+		int c = hlReadByte();
+		if (c < 0)
+			return;
+		hlRequest[3 + i] = c;
+	}
+	int crcHigh = hlReadByte();
+	int crcLow = hlReadByte();
+	if ((crcHigh < 0) || (crcLow < 0))
+		return;
+	unsigned int crc = (((unsigned int)crcHigh) << 8) | crcLow;
+	if (crc != crc16Ccitt(CRC16_CCITT_INIT, hlRequest, 3 + length))
+		return;
+
+	// Start the reply with the same id and the fields after the header
+	hlReply[0] = HL_ESCAPE;
+	hlReply[1] = hlRequest[0];
+	hlReply[2] = hlRequest[1] | HL_REPLY_OK;
+	hlReplyLength = 4;
+
+	// The request owns the meter and the card while it is answered
+	schedulerClaim(SCHEDULER_ALL);
+	hlAnswer(hlRequest[1], &hlRequest[3], length);
+
+	// Fill in the length and seal it with the CRC
+	hlReply[3] = hlReplyLength - 4;
+	crc = crc16Ccitt(CRC16_CCITT_INIT, &hlReply[1], hlReplyLength - 1);
+	hlReply[hlReplyLength++] = crc >> 8;
+	hlReply[hlReplyLength++] = crc;
+	writeU1(hlReply, hlReplyLength);
+
+	// Now the reply is on its way, let any sample that came due go ahead
+	schedulerRelease(SCHEDULER_ALL);
+}
@@ -0,0 +1,221 @@
+/*******************************************************
+ * Ledger.c
+ * The daily consumption ledger
+ *******************************************************/
+
+// Include Microchips SD File Library
+#include "FSIO.h"
+
+// Include the log file functions (for appending)
+#include "LogFile.h"
+
+// Include the fixed point number formatters
+#include "RecordFormat.h"
+
+// Include the CRC (for the saved day)
+#include "Checksum.h"
+
+// Include the header for this file
+#include "Ledger.h"
+
+// Include the standard library (for labs)
+#include <stdlib.h>
+
+// Include the string library (for memcpy)
+#include <string.h>
+
+// The day being added up and whether there is one yet
+LEDGER_DAY ledgerOpen = {0, 0, 0, LEDGER_FLAG_STARTED};
+unsigned char ledgerActive = 0;
+
+// This function makes a total from the two totalizer registers
+static void ledgerMakeTotal(LEDGER_TOTAL *total, long integer, float fraction) {
+	int thousandths = (int)(fraction * 1000 + 0.5);
+	if (thousandths < 0)
+		thousandths = 0;
+	total->whole = integer;
+	total->thousandths = thousandths;
+	if (total->thousandths >= 1000) {
+		total->thousandths -= 1000;
+		total->whole++;
+	}
+}
+
+// This function works out to = to + from - less, keeping thousandths in 0-999
+static void ledgerAddDifference(LEDGER_TOTAL *to, LEDGER_TOTAL *from, LEDGER_TOTAL *less) {
+	to->whole += from->whole - less->whole;
+	to->thousandths += from->thousandths - less->thousandths;
+	while (to->thousandths < 0) {
+		to->thousandths += 1000;
+		to->whole--;
+	}
+	while (to->thousandths >= 1000) {
+		to->thousandths -= 1000;
+		to->whole++;
+	}
+}
+
+// This function writes a total with three decimal places
+static char *ledgerFormatTotal(char *out, LEDGER_TOTAL *total) {
+	LEDGER_TOTAL value = *total;
+	// Show negatives (reverse flow) as a sign and a size
+	if (value.whole < 0) {
+		*out++ = '-';
+		value.whole = -value.whole;
+		if (value.thousandths > 0) {
+			value.whole--;
+			value.thousandths = 1000 - value.thousandths;
+		}
+	}
+	out = formatUnsigned(out, value.whole, 0, '0');
+	*out++ = '.';
+	return formatUnsigned(out, value.thousandths, 3, '0');
+}
+
+// This function appends the row for the day being added up
+static void ledgerWriteRow(void) {
+	char row[80];
+	char *out = row;
+	char fileName[] = LEDGER_FILE;
+
+	// The date
+	*out++ = '2';
+	*out++ = '0';
+	out = formatUnsigned(out, ledgerOpen.year, 2, '0');
+	*out++ = '-';
+	out = formatUnsigned(out, ledgerOpen.month, 2, '0');
+	*out++ = '-';
+	out = formatUnsigned(out, ledgerOpen.day, 2, '0');
+
+	// The totals, consumption and samples
+	*out++ = ',';
+	out = ledgerFormatTotal(out, &ledgerOpen.first);
+	*out++ = ',';
+	out = ledgerFormatTotal(out, &ledgerOpen.last);
+	*out++ = ',';
+	out = ledgerFormatTotal(out, &ledgerOpen.consumption);
+	*out++ = ',';
+	out = formatUnsigned(out, ledgerOpen.samples, 0, '0');
+
+	// The flags
+	*out++ = ',';
+	if (ledgerOpen.flags == 0)
+		*out++ = '-';
+	if (ledgerOpen.flags & LEDGER_FLAG_STARTED)
+		*out++ = 'S';
+	if (ledgerOpen.flags & LEDGER_FLAG_POWER_UP)
+		*out++ = 'P';
+	if (ledgerOpen.flags & LEDGER_FLAG_RESET)
+		*out++ = 'R';
+	if (ledgerOpen.flags & LEDGER_FLAG_RESTARTED)
+		*out++ = 'B';
+	*out++ = '\n';
+
+	appendToFile(fileName, row, out - row);
+}
+
+// This function picks up the day that was open when the logger was
+// reset.  A missing file, or one with a bad CRC (the reset came in the
+// middle of saving it), leaves the next sample to start the day again.
+void ledgerRestore(void) {
+	// The mode to open the file in (r = read-only)
+	char readArg[] = "r";
+	char fileName[] = LEDGER_OPEN_FILE;
+	unsigned char saved[sizeof(LEDGER_DAY) + 2];
+
+	FSFILE *openFile = FSfopen(fileName, readArg);
+	if (openFile == NULL)
+		return;
+	unsigned int length = FSfread(saved, 1, sizeof(saved), openFile);
+	FSfclose(openFile);
+	if (length != sizeof(saved))
+		return;
+	unsigned int crc = crc16Ccitt(CRC16_CCITT_INIT, saved, sizeof(LEDGER_DAY));
+	if ((saved[sizeof(LEDGER_DAY)] != (crc >> 8)) || (saved[sizeof(LEDGER_DAY) + 1] != (crc & 0xFF)))
+		return;
+
+	memcpy(&ledgerOpen, saved, sizeof(LEDGER_DAY));
+	ledgerOpen.flags |= LEDGER_FLAG_RESTARTED;
+	ledgerActive = 1;
+}
+
+// This function saves the day being added up.  Once the file is there
+// it is written over in place so it keeps the one cluster.
+static void ledgerSave(void) {
+	// The modes to open the file in (r+ = write in place, w = create)
+	char updateArg[] = "r+";
+	char writeArg[] = "w";
+	char fileName[] = LEDGER_OPEN_FILE;
+	unsigned int crc = crc16Ccitt(CRC16_CCITT_INIT, (unsigned char *)&ledgerOpen,
+		sizeof(LEDGER_DAY));
+	unsigned char trailer[2] = {crc >> 8, crc};
+
+	FSFILE *openFile = FSfopen(fileName, updateArg);
+	if (openFile == NULL)
+		openFile = FSfopen(fileName, writeArg);
+	if (openFile != NULL) {
+		FSfwrite(&ledgerOpen, 1, sizeof(LEDGER_DAY), openFile);
+		FSfwrite(trailer, 1, 2, openFile);
+		FSfclose(openFile);
+	}
+}
+
+// This function adds one totalizer reading to the ledger
+void ledgerAddSample(unsigned char year, unsigned char month, unsigned char day,
+	long totalizerInteger, float totalizerFraction, unsigned int powerUps) {
+	LEDGER_TOTAL reading;
+	ledgerMakeTotal(&reading, totalizerInteger, totalizerFraction);
+
+	// Close off the old day when a new one starts.  The new day starts
+	// from the last reading of the old one so no flow falls between days.
+	if (ledgerActive && ((year != ledgerOpen.year) || (month != ledgerOpen.month) || (day != ledgerOpen.day))) {
+		ledgerWriteRow();
+		ledgerOpen.first = ledgerOpen.last;
+		ledgerOpen.consumption.whole = 0;
+		ledgerOpen.consumption.thousandths = 0;
+		ledgerOpen.samples = 0;
+		ledgerOpen.flags = 0;
+		ledgerOpen.year = year;
+		ledgerOpen.month = month;
+		ledgerOpen.day = day;
+	}
+
+	// The first reading since the logger started
+	if (!ledgerActive) {
+		ledgerActive = 1;
+		ledgerOpen.year = year;
+		ledgerOpen.month = month;
+		ledgerOpen.day = day;
+		ledgerOpen.first = reading;
+		ledgerOpen.last = reading;
+		ledgerOpen.consumption.whole = 0;
+		ledgerOpen.consumption.thousandths = 0;
+		ledgerOpen.powerUps = powerUps;
+	}
+
+	// A change in the power up count means the meter restarted
+	unsigned char poweredUp = (powerUps != ledgerOpen.powerUps);
+	if (poweredUp)
+		ledgerOpen.flags |= LEDGER_FLAG_POWER_UP;
+	ledgerOpen.powerUps = powerUps;
+
+	// If the totalizer went back after the meter restarted, or lost more
+	// than half its size (a roll over or someone resetting it), it started
+	// again from zero, so everything on it now is new.  A small step back
+	// with no restart is reverse flow and counts against the consumption.
+	// The halving is by size so a total that has gone negative with
+	// reverse flow is not taken for a reset when it steps back further.
+	LEDGER_TOTAL zero = {0, 0};
+	if ((reading.whole < ledgerOpen.last.whole) &&
+		(poweredUp || (labs(reading.whole) < labs(ledgerOpen.last.whole) / 2))) {
+		ledgerOpen.flags |= LEDGER_FLAG_RESET;
+		ledgerAddDifference(&ledgerOpen.consumption, &reading, &zero);
+	} else {
+		ledgerAddDifference(&ledgerOpen.consumption, &reading, &ledgerOpen.last);
+	}
+	ledgerOpen.last = reading;
+	ledgerOpen.samples++;
+
+	// Keep the day on the card in case the logger is reset
+	ledgerSave();
+}
@@ -0,0 +1,110 @@
+/*******************************************************
+ * Live.c
+ * Streams the process values to the terminal until a
+ * key is hit
+ *******************************************************/
+
+// Include library for processor
+#include <p24fj256gb110.h>
+
+// Include the UART library for the terminal
+#include "UART.h"
+
+// Include the library for modbus functionality to flow meter
+#include "modbus.h"
+
+// Include the Real Time Clock functions
+#include "RTCC.h"
+
+// Include the tick counter for pacing the readings
+#include "Timer.h"
+
+// Include the fixed point number formatters
+#include "RecordFormat.h"
+
+// Include the background scheduler
+#include "Scheduler.h"
+
+// Include the header for this file
+#include "Live.h"
+
+// The decimals to show for the velocity (mm/s)
+#define LIVE_VELOCITY_DECIMALS	1
+
+// The longest line, hh:mm:ss and four numbers
+#define LIVE_LINE_MAX	(9 + 3 * FORMAT_FIXED_MAX + 12 + 2)
+
+// This function formats one live line and returns its length
+static unsigned int formatLiveLine(char *line, PROCESS_SNAPSHOT *snapshot) {
+	char *out = formatUnsigned(line, getHour(), 2, '0');
+	*out++ = ':';
+	out = formatUnsigned(out, getMin(), 2, '0');
+	*out++ = ':';
+	out = formatUnsigned(out, getSec(), 2, '0');
+	*out++ = ',';
+	out = formatFixed(out, snapshot->flowRate, RECORD_FLOW_DECIMALS);
+	*out++ = ',';
+	out = formatFixed(out, snapshot->velocity, LIVE_VELOCITY_DECIMALS);
+	*out++ = ',';
+	out = formatSigned(out, snapshot->totalizer1Integer);
+	*out++ = ',';
+	out = formatOctal(out, snapshot->faultStatus, 2);
+	*out++ = '\r';
+	*out = '\0';
+	return out - line;
+}
+
+// This function streams the live readings until a key is hit
+void runLiveMonitor(unsigned long intervalMs, unsigned long *linesSent, unsigned long *linesDropped) {
+	char line[LIVE_LINE_MAX];
+	PROCESS_SNAPSHOT snapshot;
+
+	*linesSent = 0;
+	*linesDropped = 0;
+
+	putsU1("Time,Flow(l/s),Velocity(mm/s),Totalizer,Fault\r");
+
+	// Each reading is scheduled from the last one that was due, so the
+	// time a reading takes does not make the rate drift
+	unsigned long intervalTicks = timerMsToTicks(intervalMs);
+	timerStart();
+	unsigned long nextTicks = timerGetTicks();
+
+	// A key on the terminal stops it
+	while (!charArrivedAtUART1()) {
+		// Wait for the reading to be due, still watching for a key
+		while ((long)(nextTicks - timerGetTicks()) > 0) {
+			if (charArrivedAtUART1())
+				break;
+		}
+		if (charArrivedAtUART1())
+			break;
+		nextTicks += intervalTicks;
+
+		// Read everything in one transaction
+		if (readProcessSnapshot(&snapshot)) {
+			RTCCgrab();
+			unsigned int length = formatLiveLine(line, &snapshot);
+
+			// Only send it if it fits without waiting on the transmitter
+			if (spaceU1() >= length) {
+				writeU1((unsigned char *)line, length);
+				(*linesSent)++;
+			} else {
+				(*linesDropped)++;
+			}
+		}
+
+		// The meter and the card are free between readings, let any
+		// sample that has come due go ahead
+		schedulerYield();
+
+		// If a sample (or a slow meter) made it fall behind, start
+		// the schedule again from now instead of catching up
+		if ((long)(timerGetTicks() - nextTicks) > (long)intervalTicks)
+			nextTicks = timerGetTicks();
+	}
+
+	// Throw away the key that stopped it
+	readU1();
+}
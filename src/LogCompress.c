@@ -0,0 +1,253 @@
+/*******************************************************
+ * LogCompress.c
+ * The small LZ compressor for log file downloads (see
+ * LogCompress.h for the format).  This has no PIC parts
+ * in it so the host tools build the same file.
+ *******************************************************/
+
+// Include the header for this file
+#include "LogCompress.h"
+
+// The hash table size (a power of 2), and how many earlier places with
+// the same hash are tried for each match
+#define LZ_HASH_SIZE		256
+#define LZ_CHAIN_DEPTH		8
+
+// The marker for no earlier place
+#define LZ_NONE				0xFFFF
+
+// The characters that have a short literal code, in code order.  The
+// log is mostly digits and the hex of the record CRCs.
+const unsigned char lzLiteralCodes[LZ_LITERAL_CODES] = "0123456789ABCDE";
+
+// The last place each hash of three bytes was seen, and for each place
+// in the window the place before that with the same hash
+unsigned int lzHead[LZ_HASH_SIZE];
+unsigned int lzPrevious[LZ_WINDOW_SIZE];
+
+// The next place to go in the chains
+unsigned int lzInserted;
+
+// The bits waiting to be written and how many there are, and where the
+// compressed block is going
+unsigned int lzBits;
+unsigned char lzBitCount;
+unsigned char *lzOut;
+unsigned int lzOutLength;
+unsigned int lzOutSize;
+
+// This function hashes the three bytes at p
+static unsigned int lzHash(const unsigned char *p) {
+	return ((p[0] << 4) ^ (p[1] << 2) ^ p[2]) & (LZ_HASH_SIZE - 1);
+}
+
+// This function adds the place to the hash chains
+static void lzInsert(const unsigned char *window, unsigned int place) {
+	unsigned int hash = lzHash(&window[place]);
+	lzPrevious[place] = lzHead[hash];
+	lzHead[hash] = place;
+}
+
+// This function writes the low count bits of value (count up to 8), most
+// significant first.  Returns 0 if the output is full.
+static int lzPutBits(unsigned int value, unsigned char count) {
+	lzBits = (lzBits << count) | (value & ((1 << count) - 1));
+	lzBitCount += count;
+	if (lzBitCount >= 8) {
+		if (lzOutLength >= lzOutSize)
+			return 0;
+		lzBitCount -= 8;
+		lzOut[lzOutLength++] = lzBits >> lzBitCount;
+	}
+	return 1;
+}
+
+// This function finds the short literal code for c, or LZ_LITERAL_CODES
+// if it does not have one (this follows lzLiteralCodes)
+static unsigned char lzLiteralCode(unsigned char c) {
+	if ((c >= '0') && (c <= '9'))
+		return c - '0';
+	if ((c >= 'A') && (c <= 'E'))
+		return c - 'A' + 10;
+	return LZ_LITERAL_CODES;
+}
+
+// This function writes one literal byte
+static int lzPutLiteral(unsigned char c) {
+	unsigned char code = lzLiteralCode(c);
+	if (code < LZ_LITERAL_CODES)
+		return lzPutBits(code, 5);
+	return lzPutBits(LZ_LITERAL_CODES, 5) && lzPutBits(c, 8);
+}
+
+// This function works out the bits the literals for length bytes at p
+// would take
+static unsigned int lzLiteralBits(const unsigned char *p, unsigned int length) {
+	unsigned int bits = 0;
+	while (length > 0) {
+		bits += lzLiteralCode(*p) < LZ_LITERAL_CODES ? 5 : 13;
+		p++;
+		length--;
+	}
+	return bits;
+}
+
+// This function works out the bits a match of length bytes takes
+static unsigned int lzMatchBits(unsigned int length) {
+	return length < LZ_LONG_MATCH ? 13 : 19;
+}
+
+// This function puts every place before place in the chains (the ones
+// with three bytes left before the end)
+static void lzInsertUpTo(const unsigned char *window, unsigned int place, unsigned int end) {
+	while ((lzInserted < place) && (lzInserted + LZ_MIN_MATCH <= end)) {
+		lzInsert(window, lzInserted);
+		lzInserted++;
+	}
+	if (lzInserted < place)
+		lzInserted = place;
+}
+
+// This function looks back along the chain for the match at place that
+// saves the most bits over literals.  Returns the bits saved (0 if there
+// is no match worth taking) with the length and distance.
+static unsigned int lzFindMatch(const unsigned char *window, unsigned int place, unsigned int end,
+	unsigned int *bestLength, unsigned int *bestDistance) {
+	unsigned int bestSaving = 0;
+	if (place + LZ_MIN_MATCH > end)
+		return 0;
+	lzInsertUpTo(window, place, end);
+
+	unsigned int limit = end - place;
+	if (limit > LZ_MAX_MATCH)
+		limit = LZ_MAX_MATCH;
+	unsigned int candidate = lzHead[lzHash(&window[place])];
+	unsigned int depth = LZ_CHAIN_DEPTH;
+	while ((candidate != LZ_NONE) && (depth > 0)) {
+		unsigned int length = 0;
+		while ((length < limit) && (window[candidate + length] == window[place + length]))
+			length++;
+		if (length >= LZ_MIN_MATCH) {
+			unsigned int literalBits = lzLiteralBits(&window[place], length);
+			unsigned int matchBits = lzMatchBits(length);
+			if ((literalBits > matchBits) && (literalBits - matchBits > bestSaving)) {
+				bestSaving = literalBits - matchBits;
+				*bestLength = length;
+				*bestDistance = place - candidate;
+			}
+		}
+		candidate = lzPrevious[candidate];
+		depth--;
+	}
+	return bestSaving;
+}
+
+// This function compresses window[start] up to window[end]
+unsigned int lzCompress(const unsigned char *window, unsigned int start, unsigned int end,
+	unsigned char *out, unsigned int outSize) {
+	unsigned int i;
+
+	// Start the output and the chains fresh and fill the chains with the
+	// history
+	lzBits = 0;
+	lzBitCount = 0;
+	lzOut = out;
+	lzOutLength = 0;
+	lzOutSize = outSize;
+	for (i = 0; i < LZ_HASH_SIZE; i++)
+		lzHead[i] = LZ_NONE;
+	lzInserted = 0;
+	lzInsertUpTo(window, start, end);
+
+	unsigned int place = start;
+	while (place < end) {
+		unsigned int length = 0;
+		unsigned int distance = 0;
+		unsigned int saving = lzFindMatch(window, place, end, &length, &distance);
+
+		// If the match one place on saves more, send this byte as a literal
+		// and take that one next time round
+		if (saving > 0) {
+			unsigned int nextLength = 0;
+			unsigned int nextDistance = 0;
+			if (lzFindMatch(window, place + 1, end, &nextLength, &nextDistance) > saving)
+				saving = 0;
+		}
+
+		if (saving > 0) {
+			// A match, a 1 bit, the distance and the length
+			distance--;
+			if (!lzPutBits(0x4 | (distance >> 8), 3) || !lzPutBits(distance, 8))
+				return 0;
+			if (length < LZ_LONG_MATCH) {
+				if (!lzPutBits(length - LZ_MIN_MATCH, 2))
+					return 0;
+			} else {
+				if (!lzPutBits(3, 2) || !lzPutBits(length - LZ_LONG_MATCH, 6))
+					return 0;
+			}
+			place += length;
+		} else {
+			// A literal, a 0 bit and its code
+			if (!lzPutLiteral(window[place]))
+				return 0;
+			place++;
+		}
+	}
+
+	// Pad out the last byte with zeros
+	if ((lzBitCount > 0) && !lzPutBits(0, 8 - lzBitCount))
+		return 0;
+	return lzOutLength;
+}
+
+// This function decompresses a block into window[start] up to window[end]
+int lzDecompress(unsigned char *window, unsigned int start, unsigned int end,
+	const unsigned char *in, unsigned int inLength) {
+	unsigned int place = start;
+	unsigned int at = 0;
+	unsigned long bits = 0;
+	unsigned char bitCount = 0;
+
+	while (place < end) {
+		// Keep at least 19 bits on hand (a whole match), the zeros past
+		// the end only matter if the block is damaged
+		while (bitCount <= 24) {
+			bits = (bits << 8) | (at < inLength ? in[at] : 0);
+			at++;
+			bitCount += 8;
+		}
+		if (at > inLength + 4)
+			return 0;
+
+		if ((bits >> (bitCount - 1)) & 1) {
+			// A match, copy from earlier in the window
+			unsigned int distance = ((bits >> (bitCount - 11)) & 0x3FF) + 1;
+			unsigned int length = ((bits >> (bitCount - 13)) & 0x03) + LZ_MIN_MATCH;
+			bitCount -= 13;
+			if (length == LZ_LONG_MATCH) {
+				length = ((bits >> (bitCount - 6)) & 0x3F) + LZ_LONG_MATCH;
+				bitCount -= 6;
+			}
+			if ((distance > place) || (place + length > end))
+				return 0;
+			while (length > 0) {
+				window[place] = window[place - distance];
+				place++;
+				length--;
+			}
+		} else {
+			// A literal, a short code or the whole byte
+			unsigned char code = (bits >> (bitCount - 5)) & 0x0F;
+			bitCount -= 5;
+			if (code < LZ_LITERAL_CODES) {
+				window[place++] = lzLiteralCodes[code];
+			} else {
+				window[place++] = bits >> (bitCount - 8);
+				bitCount -= 8;
+			}
+		}
+		bits &= (1UL << bitCount) - 1;
+	}
+	return 1;
+}
@@ -0,0 +1,374 @@
+/*******************************************************
+ * LogFile.c
+ * Functions for moving the contents of the log files on
+ * the SD card out to the terminal
+ *******************************************************/
+
+// Include library for processor
+#include <p24fj256gb110.h>
+
+// Include Microchips SD File Library
+#include "FSIO.h"
+
+// Include the UART library for the terminal
+#include "UART.h"
+
+// Include the Real Time Clock functions for the time stamps
+#include "RTCC.h"
+
+// Include the CRC for the records
+#include "Checksum.h"
+
+// Include the fixed point record formatters
+#include "RecordFormat.h"
+
+// Include the scheduler so samples can go ahead during long reads
+#include "Scheduler.h"
+
+// Include the header for this file
+#include "LogFile.h"
+
+// The buffer that sectors of the log file are read into
+unsigned char logChunkBuffer[LOG_CHUNK_SIZE];
+
+// This function formats one log record into recordBuffer
+int formatLogRecord(char *recordBuffer, const TIMER_STAMP *stamp, RUNNING_STATS *flowStats,
+	long totalizer, float transTemp, unsigned char battCap, unsigned char powerStat,
+	unsigned int faultStatus) {
+	// Build the record field by field along the buffer.  This gives the same
+	// line as "%3.3f" style sprintf but without the floating point printf.
+	RTCC_DATE now;
+	epochToDate(stamp->epoch, &now);
+	char *out = formatTimestamp(recordBuffer, now.year, now.month, now.day,
+		now.hour, now.minute, now.second);
+	*out++ = '.';
+	out = formatUnsigned(out, stamp->ms, 3, '0');
+	*out++ = ',';
+	out = formatFixed(out, flowStats->mean, RECORD_FLOW_DECIMALS);
+	*out++ = ',';
+	out = formatFixed(out, statsStdDev(flowStats), RECORD_FLOW_DECIMALS);
+	*out++ = ',';
+	out = formatFixed(out, flowStats->min, RECORD_FLOW_DECIMALS);
+	*out++ = ',';
+	out = formatFixed(out, flowStats->max, RECORD_FLOW_DECIMALS);
+	*out++ = ',';
+	out = formatSigned(out, totalizer);
+	*out++ = ',';
+	out = formatFixed(out, transTemp, RECORD_TEMP_DECIMALS);
+	*out++ = ',';
+	out = formatUnsigned(out, battCap, 3, ' ');
+	*out++ = ',';
+	out = formatUnsigned(out, powerStat, 1, ' ');
+	*out++ = ',';
+	out = formatOctal(out, faultStatus, 2);
+
+	// Seal it with the CRC of the line so far
+	unsigned int crc = crc16Ccitt(CRC16_CCITT_INIT, (unsigned char *)recordBuffer,
+		out - recordBuffer);
+	*out++ = LOG_RECORD_CRC_MARK;
+	out = formatHex16(out, crc);
+	*out++ = '\n';
+	*out = '\0';
+	return out - recordBuffer;
+}
+
+// This function turns a hex digit into its value, or 0xFF if it is not one
+static unsigned char hexValue(unsigned char c) {
+	if ((c >= '0') && (c <= '9'))
+		return c - '0';
+	if ((c >= 'A') && (c <= 'F'))
+		return c - 'A' + 10;
+	return 0xFF;
+}
+
+// This function checks one line of the log file
+int checkLogRecord(const unsigned char *line, unsigned int length) {
+	// Everything has to be printable
+	unsigned int i;
+	for (i = 0; i < length; i++) {
+		if ((line[i] < ' ') || (line[i] > '~'))
+			return 0;
+	}
+
+	// No CRC on the end means a header or an old record
+	if ((length < 5) || (line[length - 5] != LOG_RECORD_CRC_MARK))
+		return 1;
+
+	// Read the CRC and compare it to the line
+	unsigned int crc = 0;
+	for (i = length - 4; i < length; i++) {
+		unsigned char nibble = hexValue(line[i]);
+		if (nibble == 0xFF)
+			return 0;
+		crc = (crc << 4) | nibble;
+	}
+	return crc == crc16Ccitt(CRC16_CCITT_INIT, line, length - 5);
+}
+
+// This function checks the tail of a log file and repairs it
+int recoverLogFile(char *fileName) {
+	// The mode to open the file in (r+ = read and write in place)
+	char updateArg[] = "r+";
+
+	// Open the file, a missing file has nothing to recover
+	FSFILE *logFile = FSfopen(fileName, updateArg);
+	if (logFile == NULL)
+		return LOG_RECOVERY_CLEAN;
+
+	// Read just the tail into the shared buffer
+	unsigned long fileSize = logFile->size;
+	unsigned long tailStart = 0;
+	if (fileSize > LOG_RECOVERY_BYTES)
+		tailStart = fileSize - LOG_RECOVERY_BYTES;
+	unsigned int tailLength = fileSize - tailStart;
+	if ((FSfseek(logFile, tailStart, SEEK_SET) != 0) ||
+		(FSfread(logChunkBuffer, 1, tailLength, logFile) != tailLength)) {
+		FSfclose(logFile);
+		return LOG_RECOVERY_FAILED;
+	}
+
+	// If the tail starts part way through a record, that record started
+	// in an earlier sector that was finished, so skip to the next line
+	unsigned int firstLine = 0;
+	if (tailStart > 0) {
+		while ((firstLine < tailLength) && (logChunkBuffer[firstLine] != '\n'))
+			firstLine++;
+		firstLine++;
+	}
+
+	// Find where the good records end and whether there are any bad ones
+	unsigned int lineStart = firstLine;
+	unsigned int goodEnd = firstLine;
+	unsigned char anyBad = 0;
+	unsigned int i;
+	for (i = firstLine; i < tailLength; i++) {
+		if (logChunkBuffer[i] == '\n') {
+			if (checkLogRecord(&logChunkBuffer[lineStart], i - lineStart))
+				goodEnd = i + 1;
+			else
+				anyBad = 1;
+			lineStart = i + 1;
+		}
+	}
+	if (lineStart < tailLength)
+		anyBad = 1;
+
+	// Nothing wrong
+	int result = LOG_RECOVERY_CLEAN;
+	if (!anyBad) {
+		FSfclose(logFile);
+		return result;
+	}
+
+	// Blank bytes (zeros or erased) on the end are data that never made it
+	// because the directory entry got ahead of it, so cut the size back
+	// to the last byte that was written.  The library has no truncate, but
+	// the size in the file object is what gets written to the directory
+	// entry when it is closed.
+	unsigned int markEnd = tailLength;
+	while ((markEnd > goodEnd) &&
+		((logChunkBuffer[markEnd - 1] == 0x00) || (logChunkBuffer[markEnd - 1] == 0xFF)))
+		markEnd--;
+	if (markEnd < tailLength) {
+		logFile->size = tailStart + markEnd;
+		result = LOG_RECOVERY_TRUNCATED;
+	}
+
+	// Mark each bad line that is left where it is, making the rest of it
+	// printable.  A last line with no newline was torn part way through
+	// so it is always bad, and it gets a newline so the next append
+	// starts clean.
+	unsigned char anyMarked = 0;
+	lineStart = firstLine;
+	for (i = firstLine; i <= markEnd; i++) {
+		if ((i == markEnd) || (logChunkBuffer[i] == '\n')) {
+			if ((i > lineStart) && ((i == markEnd) ||
+				!checkLogRecord(&logChunkBuffer[lineStart], i - lineStart))) {
+				unsigned int j;
+				logChunkBuffer[lineStart] = LOG_RECORD_BAD_MARK;
+				for (j = lineStart + 1; j < i; j++) {
+					if ((logChunkBuffer[j] < ' ') || (logChunkBuffer[j] > '~'))
+						logChunkBuffer[j] = '?';
+				}
+				if (i == markEnd)
+					logChunkBuffer[markEnd - 1] = '\n';
+				anyMarked = 1;
+			}
+			lineStart = i + 1;
+		}
+	}
+
+	// Write the marked lines back over themselves
+	if (anyMarked) {
+		if ((FSfseek(logFile, tailStart + firstLine, SEEK_SET) != 0) ||
+			(FSfwrite(&logChunkBuffer[firstLine], 1, markEnd - firstLine, logFile) !=
+			markEnd - firstLine)) {
+			result = LOG_RECOVERY_FAILED;
+		} else if (result == LOG_RECOVERY_CLEAN) {
+			result = LOG_RECOVERY_MARKED;
+		}
+	}
+
+	// Closing writes the directory entry with the size
+	if (FSfclose(logFile) != 0)
+		result = LOG_RECOVERY_FAILED;
+	return result;
+}
+
+// This function appends data to a file
+unsigned int appendToFile(char *fileName, const void *data, unsigned int length) {
+	// The mode to open the file in (a = append)
+	char appendArg[] = "a";
+	unsigned int written = 0;
+
+	// Open the file, write and close it
+	FSFILE *appendFile = FSfopen(fileName, appendArg);
+	if (appendFile != NULL) {
+		written = FSfwrite(data, 1, length, appendFile);
+		FSfclose(appendFile);
+	}
+	return written;
+}
+
+// This function lets a sample that is due go ahead from the middle of
+// reading a file
+FSFILE *logFileYield(FSFILE *file, char *fileName, unsigned long offset) {
+	// The mode to open the file in (r = read-only)
+	char readArg[] = "r";
+
+	if (!schedulerPending())
+		return file;
+
+	// The sample mounts the card again, which drops any open file, and
+	// turns SPI1 off when it is done, so the file is closed around it
+	FSfclose(file);
+	schedulerYield();
+
+	// Open it again where it was
+	PMD1bits.SPI1MD = 0;
+	if (!FSInit())
+		return NULL;
+	file = FSfopen(fileName, readArg);
+	if ((file != NULL) && (offset > 0) && (FSfseek(file, offset, SEEK_SET) != 0)) {
+		FSfclose(file);
+		return NULL;
+	}
+	return file;
+}
+
+// This function dumps the contents of a log file out UART1
+long dumpLogFile(char *fileName) {
+	unsigned long offset = 0;
+	return dumpLogFileFrom(fileName, &offset);
+}
+
+// This function dumps a log file out UART1 from an offset
+long dumpLogFileFrom(char *fileName, unsigned long *offset) {
+	// The mode to open the file in (r = read-only)
+	char readArg[] = "r";
+
+	// Open the file
+	FSFILE *logFile = FSfopen(fileName, readArg);
+	if (logFile == NULL)
+		return -1;
+
+	// Go to the offset, or back to the start if the file has been cleared
+	// since and is now shorter
+	if (*offset > logFile->size)
+		*offset = 0;
+	if ((*offset > 0) && (FSfseek(logFile, *offset, SEEK_SET) != 0)) {
+		FSfclose(logFile);
+		return -1;
+	}
+
+	// The number of bytes sent so far
+	long bytesSent = 0;
+
+	// Loop reading a sector at a time until the end of the file
+	while (1) {
+		// Let a sample go ahead if one is due
+		logFile = logFileYield(logFile, fileName, *offset + bytesSent);
+		if ((logFile == NULL) || FSfeof(logFile))
+			break;
+
+		// Read the next chunk
+		unsigned int bytesRead = FSfread(logChunkBuffer, 1, LOG_CHUNK_SIZE, logFile);
+		if (bytesRead == 0)
+			break;
+
+		// Translate the line endings in place for the terminal
+		unsigned int i;
+		for (i = 0; i < bytesRead; i++) {
+			if (logChunkBuffer[i] == '\n')
+				logChunkBuffer[i] = '\r';
+		}
+
+		// Queue it up for the transmitter.  This returns as soon as the chunk
+		// is in the ring buffer so the next read overlaps with sending this one
+		unsigned int bytesQueued = writeU1(logChunkBuffer, bytesRead);
+		bytesSent += bytesQueued;
+
+		// If the transmitter stalled, the terminal is gone so stop
+		if (bytesQueued < bytesRead)
+			break;
+	}
+
+	// Close the file
+	if (logFile != NULL)
+		FSfclose(logFile);
+
+	// Wait for the last of it to go out
+	flushU1();
+	*offset += bytesSent;
+
+	// Return the count
+	return bytesSent;
+}
+
+// This function finds where the last few records of a log file start
+long findLastRecords(char *fileName, unsigned int records) {
+	// The mode to open the file in (r = read-only)
+	char readArg[] = "r";
+
+	// Open the file
+	FSFILE *logFile = FSfopen(fileName, readArg);
+	if (logFile == NULL)
+		return -1;
+
+	// The last byte is the newline of the last record (or the end of a
+	// torn one), so the newlines before it are where records start.  Go
+	// back a sector at a time counting them.
+	unsigned long scanEnd = logFile->size;
+	if (scanEnd > 0)
+		scanEnd--;
+	unsigned long recordStart = 0;
+	unsigned int found = 0;
+	while ((scanEnd > 0) && (found < records)) {
+		// Read back to the start of the sector (only the first read is
+		// part of one)
+		unsigned long sectorStart = (scanEnd - 1) & ~((unsigned long)LOG_CHUNK_SIZE - 1);
+		unsigned int length = scanEnd - sectorStart;
+		if ((FSfseek(logFile, sectorStart, SEEK_SET) != 0) ||
+			(FSfread(logChunkBuffer, 1, length, logFile) != length)) {
+			FSfclose(logFile);
+			return -1;
+		}
+
+		// Count the newlines from the back
+		while (length > 0) {
+			length--;
+			if (logChunkBuffer[length] == '\n') {
+				found++;
+				if (found == records) {
+					recordStart = sectorStart + length + 1;
+					break;
+				}
+			}
+		}
+		scanEnd = sectorStart;
+	}
+
+	// Close the file
+	FSfclose(logFile);
+	return recordStart;
+}
@@ -59,6 +59,9 @@
 **********************************************************************/
 #include <p24fxxxx.h>
 
+// Include the header for this file (for RTCC_DATE)
+#include "RTCC.h"
+
 // Union to access rtcc registers
 typedef union tagRTCC {
 	struct {
@@ -86,6 +89,16 @@ RTCC _alarm;
 #define mRTCCDec2Bin(Dec) (10*(Dec>>4)+(Dec&0x0f))
 #define mRTCCBin2Dec(Bin) (((Bin/10)<<4)|(Bin%10))
 
+// How many times RTCCgrab reads the clock looking for two reads that
+// agree.  The clock only ticks once a second so the second try always
+// does unless something held us up for a second in between.
+#define RTCC_GRAB_TRIES		4
+
+// The days in the year before the first of each month (not a leap year)
+const unsigned int rtccDaysBeforeMonth[12] =
+	//jan feb mar apr  may  jun  jul  aug  sep  oct  nov  dec
+	{   0, 31, 59, 90, 120, 151, 181, 212, 243, 273, 304, 334 };
+
 unsigned char getHour(void);
 unsigned char getMin(void);
 unsigned char getSec(void);
@@ -94,7 +107,7 @@ unsigned char getDay(void);
 unsigned char getYear(void);
 
 void RTCCgrab(void);
-void RTCCInit(void);
+int RTCCInit(void);
 void RTCCSet(void);
 void RTCCAlarmSet(void);
 void RTCCUnlock(void);
@@ -140,8 +153,8 @@ unsigned char getYear(void) {
  ********************************************************************/
 void RTCCgrab(void)
 {
-	// Process time object only if time is not being set
-
+	unsigned char tries;
+	for (tries = 0; tries < RTCC_GRAB_TRIES; tries++) {
 		// Grab the time
 		RCFGCALbits.RTCPTR = 0;			
 		_time.prt00 = RTCVAL;
@@ -162,32 +175,232 @@ void RTCCgrab(void)
 		RCFGCALbits.RTCPTR = 3;			
 		_time_chk.prt11 = RTCVAL;
 
-		// Verify there is no roll-over
+		// If the two agree there was no roll-over part way through (say
+		// the seconds going 59 to 00 after the minutes were read) and
+		// _time_chk is good.  Otherwise read it all again.
 		if ((_time.prt00 == _time_chk.prt00) &&
 			(_time.prt01 == _time_chk.prt01) &&
 			(_time.prt10 == _time_chk.prt10) &&
 			(_time.prt11 == _time_chk.prt11))
-		{
-			// Here, you can watch structure _time, 
-			//	which has the data from RTCC registers.
- 
-			// TO DO: do something as you like here. 
-		}
-	
+			break;
+	}
 }
 
 /*********************************************************************
- * Function: RTCCInit
+ * Function: RTCCGetDate
+ *
+ * Preconditions: RTCCgrab must be called before.
+ *
+ * Overview: The function translates the time from the last grab out
+ * of BCD, one field at a time.
+ *
+ * Input: None.
+ *
+ * Output: The binary time and date in date.
+ *
+ ********************************************************************/
+void RTCCGetDate(RTCC_DATE *date)
+{
+	date->year = mRTCCDec2Bin(_time_chk.yr);
+	date->month = mRTCCDec2Bin(_time_chk.mth);
+	date->day = mRTCCDec2Bin(_time_chk.day);
+	date->hour = mRTCCDec2Bin(_time_chk.hr);
+	date->minute = mRTCCDec2Bin(_time_chk.min);
+	date->second = mRTCCDec2Bin(_time_chk.sec);
+}
+
+/*********************************************************************
+ * Function: RTCCGetEpoch
  *
  * Preconditions: RTCCInit must be called before.
  *
- * Overview: Enable the oscillator for the RTCC
+ * Overview: The function grabs the time and returns it as seconds
+ * since 2000-01-01T00:00:00.  The getXXX functions return the same
+ * time afterwards.
  *
  * Input: None.
  *
+ * Output: The epoch.
+ *
+ ********************************************************************/
+unsigned long RTCCGetEpoch(void)
+{
+	RTCC_DATE date;
+	RTCCgrab();
+	RTCCGetDate(&date);
+	return epochFromDate(&date);
+}
+
+/*********************************************************************
+ * Function: RTCCSetEpoch
+ *
+ * Preconditions: None.
+ *
+ * Overview: The function sets the clock to an epoch (seconds since
+ * 2000-01-01T00:00:00), with the week day worked out from it.
+ *
+ * Input: The epoch.
+ *
  * Output: None.
+ *
+ ********************************************************************/
+void RTCCSetEpoch(unsigned long epoch)
+{
+	RTCC_DATE date;
+	epochToDate(epoch, &date);
+	_time_chk.yr = mRTCCBin2Dec(date.year);
+	_time_chk.mth = mRTCCBin2Dec(date.month);
+	_time_chk.day = mRTCCBin2Dec(date.day);
+	_time_chk.hr = mRTCCBin2Dec(date.hour);
+	_time_chk.min = mRTCCBin2Dec(date.minute);
+	_time_chk.sec = mRTCCBin2Dec(date.second);
+	// 2000-01-01 was a Saturday (6)
+	_time_chk.wkd = (epoch / RTCC_SECONDS_PER_DAY + 6) % 7;
+	RTCCSet();
+}
+
+/*********************************************************************
+ * Function: epochFromDate
+ *
+ * Preconditions: None.
+ *
+ * Overview: The function turns a date and time into seconds since
+ * 2000-01-01T00:00:00.  Every fourth year from 2000 to 2099 is a leap
+ * year, so the days only take a multiply and a table look up.
+ *
+ * Input: The binary date and time.
+ *
+ * Output: The epoch.
+ *
+ ********************************************************************/
+unsigned long epochFromDate(const RTCC_DATE *date)
+{
+	// The days before this one (at most 36524, so 16 bits will do)
+	unsigned int days = date->year * 365U + (date->year + 3) / 4 +
+		rtccDaysBeforeMonth[date->month - 1] + date->day - 1;
+	if ((date->month > 2) && ((date->year % 4) == 0))
+		days++;
+
+	// And the seconds into this one
+	return days * RTCC_SECONDS_PER_DAY + date->hour * 3600UL +
+		date->minute * 60U + date->second;
+}
+
+/*********************************************************************
+ * Function: RTCCDateValid
+ *
+ * Preconditions: None.
+ *
+ * Overview: The function checks a date and time is a real one that
+ * the epoch can hold (2000 to 2099, a day that is in the month).
+ *
+ * Input: The binary date and time.
+ *
+ * Output: 1 if it is valid.
+ *
  ********************************************************************/
-void RTCCInit(void)
+int RTCCDateValid(const RTCC_DATE *date)
+{
+	if ((date->year > 99) || (date->month < 1) || (date->month > 12) ||
+		(date->day < 1) || (date->hour > 23) || (date->minute > 59) ||
+		(date->second > 59))
+		return 0;
+
+	// The days in the month from the table, February has one more in a
+	// leap year
+	unsigned int daysInMonth = (date->month == 12) ? 31 :
+		rtccDaysBeforeMonth[date->month] - rtccDaysBeforeMonth[date->month - 1];
+	if ((date->month == 2) && ((date->year % 4) == 0))
+		daysInMonth++;
+	return date->day <= daysInMonth;
+}
+
+/*********************************************************************
+ * Function: epochToDate
+ *
+ * Preconditions: None.
+ *
+ * Overview: The function turns seconds since 2000-01-01T00:00:00 back
+ * into a date and time.  Only the first divide is 32 bit, the rest
+ * works in whole days and four year (1461 day) cycles.
+ *
+ * Input: The epoch.
+ *
+ * Output: The binary date and time in date.
+ *
+ ********************************************************************/
+void epochToDate(unsigned long epoch, RTCC_DATE *date)
+{
+	// Split it into days and the seconds into the day
+	unsigned int days = epoch / RTCC_SECONDS_PER_DAY;
+	unsigned long secondOfDay = epoch - days * RTCC_SECONDS_PER_DAY;
+	date->hour = secondOfDay / 3600;
+	unsigned int secondOfHour = secondOfDay - date->hour * 3600UL;
+	date->minute = secondOfHour / 60;
+	date->second = secondOfHour % 60;
+
+	// Find the year, the first of each four is the leap year
+	unsigned char year = (days / 1461) * 4;
+	unsigned int dayOfYear = days % 1461;
+	if (dayOfYear >= 366) {
+		dayOfYear -= 366;
+		year += 1 + dayOfYear / 365;
+		dayOfYear %= 365;
+	}
+	date->year = year;
+
+	// Find the month going back from December
+	unsigned char leap = ((year % 4) == 0);
+	unsigned char month = 12;
+	unsigned int before;
+	while (1) {
+		before = rtccDaysBeforeMonth[month - 1];
+		if (leap && (month > 2))
+			before++;
+		if (dayOfYear >= before)
+			break;
+		month--;
+	}
+	date->month = month;
+	date->day = dayOfYear - before + 1;
+}
+
+// This function returns 1 if a BCD byte has two decimal digits
+static int rtccBcdValid(unsigned char bcd)
+{
+	return ((bcd & 0x0F) <= 9) && ((bcd >> 4) <= 9);
+}
+
+// This function reads the clock and returns 1 if it holds a real time
+// from RTCC_VALID_YEAR_MIN on (not left over from a start up)
+static int rtccTimeValid(void)
+{
+	RTCC_DATE date;
+	RTCCgrab();
+	if (!rtccBcdValid(_time_chk.yr) || !rtccBcdValid(_time_chk.mth) ||
+		!rtccBcdValid(_time_chk.day) || !rtccBcdValid(_time_chk.hr) ||
+		!rtccBcdValid(_time_chk.min) || !rtccBcdValid(_time_chk.sec))
+		return 0;
+	RTCCGetDate(&date);
+	return RTCCDateValid(&date) && (date.year >= RTCC_VALID_YEAR_MIN);
+}
+
+/*********************************************************************
+ * Function: RTCCInit
+ *
+ * Preconditions: RTCCInit must be called before.
+ *
+ * Overview: Enable the oscillator for the RTCC.  Only a power on
+ * reset stops the clock, so after any other reset (a brown out, the
+ * watchdog, MCLR) it is still running and its time is kept if it
+ * reads back as a real one.  Otherwise the clock is started at a
+ * placeholder time, to be set from the meter clock.
+ *
+ * Input: None.
+ *
+ * Output: 1 if the clock kept its time, 0 if it was started afresh.
+ ********************************************************************/
+int RTCCInit(void)
 {
     // Enables the LP OSC for RTCC operation
 	asm("mov #OSCCON,W1");	// move address of OSCCON to W1
@@ -199,6 +412,10 @@ void RTCCInit(void)
 	asm("mov.b W3, [W1]");	// write unlock byte 2
 	asm("mov.b W0, [W1]");	// enable SOSCEN
 
+	// A warm boot, leave the clock (and its calibration) alone
+	if (RCFGCALbits.RTCEN && rtccTimeValid())
+		return 1;
+
     // Unlock sequence must take place for RTCEN to be written
 	RCFGCAL	= 0x0000;
     RTCCUnlock();
@@ -217,6 +434,7 @@ void RTCCInit(void)
 
 	// Set it after you change the time and date. 
 	RTCCSet();
+	return 0;
 }
 
 /*********************************************************************
@@ -253,15 +471,96 @@ void RTCCSet(void)
 void RTCCAlarmSet(void)
 {
 	ALCFGRPTbits.ALRMEN = 0;				// Disable the alarm
-	// Set the time
+	// Set the time (the alarm has no year)
 	ALCFGRPTbits.ALRMPTR = 0;		// set min:sec
 	ALRMVAL = _alarm.prt00;
 	ALCFGRPTbits.ALRMPTR = 1;		// set week:hour
-	RTCVAL = _alarm.prt01;
+	ALRMVAL = _alarm.prt01;
 	ALCFGRPTbits.ALRMPTR = 2;		// set month:day
-	RTCVAL = _alarm.prt10;
-	ALCFGRPTbits.ALRMPTR = 3;		// set year
-	RTCVAL = _alarm.prt11;
+	ALRMVAL = _alarm.prt10;
+}
+
+/*********************************************************************
+ * Function: RTCCAlarmSetEpoch
+ *
+ * Preconditions: None.
+ *
+ * Overview: The function points the alarm at an epoch and turns it
+ * on.  With RTCC_ALARM_YEAR it fires once at that second.  With a
+ * shorter mask only the fields the mask compares count, and with
+ * repeat set it keeps firing every period of the mask.
+ *
+ * Input: The epoch, the alarm mask (RTCC_ALARM_xxx) and whether it
+ *        repeats (1) or fires once (0).
+ *
+ * Output: None.
+ *
+ ********************************************************************/
+void RTCCAlarmSetEpoch(unsigned long epoch, unsigned char mask, unsigned char repeat)
+{
+	RTCC_DATE date;
+	epochToDate(epoch, &date);
+	_alarm.mth = mRTCCBin2Dec(date.month);
+	_alarm.day = mRTCCBin2Dec(date.day);
+	_alarm.hr = mRTCCBin2Dec(date.hour);
+	_alarm.min = mRTCCBin2Dec(date.minute);
+	_alarm.sec = mRTCCBin2Dec(date.second);
+	// 2000-01-01 was a Saturday (6)
+	_alarm.wkd = (epoch / RTCC_SECONDS_PER_DAY + 6) % 7;
+	RTCCAlarmSet();
+
+	ALCFGRPTbits.AMASK = mask;
+	ALCFGRPTbits.ARPT = 0;
+	ALCFGRPTbits.CHIME = repeat;
+	ALCFGRPTbits.ALRMEN = 1;
+}
+
+/*********************************************************************
+ * Function: RTCCSetCalibration
+ *
+ * Preconditions: The clock is running.
+ *
+ * Overview: The function writes the drift calibration (the CAL bits
+ * of RCFGCAL).  CAL can only be changed just after the seconds tick
+ * over, and not at 00 seconds when the adjustment is being made, so
+ * it waits for the tick (up to a second or two).
+ *
+ * Input: The calibration, -128 to 127 steps of 4 clock pulses a
+ *        minute (about 2.03 ppm), positive makes the clock faster.
+ *
+ * Output: None.
+ *
+ ********************************************************************/
+void RTCCSetCalibration(signed char calibration)
+{
+	if (RTCCGetCalibration() == calibration)
+		return;
+	RTCCUnlock();
+	do {
+		// RTCSYNC is set just before the seconds tick over
+		while (RCFGCALbits.RTCSYNC == 0);
+		while (RCFGCALbits.RTCSYNC == 1);
+		RCFGCALbits.RTCPTR = 0;
+	} while ((RTCVAL & 0x00FF) == 0);
+	RCFGCALbits.CAL = (unsigned char)calibration;
+	RCFGCALbits.RTCWREN = 0;	// Lock the RTCC
+}
+
+/*********************************************************************
+ * Function: RTCCGetCalibration
+ *
+ * Preconditions: None.
+ *
+ * Overview: The function reads the drift calibration (the CAL bits).
+ *
+ * Input: None.
+ *
+ * Output: The calibration in steps of about 2.03 ppm.
+ *
+ ********************************************************************/
+signed char RTCCGetCalibration(void)
+{
+	return (signed char)RCFGCALbits.CAL;
 }
 
 /*********************************************************************
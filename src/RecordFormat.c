@@ -0,0 +1,173 @@
+/*******************************************************
+ * RecordFormat.c
+ * Fixed point number formatters for the log records and
+ * terminal replies
+ *******************************************************/
+
+// Include the header for this file
+#include "RecordFormat.h"
+
+// The powers of ten used to scale the fractions
+const unsigned long formatPowersOfTen[FORMAT_FIXED_MAX_DECIMALS + 1] = {
+	1UL, 10UL, 100UL, 1000UL, 10000UL, 100000UL, 1000000UL
+};
+
+// The date part of the last timestamp ("20YY-MM-DDT") and the date it is for
+char formatDatePrefix[12];
+unsigned char formatDateYear = 0xFF;
+unsigned char formatDateMonth = 0xFF;
+unsigned char formatDateDay = 0xFF;
+
+// This function writes an unsigned number padded to width
+char *formatUnsigned(char *out, unsigned long value, unsigned char width, char pad) {
+	// The digits come out backwards, so build them up at the end of a
+	// scratch buffer (32 bits is at most 10 digits)
+	char digits[10];
+	unsigned char count = 0;
+	do {
+		digits[count++] = '0' + (value % 10);
+		value /= 10;
+	} while (value > 0);
+
+	// Pad and then copy the digits out in the right order
+	while (width > count) {
+		*out++ = pad;
+		width--;
+	}
+	while (count > 0)
+		*out++ = digits[--count];
+	*out = '\0';
+	return out;
+}
+
+// This function writes a 16 bit number as four hex digits
+char *formatHex16(char *out, unsigned int value) {
+	signed char shift;
+	for (shift = 12; shift >= 0; shift -= 4) {
+		unsigned char nibble = (value >> shift) & 0x0F;
+		*out++ = (nibble < 10) ? ('0' + nibble) : ('A' + nibble - 10);
+	}
+	*out = '\0';
+	return out;
+}
+
+// This function writes a signed number
+char *formatSigned(char *out, long value) {
+	if (value < 0) {
+		*out++ = '-';
+		return formatUnsigned(out, 0UL - (unsigned long)value, 0, '0');
+	}
+	return formatUnsigned(out, value, 0, '0');
+}
+
+// This function writes an unsigned number in octal padded to width
+char *formatOctal(char *out, unsigned int value, unsigned char width) {
+	// 16 bits is at most 6 octal digits
+	char digits[6];
+	unsigned char count = 0;
+	do {
+		digits[count++] = '0' + (value & 0x07);
+		value >>= 3;
+	} while (value > 0);
+	while (width > count) {
+		*out++ = ' ';
+		width--;
+	}
+	while (count > 0)
+		*out++ = digits[--count];
+	*out = '\0';
+	return out;
+}
+
+// This function writes a float rounded to a number of decimal places
+char *formatFixed(char *out, float value, unsigned char decimals) {
+	if (decimals > FORMAT_FIXED_MAX_DECIMALS)
+		decimals = FORMAT_FIXED_MAX_DECIMALS;
+
+	// Anything that will not fit in a long (and NaN, which fails both
+	// compares) has no sensible fixed point form
+	if (!((value > -2147483000.0) && (value < 2147483000.0))) {
+		out[0] = 'o';
+		out[1] = 'v';
+		out[2] = 'f';
+		out[3] = '\0';
+		return out + 3;
+	}
+
+	// Work on the size and put the sign out first
+	if (value < 0) {
+		*out++ = '-';
+		value = -value;
+	}
+
+	// Split into the whole part and the fraction.  The fraction is taken
+	// as a 32 bit binary fraction (exact for anything over 1/256) and
+	// scaled in integers, so the rounding is decided on the real value
+	// and not on a float product that has already been rounded.
+	unsigned long scale = formatPowersOfTen[decimals];
+	unsigned long whole = (unsigned long)value;
+	unsigned long binaryFraction = (unsigned long)((value - whole) * 4294967296.0);
+	unsigned long long scaled = (unsigned long long)binaryFraction * scale;
+	unsigned long fraction = (unsigned long)(scaled >> 32);
+	unsigned long remainder = (unsigned long)(scaled & 0xFFFFFFFFUL);
+
+	// Round the fraction.  Exact halves go to the even digit the way
+	// printf does it, so the records match the old ones.
+	unsigned char lastDigitOdd = (decimals > 0) ? (fraction & 1) : (whole & 1);
+	if ((remainder > 0x80000000UL) || ((remainder == 0x80000000UL) && lastDigitOdd))
+		fraction++;
+
+	// Carry into the whole part if the fraction rounded up to one
+	if (fraction >= scale) {
+		fraction -= scale;
+		whole++;
+	}
+
+	// Whole part, point, then the fraction padded with zeros
+	out = formatUnsigned(out, whole, 0, '0');
+	if (decimals > 0) {
+		*out++ = '.';
+		out = formatUnsigned(out, fraction, decimals, '0');
+	}
+	return out;
+}
+
+// This function writes a two digit number with a leading zero
+static char *formatTwoDigits(char *out, unsigned char value) {
+	out[0] = '0' + (value / 10) % 10;
+	out[1] = '0' + value % 10;
+	return out + 2;
+}
+
+// This function writes a timestamp, reusing the date part if it has not changed
+char *formatTimestamp(char *out, unsigned char year, unsigned char month, unsigned char day,
+	unsigned char hour, unsigned char minute, unsigned char second) {
+	// Format the date part again only when the day rolls over
+	if ((year != formatDateYear) || (month != formatDateMonth) || (day != formatDateDay)) {
+		char *date = formatDatePrefix;
+		*date++ = '2';
+		*date++ = '0';
+		date = formatTwoDigits(date, year);
+		*date++ = '-';
+		date = formatTwoDigits(date, month);
+		*date++ = '-';
+		date = formatTwoDigits(date, day);
+		*date++ = 'T';
+		*date = '\0';
+		formatDateYear = year;
+		formatDateMonth = month;
+		formatDateDay = day;
+	}
+
+	// Copy the date part and add the time
+	unsigned char i;
+	for (i = 0; i < 11; i++)
+		*out++ = formatDatePrefix[i];
+	out = formatTwoDigits(out, hour);
+	*out++ = ':';
+	out = formatTwoDigits(out, minute);
+	*out++ = ':';
+	out = formatTwoDigits(out, second);
+	*out = '\0';
+	return out;
+}
@@ -0,0 +1,237 @@
+/*******************************************************
+ * Rollup.c
+ * Hourly, daily and monthly summaries of the flow samples
+ *******************************************************/
+
+// Include Microchips SD File Library
+#include "FSIO.h"
+
+// Include the UART library for the terminal
+#include "UART.h"
+
+// Include the fixed point number formatters
+#include "RecordFormat.h"
+
+// Include the CRC functions (for the saved open periods)
+#include "Checksum.h"
+
+// Include the header for this file
+#include "Rollup.h"
+
+// Include the string and print libraries
+#include <string.h>
+#include <stdio.h>
+
+// The size of the open periods on the card, the CRC goes on the end
+#define ROLLUP_OPEN_SIZE	(ROLLUP_LEVELS * ROLLUP_RECORD_SIZE)
+
+// The rollups that are currently being accumulated, one per level
+ROLLUP currentRollups[ROLLUP_LEVELS];
+
+// Whether the saved open periods have been looked for since the reset
+unsigned char rollupRestored = 0;
+
+// The names of the rollup files, indexed by level
+char *rollupFileNames[ROLLUP_LEVELS] = {ROLLUP_HOURLY_FILE, ROLLUP_DAILY_FILE, ROLLUP_MONTHLY_FILE};
+
+// The buffer used to print rollups to the terminal
+char rollupPrintBuffer[128];
+
+// This function packs a period start into a number that sorts in time order
+unsigned long rollupKey(unsigned char year, unsigned char month, unsigned char day,
+	unsigned char hour) {
+	return (((unsigned long)year) << 24) | (((unsigned long)month) << 16) |
+		(((unsigned int)day) << 8) | hour;
+}
+
+// This function appends a finished rollup to the file for its level
+void rollupWrite(unsigned char level, ROLLUP *rollup) {
+	// The mode to open the file in (a = append)
+	char appendArg[] = "a";
+
+	// Open, write and close
+	FSFILE *rollupFile = FSfopen(rollupFileNames[level], appendArg);
+	if (rollupFile != NULL) {
+		FSfwrite(rollup, 1, ROLLUP_RECORD_SIZE, rollupFile);
+		FSfclose(rollupFile);
+	}
+}
+
+// This function picks up the periods that were open when the logger was
+// reset.  A missing file, or one with a bad CRC (the reset came in the
+// middle of saving it), leaves them to start again.
+static void rollupRestore(void) {
+	// The mode to open the file in (r = read-only)
+	char readArg[] = "r";
+	char fileName[] = ROLLUP_OPEN_FILE;
+	unsigned char saved[ROLLUP_OPEN_SIZE + 2];
+
+	FSFILE *openFile = FSfopen(fileName, readArg);
+	if (openFile == NULL)
+		return;
+	unsigned int length = FSfread(saved, 1, sizeof(saved), openFile);
+	FSfclose(openFile);
+	if (length != sizeof(saved))
+		return;
+	unsigned int crc = crc16Ccitt(CRC16_CCITT_INIT, saved, ROLLUP_OPEN_SIZE);
+	if ((saved[ROLLUP_OPEN_SIZE] != (crc >> 8)) || (saved[ROLLUP_OPEN_SIZE + 1] != (crc & 0xFF)))
+		return;
+
+	memcpy(currentRollups, saved, ROLLUP_OPEN_SIZE);
+	unsigned char level;
+	for (level = 0; level < ROLLUP_LEVELS; level++) {
+		if (currentRollups[level].count > 0)
+			currentRollups[level].flags |= ROLLUP_FLAG_RESTARTED;
+	}
+}
+
+// This function saves the periods still being added up.  Once the file
+// is there it is written over in place so it keeps the one cluster.
+static void rollupSave(void) {
+	// The modes to open the file in (r+ = write in place, w = create)
+	char updateArg[] = "r+";
+	char writeArg[] = "w";
+	char fileName[] = ROLLUP_OPEN_FILE;
+	unsigned int crc = crc16Ccitt(CRC16_CCITT_INIT, (unsigned char *)currentRollups,
+		ROLLUP_OPEN_SIZE);
+	unsigned char trailer[2] = {crc >> 8, crc};
+
+	FSFILE *openFile = FSfopen(fileName, updateArg);
+	if (openFile == NULL)
+		openFile = FSfopen(fileName, writeArg);
+	if (openFile != NULL) {
+		FSfwrite(currentRollups, 1, ROLLUP_OPEN_SIZE, openFile);
+		FSfwrite(trailer, 1, 2, openFile);
+		FSfclose(openFile);
+	}
+}
+
+// This function adds one sample to the hourly, daily and monthly rollups
+void rollupAddSample(unsigned char year, unsigned char month, unsigned char day,
+	unsigned char hour, float meanFlow, float minFlow, float maxFlow, long totalizer,
+	unsigned int faultStatus) {
+	// The first sample after a reset carries on the periods that were open
+	if (!rollupRestored) {
+		rollupRestore();
+		rollupRestored = 1;
+	}
+
+	unsigned char level;
+	for (level = 0; level < ROLLUP_LEVELS; level++) {
+		ROLLUP *rollup = &currentRollups[level];
+
+		// Figure out which period this sample belongs to at this level
+		unsigned char periodDay = day;
+		unsigned char periodHour = hour;
+		if (level >= ROLLUP_DAILY)
+			periodHour = 0;
+		if (level == ROLLUP_MONTHLY)
+			periodDay = 1;
+
+		// If it is a new period, write out the old one and start fresh
+		if ((rollup->count == 0) || (rollup->year != year) || (rollup->month != month) ||
+			(rollup->day != periodDay) || (rollup->hour != periodHour)) {
+			// The new period starts where the old one ended so no flow falls
+			// between periods.  After a reset it starts at this sample.
+			long totalizerStart = totalizer;
+			if (rollup->count > 0) {
+				rollupWrite(level, rollup);
+				totalizerStart = rollup->totalizerEnd;
+			}
+			memset(rollup, 0, sizeof(ROLLUP));
+			rollup->year = year;
+			rollup->month = month;
+			rollup->day = periodDay;
+			rollup->hour = periodHour;
+			rollup->minFlow = minFlow;
+			rollup->maxFlow = maxFlow;
+			rollup->totalizerStart = totalizerStart;
+		}
+
+		// Add the sample
+		rollup->count++;
+		rollup->sumFlow += meanFlow;
+		if (minFlow < rollup->minFlow)
+			rollup->minFlow = minFlow;
+		if (maxFlow > rollup->maxFlow)
+			rollup->maxFlow = maxFlow;
+		rollup->totalizerEnd = totalizer;
+		rollup->faultBits |= faultStatus;
+	}
+
+	// Keep them in case the logger is reset before the periods end
+	rollupSave();
+}
+
+// This function prints one rollup record to the terminal
+void rollupPrint(ROLLUP *rollup, char *note) {
+	float meanFlow = 0;
+	if (rollup->count > 0)
+		meanFlow = rollup->sumFlow / rollup->count;
+	char minText[FORMAT_FIXED_MAX];
+	char meanText[FORMAT_FIXED_MAX];
+	char maxText[FORMAT_FIXED_MAX];
+	formatFixed(minText, rollup->minFlow, RECORD_FLOW_DECIMALS);
+	formatFixed(meanText, meanFlow, RECORD_FLOW_DECIMALS);
+	formatFixed(maxText, rollup->maxFlow, RECORD_FLOW_DECIMALS);
+	sprintf(rollupPrintBuffer, "20%02u-%02u-%02uT%02u,%u,%s,%s,%s,%ld,%o%s%s\r",
+		rollup->year, rollup->month, rollup->day, rollup->hour, rollup->count,
+		minText, meanText, maxText,
+		rollup->totalizerEnd - rollup->totalizerStart, rollup->faultBits,
+		(rollup->flags & ROLLUP_FLAG_RESTARTED) ? ",restarted" : "", note);
+	putsU1(rollupPrintBuffer);
+}
+
+// This function prints a range of rollup records to the terminal
+int rollupPrintRange(unsigned char level, unsigned char year, unsigned char month,
+	unsigned char day, unsigned char hour, int count) {
+	// The mode to open the file in (r = read-only)
+	char readArg[] = "r";
+	ROLLUP rollup;
+	int printed = 0;
+	unsigned long startKey = rollupKey(year, month, day, hour);
+
+	if (level >= ROLLUP_LEVELS)
+		return 0;
+
+	// Print a header
+	putsU1("Period,Samples,Min Flow(l/s),Mean Flow(l/s),Max Flow(l/s),Flow Total Delta(lx100),Fault Bits\r");
+
+	FSFILE *rollupFile = FSfopen(rollupFileNames[level], readArg);
+	if (rollupFile != NULL) {
+		// Binary search for the first record at or after the start.  The
+		// records are in time order so this takes one small read per halving.
+		long low = 0;
+		long high = rollupFile->size / ROLLUP_RECORD_SIZE;
+		while (low < high) {
+			long middle = (low + high) / 2;
+			FSfseek(rollupFile, middle * ROLLUP_RECORD_SIZE, SEEK_SET);
+			FSfread(&rollup, 1, ROLLUP_RECORD_SIZE, rollupFile);
+			if (rollupKey(rollup.year, rollup.month, rollup.day, rollup.hour) < startKey)
+				low = middle + 1;
+			else
+				high = middle;
+		}
+
+		// Now read forward from there
+		if (FSfseek(rollupFile, low * ROLLUP_RECORD_SIZE, SEEK_SET) == 0) {
+			while ((printed < count) &&
+				(FSfread(&rollup, 1, ROLLUP_RECORD_SIZE, rollupFile) == ROLLUP_RECORD_SIZE)) {
+				rollupPrint(&rollup, "");
+				printed++;
+			}
+		}
+		FSfclose(rollupFile);
+	}
+
+	// Finish with the period that is still being accumulated
+	ROLLUP *current = &currentRollups[level];
+	if ((printed < count) && (current->count > 0) &&
+		(rollupKey(current->year, current->month, current->day, current->hour) >= startKey)) {
+		rollupPrint(current, ",in progress");
+		printed++;
+	}
+
+	// Return how many were printed
+	return printed;
+}
@@ -0,0 +1,124 @@
+/*******************************************************
+ * Scheduler.c
+ * A small cooperative scheduler.  The RTCC interrupt
+ * only flags alarms, the alarms are serviced from the
+ * main loop whenever the Modbus and SD card buffers are
+ * free, including while the terminal waits for a key.
+ *******************************************************/
+
+// Include library for processor
+#include <p24fj256gb110.h>
+
+// Include the UART library for the terminal
+#include "UART.h"
+
+// Include the once a second timer for the terminal timeout
+#include "Timer.h"
+
+// Include the binary channel for host tools
+#include "HostLink.h"
+
+// Include the parts of the main program that service the alarm
+#include "TLR_Logger.h"
+
+// Include the header for this file
+#include "Scheduler.h"
+
+// The number of seconds to wait for a line before giving up
+#define SCHEDULER_LINE_TIMEOUT_SECONDS	90
+
+// The shared things that are in use right now
+unsigned char schedulerClaimed = 0;
+
+// The function to mark shared things as in use
+void schedulerClaim(unsigned char resources) {
+	schedulerClaimed |= resources;
+}
+
+// The function to release shared things and catch up on the alarms
+void schedulerRelease(unsigned char resources) {
+	schedulerClaimed &= ~resources;
+	schedulerRun();
+}
+
+// The function to service the RTCC alarms that are waiting
+void schedulerRun(void) {
+	// A sample needs the meter and the card, so wait if either is busy
+	while ((alarmFired > 0) && ((schedulerClaimed & SCHEDULER_ALL) == 0)) {
+		// Take the alarm.  One that comes in during the sample sets it
+		// again and is taken next time round.
+		alarmFired = 0;
+
+		// The sample uses both, hold them for the length of it
+		schedulerClaimed = SCHEDULER_ALL;
+		serviceAlarm();
+		schedulerClaimed = 0;
+	}
+}
+
+// The function to tell whether an alarm is waiting to be serviced
+int schedulerPending(void) {
+	return alarmFired > 0;
+}
+
+// The function to let a waiting sample go ahead from inside a command
+void schedulerYield(void) {
+	unsigned char held = schedulerClaimed;
+	schedulerClaimed = 0;
+	schedulerRun();
+	schedulerClaimed = held;
+}
+
+// The function to read a line while still logging, answering host tools
+// if asked to
+static char *schedulerReadLine(char *s, int len, int answerHost) {
+	LINE_EDITOR editor;
+	lineEditorStart(&editor, s, len);
+
+	// The timeout is from the last key pressed
+	timerSecondsStart();
+	unsigned int lastSecond = timerSecondsGet();
+	int lastLength = 0;
+
+	// Idle between keys.  The UART, the RTCC and the once a second timer
+	// all wake the PIC up, so alarms are serviced as they come in.
+	int state;
+	while ((state = lineEditorPoll(&editor)) != LINE_EDITOR_DONE) {
+		// A host tool sent a request, answer it and carry on with the line.
+		// In the middle of a command's question the escape byte is just
+		// dropped, as getsU1 does.
+		if (state == LINE_EDITOR_ESCAPE) {
+			if (answerHost) {
+				hostLinkService();
+				lastSecond = timerSecondsGet();
+			}
+			continue;
+		}
+		schedulerRun();
+		if (editor.length != lastLength) {
+			lastLength = editor.length;
+			lastSecond = timerSecondsGet();
+		}
+		if ((unsigned int)(timerSecondsGet() - lastSecond) >= SCHEDULER_LINE_TIMEOUT_SECONDS) {
+			if (editor.length < len - 1) {
+				s[editor.length++] = 0x18;
+				s[editor.length] = '\0';
+			}
+			break;
+		}
+		Idle();
+	}
+
+	// Return the buffer pointer
+	return s;
+}
+
+// The function to read a line at the TLR> prompt
+char *schedulerGetLine(char *s, int len) {
+	return schedulerReadLine(s, len, 1);
+}
+
+// The function to read the answer to a command's question
+char *schedulerGetReply(char *s, int len) {
+	return schedulerReadLine(s, len, 0);
+}
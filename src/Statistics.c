@@ -0,0 +1,46 @@
+/*******************************************************
+ * Statistics.c
+ * A streaming aggregator that keeps the count, mean,
+ * variance, minimum and maximum of a series of values
+ *******************************************************/
+
+// Include the math library for the square root
+#include <math.h>
+
+// Include the header for this file
+#include "Statistics.h"
+
+// Clear the statistics to start a new series
+void statsReset(RUNNING_STATS *stats) {
+	stats->count = 0;
+	stats->mean = 0;
+	stats->m2 = 0;
+	stats->min = 0;
+	stats->max = 0;
+}
+
+// Add a value to the statistics.  This uses Welford's method which
+// updates the mean and variance one value at a time and does not lose
+// precision the way summing squares does.
+void statsAdd(RUNNING_STATS *stats, float value) {
+	stats->count++;
+	if (stats->count == 1) {
+		stats->min = value;
+		stats->max = value;
+	} else {
+		if (value < stats->min)
+			stats->min = value;
+		if (value > stats->max)
+			stats->max = value;
+	}
+	float delta = value - stats->mean;
+	stats->mean += delta / stats->count;
+	stats->m2 += delta * (value - stats->mean);
+}
+
+// Return the sample standard deviation
+float statsStdDev(RUNNING_STATS *stats) {
+	if (stats->count < 2)
+		return 0;
+	return sqrt(stats->m2 / (stats->count - 1));
+}
@@ -23,15 +23,48 @@
 // Include the library for modbus functionality to flow meter
 #include "modbus.h"
 
+// Include the functions for moving log files to the terminal
+#include "LogFile.h"
+
+// Include the Real Time Clock functions
+#include "RTCC.h"
+
+// Include the hourly, daily and monthly rollups
+#include "Rollup.h"
+
+// Include the tick counter for spacing out reads
+#include "Timer.h"
+
+// Include the streaming statistics
+#include "Statistics.h"
+
+// Include the event watch mode
+#include "Watch.h"
+
+// Include the settings kept on the card
+#include "Config.h"
+
+// Include the daily consumption ledger
+#include "Ledger.h"
+
+// Include the clock drift calibration
+#include "Drift.h"
+
+// Include the terminal commands
+#include "Commands.h"
+
+// Include the background scheduler
+#include "Scheduler.h"
+
+// Include the parts of this file the terminal commands use
+#include "TLR_Logger.h"
+
 // Include the string library
 #include <string.h>
 
 // Define a constant to represent the bit mask for turning on the 96MHZ
 #define PLL_96MHZ_ON	0xF7FF
 
-// Define the number of samples to average
-#define NUMBER_OF_SAMPLES_TO_AVERAGE 	4
-
 // Configure the PIC24FJ256GB110, turn JTAG off, watchdog off
 _CONFIG1(ICS_PGx2 & JTAGEN_OFF & FWDTEN_OFF)
 // ?
@@ -40,28 +73,42 @@ _CONFIG2(FNOSC_PRIPLL & PLL_96MHZ_ON & PLLDIV_DIV2 & OSCIOFNC_OFF & FCKSM_CSDCMD
 // A flag to indicate that the UART 1 is active (terminal session is active)
 int terminalActive = 0;
 
+// Whether the PIC clock holds a real time.  It does not after a power up
+// until it has been set from the meter clock (or by hand).
+unsigned char clockValid = 0;
+
+// Whether an RTCC alarm has fired that the main loop has not serviced yet,
+// so it only samples when the alarm fired and not on every other wake up,
+// and does not lose one that fires while the terminal is busy (starts at
+// one to take a sample at power up)
+volatile int alarmFired = 1;
+
+// Alarm times are counted in whole intervals from this epoch, Sunday
+// 2000-01-02T05:00:00, so a daily sample is at 05:00, a weekly one is on
+// a Sunday at 05:00 and anything that divides an hour lands on the hour
+#define ALARM_REFERENCE_EPOCH	104400UL
+
+// The seconds between alarms and, for an interval the alarm masks cannot
+// do on their own, the epoch the alarm is set for (the main loop moves
+// it on once it has fired)
+unsigned long alarmIntervalSeconds = 0;
+unsigned long alarmNextEpoch = 0;
+unsigned char alarmComputed = 0;
+
+// The watch polls since the last normal sample, and the polls left to keep
+// logging every poll after an event
+unsigned long watchPollCount = 0;
+unsigned int watchHoldLeft = 0;
+
 // The interrupt service routine for the RTCC
 void _ISR _RTCCInterrupt(void) {
 	// Clear the interrupt flag
 	_RTCIF = 0;
 
-	// Re-enable the alarm (the alarm flag gets cleared when alarm fires
-	ALCFGRPTbits.ALRMEN = 1;	// Enable the Alarm
-}
-
-// The Interrupt service routine for the UART receiver
-void _ISR _U1RXInterrupt(void) {
-	// Clear the interrupt flag
-	_U1RXIF = 0;
-
-	// If the terminal is not active, print a message
-	if (terminalActive == 0) {
-		// Write message
-		putsU1("\x1b[2J\x1b[1H                            \rWaking up, please wait for TLR> prompt ...\r");
-	}
-
-	// Mark that the terminal session is active
-	terminalActive = 1;	
+	// Let the main loop know it is time to sample.  Alarms that come in
+	// before it gets to them make one late sample, not a backlog that
+	// would keep it from ever idling.
+	alarmFired = 1;
 }
 
 // This function sets up the various peripherals that are associated with the PIC controller
@@ -147,6 +194,30 @@ void setupPeripherals() {
 	PMD1bits.SPI1MD = 1;
 }
 
+// The function to set the PIC clock from a date read from the meter clock
+// (yy MM dd hh mm ss).  Returns 1 if the date was a real one and the clock
+// was set.
+static int setClockFromMeter(unsigned char meterDate[]) {
+	RTCC_DATE date;
+	date.year = meterDate[0];
+	date.month = meterDate[1];
+	date.day = meterDate[2];
+	date.hour = meterDate[3];
+	date.minute = meterDate[4];
+	date.second = meterDate[5];
+	if (!RTCCDateValid(&date))
+		return 0;
+	RTCCSetEpoch(epochFromDate(&date));
+	clockValid = 1;
+	timerStampInvalidate();
+
+	// The drift is measured from here on, and the alarm is worked out
+	// from the clock so set it again
+	driftReset();
+	applyAlarmMask();
+	return 1;
+}
+
 // This is the function to read in all the data from the flow meter and record
 // in the data buffer provided to the method call
 void readAndLogSample(void) {
@@ -154,30 +225,56 @@ void readAndLogSample(void) {
 	PMD1bits.SPI1MD = 0;
 
 	// The buffer to use to write to the file
-	char logRecordBuffer[255];
-
-	// Clear out the buffer
-	int p = 0;
-	for (p = 0; p < 255; p++) {
-		logRecordBuffer[p] = '\0';
+	char logRecordBuffer[LOG_RECORD_MAX];
+
+	// First we send a command just to clear up and establish comms.  This is
+	// more of a work around, but it seemed like every time it would wake up.
+	// It reads the meter clock, so when it does come back it gives the
+	// offset for the drift calibration, with the PIC time read straight
+	// after it.
+	unsigned char meterDate[6];
+	int haveMeterClock = readMeterClock(meterDate);
+
+	// If the PIC clock was not set at boot (the meter did not answer) take
+	// the time from the meter now, before it goes on a record
+	if (haveMeterClock && !clockValid)
+		setClockFromMeter(meterDate);
+	unsigned long picEpoch = RTCCGetEpoch();
+
+	// Read the flow values evenly spaced across the averaging window and
+	// keep the mean, spread and extremes of them.  Each read is scheduled
+	// from the start of the window so the time the reads take does not
+	// stretch the spacing.
+	// The record is stamped to the millisecond with the time the first
+	// of them was read, from Timer1 (it is only put back in step with the
+	// RTCC when that is due).
+	RUNNING_STATS flowStats;
+	TIMER_STAMP stamp;
+	statsReset(&flowStats);
+	timerStart();
+	unsigned long windowStart = timerGetTicks();
+	unsigned int i = 0;
+	for (i = 0; i < loggerConfig.samplesToAverage; i++) {
+		if (i > 0) {
+			timerWaitUntil(windowStart + timerMsToTicks((loggerConfig.averagingWindowMs * i) /
+				(loggerConfig.samplesToAverage - 1)));
+		} else {
+			timerStampTake(&stamp);
+		}
+		statsAdd(&flowStats, readFlowRate());
 	}
 
-	// First we send a command just to clear up and establish comms.  We then
-	// throw away that response.  This is more of a work around, but it seemed
-	// like every time it would wake up
-	unsigned char dateAndTime[6];
-	readActualDateAndTime(dateAndTime);
-
-	// Read flow values and average
-	float averageFlow = 0;
-	char i = 0;
-	for (i=0; i<NUMBER_OF_SAMPLES_TO_AVERAGE; i++) {
-		averageFlow += readFlowRate();
+	// Read the totalizer (both parts) and fault status in one go, and the
+	// meter's power up count for the consumption ledger
+	PROCESS_SNAPSHOT snapshot;
+	int haveSnapshot = readProcessSnapshot(&snapshot);
+	if (!haveSnapshot) {
+		// Fall back to reading them one at a time
+		snapshot.totalizer1Integer = readTotalizer1Integer();
+		snapshot.faultStatus = readFaultStatus();
 	}
-	averageFlow = averageFlow/NUMBER_OF_SAMPLES_TO_AVERAGE;
-
-	// Read Totalizer Integer
-	long integerTotalizerOne = readTotalizer1Integer();
+	long integerTotalizerOne = snapshot.totalizer1Integer;
+	unsigned int powerUps = readNumberOfPowerUps();
 
 	// Read the transmitter temp
 	float transTemp = readTransmitterTemp();
@@ -188,45 +285,173 @@ void readAndLogSample(void) {
 	// Power status
 	unsigned char powerStat = readPowerStatus();
 
-	// Read the fault status
-	unsigned int faultStatus = readFaultStatus();
+	// The fault status came with the totalizer
+	unsigned int faultStatus = snapshot.faultStatus;
+
+	// If the first read did not come back and an offset is due, try the
+	// meter clock once more now the line is awake
+	if (!haveMeterClock && driftDue(picEpoch)) {
+		haveMeterClock = readMeterClock(meterDate);
+		picEpoch = RTCCGetEpoch();
+	}
 
-	// Grab the current time and date and put in RTCC register
-	RTCCgrab();
+	// The rollups and ledger go by the date of the record
+	RTCC_DATE now;
+	epochToDate(stamp.epoch, &now);
 
 	// Initialize the File system
 	if (FSInit()){
-		// Define a pointer to the log file
-		FSFILE *logFile;
+		// Format the record and append it to the log file
+		int charsWritten = formatLogRecord(logRecordBuffer, &stamp, &flowStats,
+			integerTotalizerOne, transTemp, battCap, powerStat, faultStatus);
+		appendToFile(loggerConfig.logFileName, logRecordBuffer, charsWritten);
+
+		// Add the sample to the hourly, daily and monthly rollups
+		rollupAddSample(now.year, now.month, now.day, now.hour,
+			flowStats.mean, flowStats.min, flowStats.max, integerTotalizerOne, faultStatus);
+
+		// Add the totalizer to the daily consumption ledger
+		if (haveSnapshot) {
+			ledgerAddSample(now.year, now.month, now.day, snapshot.totalizer1Integer,
+				snapshot.totalizer1Fraction, powerUps);
+		}
 
-		// A variable to keep track of how many characters were written 
-		int charsWritten;
+		// Add the offset from the meter clock to the drift line
+		if (haveMeterClock && driftDue(picEpoch))
+			driftAddReading(meterDate, picEpoch);
+	}
 
-		// Define the name of the log file
-		char logFileName[] = "DATALOG.TXT";
+	// Flow change events are measured from this record
+	watchRecordLogged(flowStats.mean);
 
-		// The mode to open the file in (a = append, w = write/over-write
-		char appendArg[] = "a";
+	// Put Timer1 back in step with the RTCC if the calibration has had
+	// time to move them apart, now that the stamp has been taken
+	timerStampRefresh();
 
-		// Open the file
-		logFile = FSfopen(logFileName,appendArg);
+	// Now shutdown SPI1
+	PMD1bits.SPI1MD = 1;
+}
 
-		// If the file opened OK, write the log entry
-		if (logFile != NULL) {
-			// Write to a buffer first
-			charsWritten = sprintf(logRecordBuffer,"20%02u-%02u-%02uT%02u:%02u:%02u,%3.3f,%ld,%2.2f,%3u,%1u,%2o\n", 
-				getYear(), getMonth(), getDay(), getHour(), getMin(), getSec(), 
-				averageFlow, integerTotalizerOne,transTemp,battCap,powerStat,faultStatus);
-			// Write those to a file
-			FSfwrite(logRecordBuffer,1,charsWritten,logFile);
+// The function to return the number of seconds between alarms for an
+// alarm mask (the half second one counts as 1, the monthly and yearly
+// ones are not used)
+unsigned long alarmMaskSeconds(unsigned char mask) {
+	switch (mask) {
+		case RTCC_ALARM_10_SECONDS: return 10UL;
+		case RTCC_ALARM_MINUTE: return 60UL;
+		case RTCC_ALARM_10_MINUTES: return 600UL;
+		case RTCC_ALARM_HOUR: return 3600UL;
+		case RTCC_ALARM_DAY: return 86400UL;
+		case RTCC_ALARM_WEEK: return 604800UL;
+		default: return 1UL;
+	}
+}
 
-			// Close the file
-			FSfclose(logFile);
-		}
+// The function to return the repeating alarm mask that fires every
+// seconds, or RTCC_ALARM_YEAR if there is none and the alarm has to be
+// worked out each time.  The half second and second masks are left out,
+// a sample takes longer than that (see CONFIG_MIN_SAMPLE_SECONDS).
+static unsigned char alarmMaskForSeconds(unsigned long seconds) {
+	unsigned char mask;
+	for (mask = RTCC_ALARM_10_SECONDS; mask <= RTCC_ALARM_WEEK; mask++) {
+		if (alarmMaskSeconds(mask) == seconds)
+			return mask;
+	}
+	return RTCC_ALARM_YEAR;
+}
+
+// The function to return the first whole interval after now, counted from
+// ALARM_REFERENCE_EPOCH
+static unsigned long alarmNextAligned(unsigned long now, unsigned long interval) {
+	unsigned long phase = ALARM_REFERENCE_EPOCH % interval;
+	if (now < phase)
+		return phase;
+	return now - (now - phase) % interval + interval;
+}
+
+// The function to point the RTCC alarm at the watch poll interval if
+// watch mode is on, or the normal sample interval if it is not.  An
+// interval one of the alarm masks repeats at (every 10 seconds, minute,
+// 10 minutes, hour, day or week) is left to the hardware.  Any other is
+// set up as a one shot alarm at the next whole interval, and checkAlarm
+// sets the one after each time it fires, so the PIC only wakes when a
+// sample is due.
+void applyAlarmMask(void) {
+	unsigned long interval = loggerConfig.sampleSeconds;
+	if (watchSettings.enabled)
+		interval = alarmMaskSeconds(watchSettings.pollMask);
+	unsigned char mask = alarmMaskForSeconds(interval);
+
+	// Keep the interrupt out while the alarm is changed
+	_RTCIE = 0;
+	alarmIntervalSeconds = interval;
+	alarmNextEpoch = alarmNextAligned(RTCCGetEpoch(), interval);
+	alarmComputed = (mask == RTCC_ALARM_YEAR);
+	RTCCAlarmSetEpoch(alarmNextEpoch, mask, !alarmComputed);
+	_RTCIF = 0;
+	_RTCIE = 1;
+
+	// Start counting to the next normal sample again
+	watchPollCount = 0;
+	watchHoldLeft = 0;
+}
+
+// The function to set the alarm again once it has fired.  A repeating
+// alarm is just turned back on.  A one shot alarm that is not ahead of
+// the clock any more (it fired, was missed or the clock was changed) is
+// pointed at the next whole interval, without this the next one would
+// not come for a year.  It is done here and not in the interrupt so the
+// interrupt does not have to work out dates.
+static void checkAlarm(void) {
+	if (!alarmComputed) {
+		ALCFGRPTbits.ALRMEN = 1;
+		return;
 	}
+	unsigned long now = RTCCGetEpoch();
+	if (now < alarmNextEpoch)
+		return;
+	alarmNextEpoch = alarmNextAligned(now, alarmIntervalSeconds);
+	RTCCAlarmSetEpoch(alarmNextEpoch, RTCC_ALARM_YEAR, 0);
+}
 
-	// Now shutdown SPI1
-	PMD1bits.SPI1MD = 1;
+// The function to do whatever is due when the RTCC alarm fires.  Without
+// watch mode that is just a sample.  With watch mode each alarm is a
+// quick poll of the flow and fault status, and a full sample is taken
+// when the normal interval is up, when the poll fires an event, or on
+// every poll for a while after an event.
+void serviceAlarm(void) {
+	// Set up the next alarm before the sample so it is not missed while
+	// the sample is taken
+	checkAlarm();
+
+	// No watch, just sample
+	if (!watchSettings.enabled) {
+		readAndLogSample();
+		return;
+	}
+
+	// Count this poll towards the next normal sample
+	watchPollCount++;
+	int sampleDue = (watchPollCount >=
+		loggerConfig.sampleSeconds / alarmMaskSeconds(watchSettings.pollMask));
+
+	// Still logging fast after an event
+	if (watchHoldLeft > 0) {
+		watchHoldLeft--;
+		sampleDue = 1;
+	}
+
+	// Check the cheap registers, an event starts the fast logging
+	if (watchPoll() != WATCH_EVENT_NONE) {
+		watchHoldLeft = watchSettings.holdPolls;
+		sampleDue = 1;
+	}
+
+	// Take the full sample if one is due
+	if (sampleDue) {
+		readAndLogSample();
+		watchPollCount = 0;
+	}
 }
 
 // The main program
@@ -237,40 +462,17 @@ int main(void) {
 	// the correct pins that route to the various peripherals
 	init_PPS();
 
-	// Initialize the Real Time Clock and Calendar
-	RTCCInit();
-	
-	// Set the alarm register seconds, minutes, hours, days and write to Alarm
-	RTCCSetBinSec(0,1);
-	RTCCSetBinMin(0,1);
-	RTCCSetBinHour(5,1);
-	RTCCAlarmSet();
-
-	// Set the alarm interval
-	// 0x0 = Every half second
-	// 0x1 = Every second
-	// 0x2 = Every 10 seconds
-	// 0x3 = Every minute
-	// 0x4 = Every 10 minutes
-	// 0x5 = Every hour
-	// 0x6 = Once a day
-	// 0x7 = Once a week
-	// 0x8 = Once a month
-	// 0x9 = Once a year
-	ALCFGRPTbits.AMASK = 0x5;
-
-	// Enable the alarm
-	ALCFGRPTbits.ALRMEN = 1;
+	// Initialize the Real Time Clock and Calendar, it keeps its time if it
+	// ran through the reset
+	clockValid = RTCCInit();
 
 	// Initialize the interrupt for the RTCC
   	// Set the interrupt priority to level 4.  This is the default, but set 
 	// priority explicitly anyway
 	_RTCIP = 4;
-	// Clear the interrupt flag (0) so it will not fire when enabled
-	_RTCIF = 0;
-	// Enbale (1) the interrupt
-	_RTCIE = 1;
 
+	// Start with the default settings until they are loaded from the card
+	configDefaults();
 
 	// Setup the interrupt for the receive on UART1 so terminal can wake
 	// up processor from sleep
@@ -280,6 +482,13 @@ int main(void) {
 	_U1RXIF = 0;
 	// Enable (1) the interrupt
 	_U1RXIE = 1;
+
+	// Setup the interrupt for the transmit on UART1 that drains the
+	// terminal transmit buffer.  It is only enabled while there is
+	// something queued to send
+	_U1TXIP = 4;
+	_U1TXIF = 0;
+	_U1TXIE = 0;
 	
 	// Set the default interrupt priority level of the processor
 	// to 0.  This is the default, but explicity set it anyway
@@ -294,6 +503,29 @@ int main(void) {
 	// Setup the rest of the peripherals
 	setupPeripherals();
 
+	// Load the settings from the card, then check the end of the log file
+	// in case the power went while it was being written, and pick up the
+	// ledger day that was open
+	PMD1bits.SPI1MD = 0;
+	if (FSInit()){
+		configLoad();
+		recoverLogFile(loggerConfig.logFileName);
+		ledgerRestore();
+	}
+	PMD1bits.SPI1MD = 1;
+
+	// Put the settings into use
+	configApply();
+
+	// If the clock stopped, set it from the meter clock in one read so the
+	// first sample has the right time
+	if (!clockValid) {
+		unsigned char meterDate[6];
+		if (readMeterClock(meterDate))
+			setClockFromMeter(meterDate);
+	}
+	applyAlarmMask();
+
 	// Enter an endless loop
 	while(1) {
 
@@ -307,7 +539,7 @@ int main(void) {
 
 			// Enter loop that asks for user's input and processes it until the user
 			// exits.
-			putsU1("\r                                  \rWelcome! All normal processing is halted until 'resume' is entered\r");
+			putsU1("\r                                  \rWelcome! Logging carries on in the background, enter 'resume' when done\r");
 
 			// The buffer for the user's command
 			char command[128];
@@ -333,8 +565,8 @@ int main(void) {
 					toPrint[p] = '\0';
 				}
 
-				// Read the command from the user
-				getsU1(command, 128);
+				// Read the command from the user, sampling in between keys
+				schedulerGetLine(command, 128);
 
 				// Check the return string for the 'Cancel' character 0x18 (^X)
 				// which means the get command from user most likely timed out
@@ -346,367 +578,46 @@ int main(void) {
 					break;
 				}
 
-				// Check to see if the command was 'resume'
-				if (strncmp(command,"resume",6) == 0) {
+				// Look the command up in the command table and run it
+				if (runCommand(command, toPrint) == COMMAND_EXIT) {
 					userExit = 1;
-					// Clear the terminal active flag
-					terminalActive = 0;
-					putsU1("Exited terminal and resuming normal operation.\r");
-				} else if (strncmp(command,"gpdt",4) == 0) {
-					// The user has request the date and time from the PIC
-					RTCCgrab();
-					sprintf(toPrint,"PIC Time = 20%02u-%02u-%02uT%02u:%02u:%02u \r", 
-						getYear(), getMonth(), getDay(), getHour(), getMin(), getSec());
-				} else if (strncmp(command,"gplf",4) == 0) {
-					// The user has requested a dump of the contents of the log file
-					// Turn on SPI1
-					PMD1bits.SPI1MD = 0;
-					// Initialize the File system
-					if (FSInit()){
-						// Define a pointer to the log file
-						FSFILE *logFile;
-
-						// Define the name of the log file
-						char logFileName[] = "DATALOG.TXT";
-
-						// The mode to open the file in (a = append, w = write/over-write, r = read-only)
-						char appendArg[] = "r";
-
-						// Open the file
-						logFile = FSfopen(logFileName,appendArg);
-
-						// If the file opened OK, loop over the lines and print to the terminal
-						if (logFile != NULL) {
-							// While not at end of file
-							unsigned char fromFile[1];
-							while(!FSfeof(logFile)) {
-								FSfread(fromFile,1,1,logFile);
-								if (fromFile[0] == '\n'){ 
-									putU1('\r');
-								} else {
-									putU1(fromFile[0]);
-								}
-							}
-						}
-						// Close the file
-						FSfclose(logFile);
-					}
-					// Write done message to terminal buffer
-					sprintf(toPrint,"Done reading log file\r");
-					// Turn off SPI1
-					PMD1bits.SPI1MD = 1;
-				} else if (strncmp(command,"spyr",4) == 0) {
-					// Prompt for year
-					putsU1("Enter last two digits of the year: i.e. '08' for 2008\r> ");
-					getsU1(command,128);
-					// Set the year using the entered two digits
-					char yearAsChar[3] = {command[0],command[1],'\0'};
-					// Convert to int
-					int yearAsInt = atoi(yearAsChar);
-					// Grab the current times to refresh the holding variables
-					RTCCgrab();
-					// Change the year holding variable
-					RTCCSetBinYear(yearAsInt,0);
-					// Write to the RTCC registers
-					RTCCSet();
-					// Read the clock again
-					RTCCgrab();
-					// Set the response buffer
-					sprintf(toPrint,"PIC Time = 20%02u-%02u-%02uT%02u:%02u:%02u \r", 
-						getYear(), getMonth(), getDay(), getHour(), getMin(), getSec());
-				} else if (strncmp(command,"spmo",4) == 0) {
-					// Prompt for month
-					putsU1("Enter month in full two digits: i.e. '08' for August\r> ");
-					getsU1(command,128);
-					// Set the month using the response from the user
-					char monthAsChar[3] = {command[0],command[1],'\0'};
-					// Convert to int
-					int monthAsInt = atoi(monthAsChar);
-					// Grab the current time from RTCC and put in holding variables
-					RTCCgrab();
-					// Update holding variables
-					RTCCSetBinMonth(monthAsInt,0);
-					// Set the RTCC from the holding variables
-					RTCCSet();
-					// Grab the current time again and write to terminal buffer
-					RTCCgrab();
-					sprintf(toPrint,"PIC Time = 20%02u-%02u-%02uT%02u:%02u:%02u \r", 
-						getYear(), getMonth(), getDay(), getHour(), getMin(), getSec());
-				} else if (strncmp(command,"spdy",4) == 0) {
-					// Prompt for day
-					putsU1("Enter day of month in full two digits: i.e. '02' for the 2nd\r> ");
-					getsU1(command,128);
-					// Set the day using the first two chars of the response 
-					char dayAsChar[3] = {command[0],command[1],'\0'};
-					// Convert to int
-					int dayAsInt = atoi(dayAsChar);
-					// Grab the current time from RTCC and set holding variables
-					RTCCgrab();
-					// Update holding variables
-					RTCCSetBinDay(dayAsInt,0);
-					// Set the RTCC from the holding variables
-					RTCCSet();
-					// Read back from the RTCC and set terminal buffer
-					RTCCgrab();
-					sprintf(toPrint,"PIC Time = 20%02u-%02u-%02uT%02u:%02u:%02u \r", 
-						getYear(), getMonth(), getDay(), getHour(), getMin(), getSec());
-				} else if (strncmp(command,"sphr",4) == 0) {
-					// Prompt for hour
-					putsU1("Enter hour of day in full two digits (24 hour): i.e. '02' for 2AM\r> ");
-					getsU1(command,128);
-					// Set the hour using the first two chars of the response 
-					char hourAsChar[3] = {command[0],command[1],'\0'};
-					// Convert to an integer
-					int hourAsInt = atoi(hourAsChar);
-					// Grab the current time and put in holding variables
-					RTCCgrab();
-					// Set the hour on the holding variables
-					RTCCSetBinHour(hourAsInt,0);
-					// Write the holding variables to the RTCC
-					RTCCSet();
-					// Read the time again and put in terminal buffer
-					RTCCgrab();
-					sprintf(toPrint,"Current Time = 20%02u-%02u-%02uT%02u:%02u:%02u \r", 
-						 getYear(), getMonth(), getDay(), getHour(), getMin(), getSec());
-				} else if (strncmp(command,"spmn",4) == 0) {
-					// Prompt for minute
-					putsU1("Enter minute in full two digits: i.e. '02' for 2 minutes after hour\r> ");
-					getsU1(command,128);
-					// Set the minute using the first two chars of the response 
-					char minuteAsChar[3] = {command[0],command[1],'\0'};
-					// Convert to an integer
-					int minuteAsInt = atoi(minuteAsChar);
-					// Grab the current time and put in holding variables
-					RTCCgrab();
-					// Write the minute to the holding variables
-					RTCCSetBinMin(minuteAsInt,0);
-					// Set the RTCC with values in the holding variables
-					RTCCSet();
-					// Read the RTCC again and put in terminal buffer
-					RTCCgrab();
-					sprintf(toPrint,"Current Time = 20%02u-%02u-%02uT%02u:%02u:%02u \r", 
-						getYear(), getMonth(), getDay(), getHour(), getMin(), getSec());
-				} else if (strncmp(command,"spsc",4) == 0) {
-					// Prompt for seconds
-					putsU1("Enter seconds in full two digits: i.e. '02' for 2 seconds after minute\r>");
-					getsU1(command,128);
-					// Set the second using the first two chars of the response 
-					char secondAsChar[3] = {command[0],command[1],'\0'};
-					// Convert to an integer
-					int secondAsInt = atoi(secondAsChar);
-					// Read the current time and put in holding variables
-					RTCCgrab();
-					// Update the seconds on the holding variables
-					RTCCSetBinSec(secondAsInt,0);
-					// Set the RTCC with values from the holding variables
-					RTCCSet();
-					// Read the time again and put in terminal buffer
-					RTCCgrab();
-					sprintf(toPrint,"Current Time = 20%02u-%02u-%02uT%02u:%02u:%02u \r", 
-						getYear(), getMonth(), getDay(), getHour(), getMin(), getSec());
-				} else if (strncmp(command,"ptsm",4) == 0) {
-					// Ask the user how many samples to take
-					putsU1("How many samples do you want to log (01-99)?\r");
-					putsU1("Enter in two digit format (i.e. 02 for two samples)\r>");
-					getsU1(command,128);
-					// Grab the user's reply
-					char numSampsAsChar[3] = {command[0],command[1],'\0'};
-					// Convert to an integer
-					int numberOfSamplesToTake = atoi(numSampsAsChar);
-					putsU1("OK, starting to sample");
-					int lc;
-					for (lc = 0; lc < numberOfSamplesToTake; lc++) {
-						// Read the log sample
-						readAndLogSample();
-						putU1('.');
-					}
-					sprintf(toPrint,"OK, done sampling, use gplf to see the samples. \r");
-				} else if (strncmp(command,"pssi",4) == 0) {
-					putsU1("Choose interval that the PIC will sample the flow meter:\r");
-					putsU1("A = Every 10 minutes\rB = Every hour\rC = Once a day\rD = Once a week\r>");
-					getsU1(command,128);
-					if (command[0] == 'a' || command[0] == 'A') {
-						ALCFGRPTbits.AMASK = 0x4;
-						sprintf(toPrint,"OK, set to sample once every 10 minutes.\r");
-					} else if (command[0] == 'b' || command[0] == 'B'){
-						ALCFGRPTbits.AMASK = 0x5;
-						sprintf(toPrint,"OK, set to sample once per hour.\r");
-					} else if (command[0] == 'c' || command[0] == 'C'){
-						ALCFGRPTbits.AMASK = 0x6;
-						sprintf(toPrint,"OK, set to sample once per day.\r");
-					} else if (command[0] == 'd' || command[0] == 'D'){
-						ALCFGRPTbits.AMASK = 0x7;
-						sprintf(toPrint,"OK, set to sample once per week.\r");
-					} else {
-						sprintf(toPrint,"Sorry, did not understand that option.\r");
-					}
-				} else if (strncmp(command,"spcl",4) == 0) {
-					putsU1("This command will CLEAR ALL DATA FROM THE LOGS!!!\r");
-					putsU1("ARE YOU SURE YOU WANT TO DO THIS?(y|[n])\r>");
-					getsU1(command,128);
-					if (command[0] == 'y' || command[0] == 'Y') {
-						// Enable SPI1
-						PMD1bits.SPI1MD = 0;
-
-						// Buffer allocation
-						char headerBuffer[255];
-						// Initialize the File system
-						if (FSInit()){
-							// Define a pointer to the log file
-							FSFILE *logFile;
-
-							// A variable to keep track of how many characters were written 
-							int charsWritten;
-
-							// Define the name of the log file
-							char logFileName[] = "DATALOG.TXT";
-
-							// The mode to open the file in (a = append, w = write/over-write
-							char appendArg[] = "w";
-
-							// Open the file
-							logFile = FSfopen(logFileName,appendArg);
-
-							// If the file opened OK, write a header
-							if (logFile != NULL) {
-								// Write to a buffer first
-								charsWritten = sprintf(headerBuffer,"Timestamp,Avg Flow Rate(l/s),Flow Total(lx100),Transmitter Temp(Deg C),Battery Cap(%),Power Status,Fault Code\n");
-								// Write those to a file
-								FSfwrite(headerBuffer,1,charsWritten,logFile);
-
-								// Close the file
-								FSfclose(logFile);
-							}
-						}
-
-						// Disable SPI1
-						PMD1bits.SPI1MD = 1;
-						sprintf(toPrint,"OK, log file is cleared.\r");
-					} else {
-						sprintf(toPrint,"Log file NOT cleared.\r");
-					}
-				} else if (strncmp(command,"gfdt",4) == 0) {
-					unsigned char flowMeterClock[6];
-					readActualDateAndTime(flowMeterClock);
-					sprintf(toPrint,"Flow Meter Date = 20%02u-%02u-%02uT%02u:%02u:%02u \r", flowMeterClock[0],
-						flowMeterClock[1],flowMeterClock[2],flowMeterClock[3],flowMeterClock[4],
-						flowMeterClock[5]);
-				} else if (strncmp(command,"gfcd",4) == 0) {
-					unsigned char calDate[6];
-					readCalDateAndTime(calDate);
-					sprintf(toPrint,"Flow Meter Calibration Date = 20%02u-%02u-%02uT%02u:%02u:%02u \r", calDate[0],
-						calDate[1],calDate[2],calDate[3],calDate[4],
-						calDate[5]);
-				} else if (strncmp(command,"gfcf",4) == 0) {
-					sprintf(toPrint,"Calibration Factor = %5.5f \r", 
-						readCalibrationFactor());
-				} else if (strncmp(command,"gfoh",4) == 0) {
-					sprintf(toPrint,"Operating hours since first power up = %lu \r", 
-						readOperatingHoursSincePowerUp());
-				} else if (strncmp(command,"gfnp",4) == 0) {
-					sprintf(toPrint,"Number of power ups since first power up = %u \r", 
-						readNumberOfPowerUps());
-				} else if (strncmp(command,"gftf",4) == 0) {
-					sprintf(toPrint,"Total flow since stats reset = %ld \r", 
-						readTotalizer1Integer());
-				} else if (strncmp(command,"gftu",4) == 0) {
-					unsigned char totalFlowUnitsBuffer[13];
-					readTotalFlowUnits(totalFlowUnitsBuffer);
-					sprintf(toPrint,"Units for total flow = %s \r", 
-						totalFlowUnitsBuffer);
-				} else if (strncmp(command,"gfqn",4) == 0) {
-					sprintf(toPrint,"Qn (nominal flow) = %5.5f \r", 
-						readQn());
-				} else if (strncmp(command,"gffl",4) == 0) {
-					// Do a priming read
-					readFlowRate();
-					sprintf(toPrint,"Current flow rate = %5.5f \r", 
-						readFlowRate());
-				} else if (strncmp(command,"gffr",4) == 0) {
-					sprintf(toPrint,"Current flow rate as percent of Qn = %3.2f%% \r", 
-						readFlowratePercentValue());
-				} else if (strncmp(command,"gfmx",4) == 0) {
-					sprintf(toPrint,"Max flow rate recorded = %5.5f \r", 
-						readHighestFlowRate());
-				} else if (strncmp(command,"gfmd",4) == 0) {
-					unsigned char maxFlowDate[6];
-					readHighestFlowDateAndTime(maxFlowDate);
-					sprintf(toPrint,"Date of maximum recorded flow = 20%02u-%02u-%02uT%02u:%02u:%02u \r", maxFlowDate[0],
-						maxFlowDate[1],maxFlowDate[2],maxFlowDate[3],maxFlowDate[4],
-						maxFlowDate[5]);
-				} else if (strncmp(command,"gfmn",4) == 0) {
-					sprintf(toPrint,"Minimum flow rate recorded = %5.5f \r", 
-						readLowestFlowRate());
-				} else if (strncmp(command,"gfnd",4) == 0) {
-					unsigned char minFlowDate[6];
-					readLowestFlowDateAndTime(minFlowDate);
-					sprintf(toPrint,"Date of minimum recorded flow = 20%02u-%02u-%02uT%02u:%02u:%02u \r", minFlowDate[0],
-						minFlowDate[1],minFlowDate[2],minFlowDate[3],minFlowDate[4],
-						minFlowDate[5]);
-				} else if (strncmp(command,"gfhc",4) == 0) {
-					sprintf(toPrint,"Highest consumption in day = %5.5f \r", 
-						readHighestDayConsumption());
-				} else if (strncmp(command,"gfhd",4) == 0) {
-					unsigned char highestConsumptionDate[6];
-					readHighestDayConsumptionDateAndTime(highestConsumptionDate);
-					sprintf(toPrint,"Date of highest day consumption = 20%02u-%02u-%02uT%02u:%02u:%02u \r", highestConsumptionDate[0],
-						highestConsumptionDate[1],highestConsumptionDate[2],highestConsumptionDate[3],highestConsumptionDate[4],
-						highestConsumptionDate[5]);
-				} else if (strncmp(command,"gffc",4) == 0) {
-					sprintf(toPrint,"Flowrate cutoff (as %% of Qn) = %3.2f%% \r", 
-						readLowFlowCutoff());
-				} else if (strncmp(command,"gffu",4) == 0) {
-					unsigned char flowRateUnitsBuffer[13];
-					readFlowRateUnits(flowRateUnitsBuffer);
-					sprintf(toPrint,"Units for flow rate = %s \r", 
-						flowRateUnitsBuffer);
-				} else if (strncmp(command,"gfvl",4) == 0) {
-					sprintf(toPrint,"Current Velocity = %5.5f \r", 
-						readActualVelocity());
-				} else if (strncmp(command,"gftp",4) == 0) {
-					sprintf(toPrint,"Current transmitter temp = %3.2f degrees C.\r", 
-						readTransmitterTemp());
-				} else if (strncmp(command,"gfbt",4) == 0) {
-					sprintf(toPrint,"Battery %% of max capacity = %3u%%\r", 
-						readBatteryCapacity());
-				} else if (strncmp(command,"gfps",4) == 0) {
-					sprintf(toPrint,"Power Status = %02u\r", 
-						readPowerStatus());
-				} else if (strncmp(command,"gfft",4) == 0) {
-					sprintf(toPrint,"Fault Status = 0x%o\r", 
-						readFaultStatus());
-				} else if (strncmp(command,"gfmt",4) == 0) {
-					sprintf(toPrint,"Comm module type = %02u\r", 
-						readCommModuleType());
-				} else if (strncmp(command,"gfll",4) == 0) {
-					unsigned char latestLogDate[6];
-					readLastLogDate(latestLogDate);
-					sprintf(toPrint,"Date of last log entry = 20%02u-%02u-%02uT%02u:%02u:%02u \r", latestLogDate[0],
-						latestLogDate[1],latestLogDate[2],latestLogDate[3],latestLogDate[4],
-						latestLogDate[5]);
-				} else if (strncmp(command,"fsyn",4) == 0) {
-					putsU1("Flow Meter Clock will be set to time on PIC\r");
-					unsigned char timeSnapshot[6] = {getYear(),getMonth(),getDay(),getHour(),getMin(),getSec()};
-					setActualDateAndTime(timeSnapshot);
-					putsU1("OK, time set on flow meter.\r");					
-				} else {
-					if (command[0] == '\0') {
-					} else {
-						sprintf(toPrint,"Sorry, didn't understand %s \r",command);
-					}
 				}
 				putsU1(toPrint);
 			}
 		} else {
-			// Read the log sample
-			readAndLogSample();
+			// Sample (or poll in watch mode) if it was the alarm that woke us
+			schedulerRun();
+
+			// If something was typed on the terminal, start a terminal session.
+			// The receive interrupt only queues the character, the message is
+			// printed from here so the interrupt never waits on the transmitter.
+			if (charArrivedAtUART1()) {
+				putsU1("\x1b[2J\x1b[1H                            \rWaking up, please wait for TLR> prompt ...\r");
+				terminalActive = 1;
+			}
 
 			// If the terminal is not active, shut everything down and wait for next interrupt
 			if (terminalActive <= 0) {
+				// Let anything still queued for the terminal go out before
+				// the UART is reset
+				flushU1();
+
 				// Before it goes to sleep, make sure we reset the
 				// bit to enable the UART for the terminal to wake it up
 				U1MODE = 0x8288;
 
+				// Stop the tick counter, it is only needed while sampling or
+				// waiting on the terminal
+				timerStop();
+
+				// Stop the once a second interrupt so only the alarm and the
+				// terminal wake us.  Timer1 itself keeps running from the
+				// crystal so the next stamp only has to read the RTCC second.
+				timerSecondsPause();
+
+				// Make sure the alarm will wake us
+				checkAlarm();
+
 				// Put PIC to sleep
 				//Sleep();
 				Idle();
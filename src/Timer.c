@@ -0,0 +1,246 @@
+/*******************************************************
+ * Timer.c
+ * A free running 32 bit tick counter built from Timer2
+ * and Timer3 chained together, and a once a second
+ * interrupt from Timer1 on the 32kHz clock
+ *******************************************************/
+
+// Include library for processor
+#include <p24fj256gb110.h>
+
+// Include the clock definitions
+#include "Compiler.h"
+#include "HardwareProfile.h"
+
+// Include the Real Time Clock functions (for the time stamps)
+#include "RTCC.h"
+
+// Include the header for this file
+#include "Timer.h"
+
+// Turn on the tick counter if it is not already running
+void timerStart(void) {
+	// If it is already running, leave it alone
+	if ((PMD1bits.T2MD == 0) && (PMD1bits.T3MD == 0) && T2CONbits.TON)
+		return;
+
+	// Power up Timer2 and Timer3
+	PMD1bits.T2MD = 0;
+	PMD1bits.T3MD = 0;
+
+	// Stop both and make them one 32 bit timer with a 1:256 prescaler
+	T2CON = 0;
+	T3CON = 0;
+	T2CONbits.T32 = 1;
+	T2CONbits.TCKPS = 3;
+
+	// Count all the way up before rolling over
+	TMR3 = 0;
+	TMR2 = 0;
+	PR3 = 0xFFFF;
+	PR2 = 0xFFFF;
+
+	// Start it
+	T2CONbits.TON = 1;
+}
+
+// Turn off the tick counter to save power before idling
+void timerStop(void) {
+	T2CONbits.TON = 0;
+	PMD1bits.T2MD = 1;
+	PMD1bits.T3MD = 1;
+}
+
+// Return the current tick count
+unsigned long timerGetTicks(void) {
+	// Reading TMR2 latches the upper word into TMR3HLD so the two
+	// halves always go together
+	unsigned int lowWord = TMR2;
+	unsigned int highWord = TMR3HLD;
+	return (((unsigned long)highWord) << 16) | lowWord;
+}
+
+// Convert a number of ticks to milliseconds
+unsigned long timerTicksToMs(unsigned long ticks) {
+	// Split it up so the multiply can not overflow
+	unsigned long ticksPerSecond = TIMER_TICKS_PER_SECOND;
+	return (ticks / ticksPerSecond) * 1000 + ((ticks % ticksPerSecond) * 1000) / ticksPerSecond;
+}
+
+// Convert a number of milliseconds to ticks
+unsigned long timerMsToTicks(unsigned long ms) {
+	unsigned long ticksPerSecond = TIMER_TICKS_PER_SECOND;
+	return (ms / 1000) * ticksPerSecond + ((ms % 1000) * ticksPerSecond) / 1000;
+}
+
+// Wait until the tick count reaches the given value
+void timerWaitUntil(unsigned long ticks) {
+	// Compare the difference so it works across roll over
+	while ((long)(ticks - timerGetTicks()) > 0) {
+	}
+}
+
+// The number of seconds Timer1 has counted
+volatile unsigned long timerSecondCount = 0;
+
+// The interrupt service routine for Timer1, once a second
+void _ISR _T1Interrupt(void) {
+	// Clear the interrupt flag
+	_T1IF = 0;
+
+	// Count the second
+	timerSecondCount++;
+}
+
+// Whether Timer1 is at the same place in the second as the RTCC, whether
+// its second count still goes with timerStampEpoch (it does not once
+// the interrupt has been off), the RTCC epoch and Timer1 second count
+// that go together, and the RTCC epoch of the last sync
+unsigned char timerStampSynced = 0;
+unsigned char timerStampCounted = 0;
+unsigned long timerStampEpoch = 0;
+unsigned long timerStampSecond = 0;
+unsigned long timerStampSyncEpoch = 0;
+
+// Turn on the once a second interrupt if it is not already running
+void timerSecondsStart(void) {
+	// If it is already running, just make sure it is counting.  Any
+	// seconds it went round while paused are not counted.
+	if ((PMD1bits.T1MD == 0) && T1CONbits.TON) {
+		if (!_T1IE) {
+			_T1IF = 0;
+			_T1IE = 1;
+		}
+		return;
+	}
+
+	// Power up Timer1 and run it from the secondary oscillator (the
+	// 32.768kHz crystal the RTCC runs from) so it keeps going in Idle
+	// without the instruction clock
+	PMD1bits.T1MD = 0;
+	T1CON = 0;
+	T1CONbits.TCS = 1;
+	TMR1 = 0;
+	PR1 = TIMER_SOSC_HZ - 1;
+
+	// It is not in step with the RTCC until it is synced
+	timerStampSynced = 0;
+	timerStampCounted = 0;
+
+	// Interrupt on each period
+	_T1IP = 4;
+	_T1IF = 0;
+	_T1IE = 1;
+
+	// Start it
+	T1CONbits.TON = 1;
+}
+
+// Turn off the once a second interrupt
+void timerSecondsStop(void) {
+	_T1IE = 0;
+	T1CONbits.TON = 0;
+	PMD1bits.T1MD = 1;
+	timerStampSynced = 0;
+	timerStampCounted = 0;
+}
+
+// Stop counting seconds but leave Timer1 running
+void timerSecondsPause(void) {
+	_T1IE = 0;
+	timerStampCounted = 0;
+}
+
+// Return the number of seconds counted so far
+unsigned int timerSecondsGet(void) {
+	return (unsigned int)timerSecondCount;
+}
+
+// Put Timer1 in step with the RTCC
+void timerStampSync(void) {
+	timerSecondsStart();
+
+	// Wait for the half second bit to change.  It goes to 0 as the
+	// seconds tick over and to 1 half way through the second.
+	unsigned char half = RCFGCALbits.HALFSEC;
+	while (RCFGCALbits.HALFSEC == half) {
+	}
+
+	// Put Timer1 at the same place in the second, and note the second
+	// count it is at with the interrupt kept out
+	_T1IE = 0;
+	TMR1 = half ? 0 : TIMER_SOSC_HZ / 2;
+	_T1IF = 0;
+	timerStampSecond = timerSecondCount;
+	_T1IE = 1;
+
+	// The RTCC second this is in (it will not tick for another half
+	// second)
+	timerStampEpoch = RTCCGetEpoch();
+	timerStampSyncEpoch = timerStampEpoch;
+	timerStampSynced = 1;
+	timerStampCounted = 1;
+}
+
+// Match the Timer1 second count up with the RTCC again, with Timer1
+// still at the right place in the second.  The RTCC is read away from
+// the ends of the Timer1 second so the two can not be either side of a
+// tick, which waits up to TIMER_STAMP_COUNT_MARGIN.
+static void timerStampCount(void) {
+	while (1) {
+		_T1IE = 0;
+		unsigned int before = TMR1;
+		unsigned long epoch = RTCCGetEpoch();
+		unsigned int after = TMR1;
+		if ((before >= TIMER_STAMP_COUNT_MARGIN) && (after >= before) &&
+			(after < TIMER_SOSC_HZ - TIMER_STAMP_COUNT_MARGIN)) {
+			// A roll over the interrupt has not counted yet came before
+			timerStampSecond = timerSecondCount + (_T1IF ? 1 : 0);
+			timerStampEpoch = epoch;
+			timerStampCounted = 1;
+			_T1IE = 1;
+			return;
+		}
+		_T1IE = 1;
+	}
+}
+
+// Take the time to the millisecond
+void timerStampTake(TIMER_STAMP *stamp) {
+	timerSecondsStart();
+	if (!timerStampSynced)
+		timerStampSync();
+	else if (!timerStampCounted)
+		timerStampCount();
+
+	// Read the part second and the seconds together.  If Timer1 rolled
+	// over and the interrupt has not counted it yet, count it here.
+	_T1IE = 0;
+	unsigned int ticks = TMR1;
+	unsigned long second = timerSecondCount;
+	if (_T1IF && (ticks < TIMER_SOSC_HZ / 2))
+		second++;
+	_T1IE = 1;
+
+	stamp->epoch = timerStampEpoch + (second - timerStampSecond);
+	stamp->ms = ((unsigned long)ticks * 1000) / TIMER_SOSC_HZ;
+}
+
+// Put Timer1 back in step if the RTCC calibration may have moved them
+// apart since the last sync
+void timerStampRefresh(void) {
+	if (!timerStampSynced)
+		return;
+	signed char calibration = RTCCGetCalibration();
+	if (calibration == 0)
+		return;
+	unsigned int calibrationSteps = (calibration < 0) ? -calibration : calibration;
+	if (RTCCGetEpoch() - timerStampSyncEpoch >= TIMER_STAMP_CAL_STEP_SECONDS / calibrationSteps)
+		timerStampSync();
+}
+
+// Drop the sync so the next stamp puts Timer1 back in step
+void timerStampInvalidate(void) {
+	timerStampSynced = 0;
+	timerStampCounted = 0;
+}
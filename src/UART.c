@@ -6,9 +6,15 @@
 // Include library for processor
 #include <p24fj256gb110.h>
 
+// Include the once a second timer for the receive timeout
+#include "Timer.h"
+
 // Include the header for this file
 #include "UART.h"
 
+// Include the string library
+#include <string.h>
+
 // Alias for the RTS Pin on UART1
 #define TRTS_U1			TRISDbits.TRISD15
 
@@ -42,6 +48,76 @@
 // Define the bits to enable a UART for transmission and clear all flags
 #define U_TX			0x0400
 
+// The size of the ring buffer that the UART1 transmit interrupt drains.  It
+// is sized to hold one full SD sector so a bulk transfer can queue a whole
+// sector and go read the next one while this one is still going out the port
+#define U1_TX_BUFFER_SIZE	512
+
+// The ring buffer of characters waiting to be sent out UART1 and the indexes
+// of the next free slot (head) and next character to send (tail)
+volatile unsigned char u1TxBuffer[U1_TX_BUFFER_SIZE];
+volatile unsigned int u1TxHead = 0;
+volatile unsigned int u1TxTail = 0;
+
+// The size of the ring buffer that the UART1 receive interrupt fills.  It
+// only has to hold what can be typed (or pasted) before the main loop
+// gets to it
+#define U1_RX_BUFFER_SIZE	128
+
+// The number of seconds getU1 waits for a character before giving up
+#define U1_RX_TIMEOUT_SECONDS	90
+
+// The ring buffer of characters that have arrived on UART1 and the indexes
+// of the next free slot (head) and the next character to read (tail)
+volatile unsigned char u1RxBuffer[U1_RX_BUFFER_SIZE];
+volatile unsigned int u1RxHead = 0;
+volatile unsigned int u1RxTail = 0;
+
+// The interrupt service routine for the UART1 transmitter.  It moves as many
+// characters as will fit from the ring buffer into the hardware TX FIFO and
+// turns itself off once the ring buffer is empty
+void _ISR _U1TXInterrupt(void) {
+	// Clear the interrupt flag
+	_U1TXIF = 0;
+
+	// Fill the hardware FIFO from the ring buffer
+	while (!U1STAbits.UTXBF && (u1TxTail != u1TxHead)) {
+		U1TXREG = u1TxBuffer[u1TxTail];
+		u1TxTail++;
+		if (u1TxTail == U1_TX_BUFFER_SIZE)
+			u1TxTail = 0;
+	}
+
+	// If there is nothing left to send, stop interrupting
+	if (u1TxTail == u1TxHead)
+		_U1TXIE = 0;
+}
+
+// The interrupt service routine for the UART1 receiver.  It moves every
+// character the hardware has into the ring buffer.  If the ring buffer is
+// full the character is dropped.
+void _ISR _U1RXInterrupt(void) {
+	// Clear the interrupt flag
+	_U1RXIF = 0;
+
+	// Empty the hardware FIFO into the ring buffer
+	while (U1STAbits.URXDA) {
+		unsigned char c = U1RXREG;
+		unsigned int nextHead = u1RxHead + 1;
+		if (nextHead == U1_RX_BUFFER_SIZE)
+			nextHead = 0;
+		if (nextHead != u1RxTail) {
+			u1RxBuffer[u1RxHead] = c;
+			u1RxHead = nextHead;
+		}
+	}
+
+	// If the receive FIFO overflowed, the UART stops receiving
+	// until the overrun flag is cleared
+	if (U1STAbits.OERR)
+		U1STAbits.OERR = 0;
+}
+
 // The function that initializes UART1 (115200@32MHz, 8, N, 1, CTS/RTS )
 void initU1( void)
 {
@@ -52,7 +128,9 @@ void initU1( void)
 	TRTS_U1 = 0;
 } // initU1
 
-// send a character to serial port 1 through UART1
+// send a character to serial port 1 through UART1.  The character is
+// queued for the transmit interrupt, so this only waits if the transmit
+// ring buffer is full.
 int putU1( int c)
 {
 	// We had an issue when the PIC was running on batteries, that
@@ -61,111 +139,219 @@ int putU1( int c)
 	// like a UART interrupt was thrown.  With the serial line
 	// disconnected, the TX buffer would never clear and the PIC
 	// would just hang indefinitely while we were waiting for the
-	// TX buffer to clear.  So in order to clear up this situation,
-	// we will loop while the TX buffer is full and look keep a 
-	// count to see if we are in this condition
+	// TX buffer to clear.  writeU1 gives up after a while in that
+	// case, so pass that on as the cancel character.
+	unsigned char ch = c;
+	if (writeU1(&ch, 1) == 0)
+		return 0x18;
+
+	// Return the same character
+	return c;
+} // putU1
+
+// queue a block of characters to be sent out UART1 by the transmit
+// interrupt.  This only waits when the ring buffer is full, so the caller
+// can go do other work (like read the next sector) while the characters
+// go out.  Returns the number of characters queued, which is less than
+// length only if the transmitter stalled (serial line disconnected)
+unsigned int writeU1( const unsigned char *data, unsigned int length)
+{
+	unsigned int queued = 0;
+	unsigned int nextHead;
+
+	while (queued < length) {
+		// Figure out where the head would move to
+		nextHead = u1TxHead + 1;
+		if (nextHead == U1_TX_BUFFER_SIZE)
+			nextHead = 0;
+
+		// If the ring buffer is full, wait for the interrupt to make room.
+		// Use the same timeout as putU1 in case the line is disconnected
+		if (nextHead == u1TxTail) {
+			unsigned long timeoutCounter = 0;
+			_U1TXIE = 1;
+			while (nextHead == u1TxTail) {
+				timeoutCounter++;
+				if (timeoutCounter > 3333333)
+					return queued;
+			}
+		}
+
+		// Add the character and move the head
+		u1TxBuffer[u1TxHead] = data[queued];
+		u1TxHead = nextHead;
+		queued++;
+	}
+
+	// Make sure the interrupt is running to drain the buffer
+	_U1TXIE = 1;
+
+	// Return how many were queued
+	return queued;
+} // writeU1
+
+// wait until everything queued by writeU1 has been handed to the
+// UART1 hardware.  Returns 0x18 if the transmitter stalled.
+int flushU1( void)
+{
 	unsigned long timeoutCounter = 0;
-	unsigned long maxWaitCounts = 3333333;
-	while (U1STAbits.UTXBF) {
+	while (u1TxTail != u1TxHead) {
 		timeoutCounter++;
-		if (timeoutCounter > maxWaitCounts)
+		if (timeoutCounter > 3333333)
 			return 0x18;
-	};
+	}
+	return 0;
+} // flushU1
 
-	// Set character and send
-	U1TXREG = c;
-	// Return the same character
+// return how many more characters writeU1 can queue without
+// having to wait
+unsigned int spaceU1( void)
+{
+	unsigned int head = u1TxHead;
+	unsigned int tail = u1TxTail;
+	if (head >= tail)
+		return (U1_TX_BUFFER_SIZE - 1) - (head - tail);
+	return (tail - head) - 1;
+} // spaceU1
+
+// A method that returns a zero if nothing has arrived
+// on UART1 and a 1 if something has arrived.
+int charArrivedAtUART1(void) {
+	if (u1RxHead != u1RxTail) {
+		return 1;
+	} else {
+		return 0;
+	}
+}
+
+// take the next character that has arrived on UART1, or return -1
+// if there is not one.  This never waits.
+int readU1( void)
+{
+	if (u1RxHead == u1RxTail)
+		return -1;
+	unsigned char c = u1RxBuffer[u1RxTail];
+	unsigned int nextTail = u1RxTail + 1;
+	if (nextTail == U1_RX_BUFFER_SIZE)
+		nextTail = 0;
+	u1RxTail = nextTail;
 	return c;
-} // putU1
+} // readU1
 
 // wait for a new character to arrive to the serial port
 // attached to UART1
 char getU1( void)
 {
-	// Wait for a new character to arrive or until a certain number
-	// or cycles have passed
-	unsigned long uart1TimeoutCounter = 0;
-//	unsigned long maxCount = 600000000;
-	unsigned long maxCount = 60000000; // This is about 90 seconds
-	while ( (!U1STAbits.URXDA) && (uart1TimeoutCounter < maxCount)) {
-		uart1TimeoutCounter++;
+	// Idle until a character arrives or the timeout runs out.  The
+	// receive interrupt wakes the PIC up for a character and the once a
+	// second timer wakes it up to check the timeout.
+	timerSecondsStart();
+	unsigned int startSecond = timerSecondsGet();
+	int c;
+	while ((c = readU1()) < 0) {
+		if ((unsigned int)(timerSecondsGet() - startSecond) >= U1_RX_TIMEOUT_SECONDS)
+			return 0x18;
+		Idle();
 	}
-	if (uart1TimeoutCounter >= maxCount)
-		return 0x18;
-	// Read the character from the receive buffer
-	return U1RXREG;
+	return c;
 }// getU1
 
 // send a null terminated string to the serial port
 // attached to UART1
 void putsU1( char *s)
 {
-	// Loop until *s == '\0' which is the end of the string, send the
-	// character and point to the next one.
-	int putReturn = 0;
-	while( *s && (putReturn != 0x18)) {
-		putReturn = putU1( *s++);
-	}
+	// Queue the whole string for the transmit interrupt
+	writeU1((unsigned char *)s, strlen(s));
 } // putsU1
 
-// receive a null terminated string in a buffer of len char
-// from the serial port attached to UART1
-char *getsU1( char *s, int len)
+// start editing a new line in the buffer given
+void lineEditorStart( LINE_EDITOR *editor, char *buffer, int size)
+{
+	editor->buffer = buffer;
+	editor->size = size;
+	editor->length = 0;
+	buffer[0] = '\0';
+} // lineEditorStart
+
+// take whatever characters have arrived on UART1 into the line being
+// edited.  This never waits.
+int lineEditorPoll( LINE_EDITOR *editor)
 {
-	// Copy the buffer pointer
-    char *p = s;
- 
-    do{
-		// Wait for a new character
-        *s = getU1();
-		// Echo the character
-		if (*s != 0x18)
-	        putU1( *s);
-        
+	int c;
+	while ((c = readU1()) >= 0) {
 		// Check for condition of backspace
-        if (( *s==BACKSPACE)&&( s>p))
-        {
-			// Overwrite last character
-            putU1( ' ');
-
-			// Move the cursor
-            putU1( BACKSPACE);
-
-			// Add one to the length left to read
-            len++;
-
-			// Back the pointer down
-            s--;
-            continue;
-        }
+		if (c == BACKSPACE) {
+			if (editor->length > 0) {
+				// Overwrite the last character on the screen and back up
+				putsU1("\b \b");
+				editor->length--;
+				editor->buffer[editor->length] = '\0';
+			}
+			continue;
+		}
 
 		// Check to see if it is a line feed and if so, ignore it
-        if ( *s=='\n')
-            continue;
-		// Check for end of line, if so, end loop
-        if ( *s=='\r')
-            break;   
-		
-		// Check for the cancel character
-		if (*s==0x18) {
-			// Increment the buffer pointer but break
-			s++;
-			break;
-		} 
-
-		// Increment the buffer pointer      
-        s++;
+		if (c == '\n')
+			continue;
+
+		// A host frame is starting, let the caller read it
+		if (c == LINE_EDITOR_ESCAPE_CHAR)
+			return LINE_EDITOR_ESCAPE;
+
+		// Check for end of line, if so, the line is done
+		if (c == '\r') {
+			putU1(c);
+			return LINE_EDITOR_DONE;
+		}
+
+		// Echo and keep the character if there is room for it
+		if (editor->length < editor->size - 1) {
+			putU1(c);
+			editor->buffer[editor->length++] = c;
+			editor->buffer[editor->length] = '\0';
+		}
+
+		// A full buffer ends the line
+		if (editor->length >= editor->size - 1)
+			return LINE_EDITOR_DONE;
+	}
+	return LINE_EDITOR_BUSY;
+} // lineEditorPoll
 
-		// Decrement the size left to read
-        len--;
+// receive a null terminated string in a buffer of len char
+// from the serial port attached to UART1
+char *getsU1( char *s, int len)
+{
+	LINE_EDITOR editor;
+	lineEditorStart(&editor, s, len);
+
+	// Idle between characters until the line is done.  If nothing is
+	// typed for too long, end the line with the cancel character.
+	timerSecondsStart();
+	unsigned int lastSecond = timerSecondsGet();
+	unsigned int lastLength = 0;
+	int state;
+	while ((state = lineEditorPoll(&editor)) != LINE_EDITOR_DONE) {
+		// Host frames are only answered at the TLR> prompt, in the middle
+		// of a question the escape byte is just dropped
+		if (state == LINE_EDITOR_ESCAPE)
+			continue;
+		if (editor.length != lastLength) {
+			lastLength = editor.length;
+			lastSecond = timerSecondsGet();
+		}
+		if ((unsigned int)(timerSecondsGet() - lastSecond) >= U1_RX_TIMEOUT_SECONDS) {
+			if (editor.length < len - 1) {
+				s[editor.length++] = 0x18;
+				s[editor.length] = '\0';
+			}
+			break;
+		}
+		Idle();
+	}
 
-    } while ( len>1 );      // until buffer full
- 
-	// Null terminate the string
-    *s = '\0';              // null terminate the string 
-    
 	// Return the buffer pointer
-    return p;
+	return s;
 
 } // getsU1
 
@@ -0,0 +1,76 @@
+/*******************************************************
+ * Watch.c
+ * A low energy watch mode that polls the flow and fault
+ * status and decides when to log a full record
+ *******************************************************/
+
+// Include the library for modbus functionality to flow meter
+#include "modbus.h"
+
+// Include the header for this file
+#include "Watch.h"
+
+// The current watch settings (off until set from the terminal)
+WATCH_SETTINGS watchSettings = {0, 0x3, 1000.0, -1000.0, 0.1, 0.0, 10};
+
+// Whether each threshold is armed (it disarms when it fires and rearms
+// once the flow is back past the deadband)
+unsigned char watchHighArmed = 1;
+unsigned char watchLowArmed = 1;
+
+// The fault status from the last poll and whether there has been one
+unsigned int watchLastFault = 0;
+unsigned char watchHaveFault = 0;
+
+// The flow that went into the last full record
+float watchLoggedFlow = 0;
+
+// This function reads the flow and fault status and checks for events
+unsigned char watchPoll(void) {
+	PROCESS_SNAPSHOT snapshot;
+	unsigned char events = WATCH_EVENT_NONE;
+
+	// One short transaction gets both registers
+	if (!readProcessSnapshot(&snapshot))
+		return WATCH_EVENT_NONE;
+	float flow = snapshot.flowRate;
+
+	// Flow over the high threshold
+	if (watchHighArmed && (flow > watchSettings.flowHigh)) {
+		events |= WATCH_EVENT_FLOW_HIGH;
+		watchHighArmed = 0;
+	} else if (flow < watchSettings.flowHigh - watchSettings.deadband) {
+		watchHighArmed = 1;
+	}
+
+	// Flow under the low threshold
+	if (watchLowArmed && (flow < watchSettings.flowLow)) {
+		events |= WATCH_EVENT_FLOW_LOW;
+		watchLowArmed = 0;
+	} else if (flow > watchSettings.flowLow + watchSettings.deadband) {
+		watchLowArmed = 1;
+	}
+
+	// Flow moved a long way from the last record
+	if (watchSettings.changeDeadband > 0) {
+		float change = flow - watchLoggedFlow;
+		if (change < 0)
+			change = -change;
+		if (change > watchSettings.changeDeadband)
+			events |= WATCH_EVENT_FLOW_CHANGE;
+	}
+
+	// Any fault bit flipped
+	if (watchHaveFault && (snapshot.faultStatus != watchLastFault))
+		events |= WATCH_EVENT_FAULT;
+	watchLastFault = snapshot.faultStatus;
+	watchHaveFault = 1;
+
+	// Return what fired
+	return events;
+}
+
+// This function remembers the flow that went into the last full record
+void watchRecordLogged(float flowRate) {
+	watchLoggedFlow = flowRate;
+}
@@ -11,6 +11,9 @@
 unsigned char buffer[MODBUS_SIZE];	
 char messageBuffer[255];
 
+// The modbus address of the flow meter
+unsigned char modbusSlaveAddress = MODBUS_DEFAULT_SLAVE_ADDRESS;
+
 // Function to write the CRC16 check to the data buffer
 int CRC16(unsigned int dataLength, char check)
 {
@@ -72,13 +75,199 @@ void sendModbusCommand(unsigned char command,
 	}
 }
 
+// function to send a modbus command from buffer when the length of the
+// response is known.  Instead of always reading a full MODBUS_SIZE
+// buffer (and waiting out a timeout on every byte past the end of the
+// reply), this stops as soon as the expected number of bytes (or a 5
+// byte exception reply) has arrived.  It returns 1 if a reply of the
+// expected length with a good CRC came back, 0 otherwise.
+int sendModbusCommandExpecting(unsigned int commandLength,
+	unsigned int responseLength){
+
+	// Send the command over UART 2
+	int i = 0;
+	for (i=0; i < commandLength; i++) {
+		putU2(buffer[i]);
+	}
+
+	// Now wait until something arrives or until we time out 
+	// waiting for a response
+	unsigned long timeoutCounter = 0;
+	while (!charArrivedAtUART2() && (timeoutCounter < 20000)) {
+		timeoutCounter++;
+	}
+
+	// Now read back only as much as the reply should be
+	unsigned int j;
+	for (j = 0; (j < responseLength) && (j < MODBUS_SIZE); j++) {
+		buffer[j] = getU2();
+		// An exception reply (function code with the top bit set) is
+		// only 5 bytes long
+		if ((j == 1) && (buffer[1] & 0x80))
+			responseLength = 5;
+	}
+
+	// Check that it is the reply we wanted
+	if ((j != responseLength) || (buffer[1] & 0x80))
+		return 0;
+	return CRC16(responseLength - 2, 1);
+}
+
+// This function returns the float that starts at the given spot in the
+// buffer (the meter sends them MSB first)
+float modbusFloatAt(unsigned int index) {
+	unsigned char floatChars[4] = {buffer[index+3],buffer[index+2],buffer[index+1],buffer[index]};
+	float * floatPtr = (float *)&floatChars[0];
+	return *floatPtr;
+}
+
+// This function returns the 32 bit integer that starts at the given spot
+// in the buffer (MSB first)
+long modbusLongAt(unsigned int index) {
+	return (((unsigned long)buffer[index]) << 24) | (((unsigned long)buffer[index+1]) << 16) |
+		(((unsigned long)buffer[index+2]) << 8) | buffer[index+3];
+}
+
+// This function returns the 16 bit integer that starts at the given spot
+// in the buffer (MSB first)
+unsigned int modbusWordAt(unsigned int index) {
+	return (((unsigned int)buffer[index]) << 8) | buffer[index+1];
+}
+
+// The function to read the process values (registers 3000 to 3020) in
+// a single transaction.  This is the fast way to get the flow along with
+// the velocity, fault status and totalizer.  Returns 1 if the snapshot
+// was read OK.
+int readProcessSnapshot(PROCESS_SNAPSHOT *snapshot) {
+	// Read the 21 registers from the actual velocity (3000) on
+	if (!readHoldingRegisters(3000, 21))
+		return 0;
+
+	// Register N is at buffer spot 3 + 2 x (N - 3000)
+	snapshot->velocity = modbusFloatAt(3);
+	snapshot->flowRate = modbusFloatAt(7);
+	snapshot->insulationValue = modbusFloatAt(11);
+	snapshot->flowratePercent = modbusFloatAt(27);
+	snapshot->faultStatus = modbusWordAt(35);
+	snapshot->totalizer1Integer = modbusLongAt(37);
+	snapshot->totalizer1Fraction = modbusFloatAt(41);
+	return 1;
+}
+
+// The function to read a run of holding registers in one transaction.
+// Returns 1 if they were read OK.
+int readHoldingRegisters(unsigned int firstRegister, unsigned int count) {
+	// More than the Modbus limit will not fit in one reply
+	if ((count == 0) || (count > MODBUS_MAX_REGISTERS))
+		return 0;
+
+	// First construct the request
+	// Slave ID
+	buffer[0] = modbusSlaveAddress;
+	// The function code to read a holding register 
+	// (function code = 3)
+	buffer[1] = 0x03;
+	// The first register
+	buffer[2] = firstRegister >> 8;
+	buffer[3] = firstRegister;
+	// The number of registers (2 bytes each)
+	buffer[4] = count >> 8;
+	buffer[5] = count;
+	// Now tack on the CRC
+	CRC16(6,0);
+	// Now send it and wait for the 3 byte header, the registers and CRC
+	return sendModbusCommandExpecting(8, 3 + 2 * count + 2);
+}
+
+// This function copies the bytes of a meter date (3 registers) that
+// starts at the given spot in the buffer
+static void modbusDateAt(unsigned int index, unsigned char *date) {
+	memcpy(date, &buffer[index], 6);
+}
+
+// This function copies a units string (6 registers) that starts at the
+// given spot in the buffer and terminates it
+static void modbusUnitsAt(unsigned int index, unsigned char *units) {
+	memcpy(units, &buffer[index], 12);
+	units[12] = '\0';
+}
+
+// The function to read everything the dashboard shows.  The registers are
+// read in six runs that each cover a group of values that sit close
+// together in the register map, rather than one transaction per value.
+unsigned char readMeterDashboard(METER_DASHBOARD *dashboard) {
+	unsigned char blocks = 0;
+	memset(dashboard, 0, sizeof(METER_DASHBOARD));
+
+	// The process values, 3000 to 3020
+	if (readProcessSnapshot(&dashboard->process)) {
+		dashboard->blocksRead |= DASHBOARD_PROCESS;
+		blocks++;
+	}
+
+	// Battery, power status, meter clock and temperature, 3030 to 3043
+	// (register N is at 3 + 2 x (N - 3030))
+	if (readHoldingRegisters(3030, 14)) {
+		dashboard->batteryCapacity = buffer[4];
+		dashboard->powerStatus = buffer[6];
+		modbusDateAt(9, dashboard->meterDate);
+		dashboard->transmitterTemp = modbusFloatAt(27);
+		dashboard->blocksRead |= DASHBOARD_STATUS;
+		blocks++;
+	}
+
+	// Operating hours, 80 to 81
+	if (readHoldingRegisters(80, 2)) {
+		dashboard->operatingHours = modbusLongAt(3);
+		dashboard->blocksRead |= DASHBOARD_HOURS;
+		blocks++;
+	}
+
+	// Units, Qn, calibration and cutoff, 210 to 240
+	// (register N is at 3 + 2 x (N - 210))
+	if (readHoldingRegisters(210, 31)) {
+		modbusUnitsAt(3, dashboard->flowUnits);
+		modbusUnitsAt(15, dashboard->totalUnits);
+		dashboard->qn = modbusFloatAt(35);
+		dashboard->calibrationFactor = modbusFloatAt(39);
+		modbusDateAt(43, dashboard->calibrationDate);
+		dashboard->lowFlowCutoff = modbusFloatAt(61);
+		dashboard->blocksRead |= DASHBOARD_SETUP;
+		blocks++;
+	}
+
+	// Power ups, the highs and lows and the last log date, 366 to 478
+	// (register N is at 3 + 2 x (N - 366))
+	if (readHoldingRegisters(366, 113)) {
+		dashboard->powerUps = modbusWordAt(3);
+		dashboard->highestFlow = modbusFloatAt(85);
+		modbusDateAt(89, dashboard->highestFlowDate);
+		dashboard->lowestFlow = modbusFloatAt(95);
+		modbusDateAt(99, dashboard->lowestFlowDate);
+		dashboard->highestDayConsumption = modbusFloatAt(105);
+		modbusDateAt(109, dashboard->highestDayConsumptionDate);
+		modbusDateAt(223, dashboard->lastLogDate);
+		dashboard->blocksRead |= DASHBOARD_HISTORY;
+		blocks++;
+	}
+
+	// Comm module type, 822
+	if (readHoldingRegisters(822, 1)) {
+		dashboard->commModuleType = buffer[4];
+		dashboard->blocksRead |= DASHBOARD_MODULE;
+		blocks++;
+	}
+
+	return blocks;
+}
+
 void sendUnlockPassword(void) {
 	// The password to send
 	unsigned char password[] = "1000";
 
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to write to a register 
 	// (function code = 10)
 	buffer[1] = 0x10;
@@ -108,7 +297,7 @@ void sendUnlockPassword(void) {
 float readActualVelocity(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -139,7 +328,7 @@ float readActualVelocity(void) {
 float readFlowRate(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -170,7 +359,7 @@ float readFlowRate(void) {
 float readInsulationValue(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -201,7 +390,7 @@ float readInsulationValue(void) {
 float readFlowratePercentValue(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -232,7 +421,7 @@ float readFlowratePercentValue(void) {
 void readTotalizer1(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -270,7 +459,7 @@ long readTotalizer1Integer(void) {
 void readTotalizer2(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -308,7 +497,7 @@ long readTotalizer2Integer(void) {
 void readTotalFlowUnits(unsigned char writeBuffer[]) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -343,7 +532,7 @@ void readTotalFlowUnits(unsigned char writeBuffer[]) {
 float readQn(void){
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -376,7 +565,7 @@ float readQn(void){
 void readActualDateAndTime(unsigned char dateAndTimeBuffer[]) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -405,13 +594,22 @@ void readActualDateAndTime(unsigned char dateAndTimeBuffer[]) {
 //	putsU1(messageBuffer);
 }
 
+// The function to read the date and time of the flow meter, returns 1
+// if it was read OK
+int readMeterClock(unsigned char date[]) {
+	if (!readHoldingRegisters(3033, 3))
+		return 0;
+	modbusDateAt(3, date);
+	return 1;
+}
+
 void setActualDateAndTime(unsigned char dateAndTimeBuffer[]) {
 	// First send the password
 	sendUnlockPassword();
 
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to write multiple registers 
 	// (function code = 0x10)
 	buffer[1] = 0x10;
@@ -443,7 +641,7 @@ void setActualDateAndTime(unsigned char dateAndTimeBuffer[]) {
 void readCalDateAndTime(unsigned char dateAndTimeBuffer[]) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -476,7 +674,7 @@ void readCalDateAndTime(unsigned char dateAndTimeBuffer[]) {
 float readCalibrationFactor(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -508,7 +706,7 @@ float readCalibrationFactor(void) {
 unsigned long readOperatingHoursSincePowerUp(void){
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -539,7 +737,7 @@ unsigned long readOperatingHoursSincePowerUp(void){
 unsigned int readNumberOfPowerUps(void){
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -565,7 +763,7 @@ unsigned int readNumberOfPowerUps(void){
 float readHighestFlowRate(void){
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -596,7 +794,7 @@ float readHighestFlowRate(void){
 void readHighestFlowDateAndTime(unsigned char dateAndTimeBuffer[]) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -629,7 +827,7 @@ void readHighestFlowDateAndTime(unsigned char dateAndTimeBuffer[]) {
 float readLowestFlowRate(void){
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -660,7 +858,7 @@ float readLowestFlowRate(void){
 void readLowestFlowDateAndTime(unsigned char dateAndTimeBuffer[]) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -693,7 +891,7 @@ void readLowestFlowDateAndTime(unsigned char dateAndTimeBuffer[]) {
 float readHighestDayConsumption(void){
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -724,7 +922,7 @@ float readHighestDayConsumption(void){
 void readHighestDayConsumptionDateAndTime(unsigned char dateAndTimeBuffer[]) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -758,7 +956,7 @@ void readHighestDayConsumptionDateAndTime(unsigned char dateAndTimeBuffer[]) {
 float readLowFlowCutoff(void){
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -789,7 +987,7 @@ float readLowFlowCutoff(void){
 void readFlowRateUnits(unsigned char writeBuffer[]) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -824,7 +1022,7 @@ void readFlowRateUnits(unsigned char writeBuffer[]) {
 float readTransmitterTemp(void){
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -855,7 +1053,7 @@ float readTransmitterTemp(void){
 unsigned char readBatteryCapacity(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -881,7 +1079,7 @@ unsigned char readBatteryCapacity(void) {
 unsigned char readPowerStatus(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -907,7 +1105,7 @@ unsigned char readPowerStatus(void) {
 unsigned int readFaultStatus(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -932,7 +1130,7 @@ unsigned int readFaultStatus(void) {
 unsigned char readCommModuleType(void){
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -958,7 +1156,7 @@ unsigned char readCommModuleType(void){
 void readLastLogDate(unsigned char dateAndTimeBuffer[]){
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -992,17 +1190,13 @@ void readLastLogDate(unsigned char dateAndTimeBuffer[]){
 // --------------------------------------------------------------------------
 
 // The function to return the fractional portion of the first totalizer
-long readTotalizer1Fraction(void) {
+float readTotalizer1Fraction(void) {
 	// First read totalizer 1 into buffer
 	readTotalizer1();
 
-	// The four bytes at buffer spots 7, 8, 9 and 10 should
-	// be the number which is the fractional part of totalizer 1
-	long totalizer1Fraction = 0;
-	totalizer1Fraction |= (buffer[7] << 24);
-	totalizer1Fraction |= (buffer[8] << 16);
-	totalizer1Fraction |= (buffer[9] << 8);
-	totalizer1Fraction |= buffer[10];
+	// The four bytes at buffer spots 7, 8, 9 and 10 are the float
+	// (0 up to 1) that is the fractional part of totalizer 1
+	float totalizer1Fraction = modbusFloatAt(7);
 //	sprintf(messageBuffer,"Totalizer 1 Fraction = %ld \r", totalizer1Fraction);
 //	putsU1(messageBuffer);
 	return totalizer1Fraction;
@@ -1029,7 +1223,7 @@ long readTotalizer2Fraction(void) {
 unsigned int readProductID(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -1055,7 +1249,7 @@ unsigned int readProductID(void) {
 unsigned int readDeviceAddress(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -1080,7 +1274,7 @@ unsigned int readDeviceAddress(void) {
 unsigned int getNumberOfParityErrors() {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -1106,7 +1300,7 @@ unsigned int getNumberOfParityErrors() {
 unsigned long getBaudRateAsUnsignedLong() {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -1135,7 +1329,7 @@ unsigned long getBaudRateAsUnsignedLong() {
 long getBaudRate(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -1173,7 +1367,7 @@ long getBaudRate(void) {
 void getManufacturerName(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -1197,7 +1391,7 @@ void getManufacturerName(void) {
 float * readSensorTemperature(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -1229,7 +1423,7 @@ float * readSensorTemperature(void) {
 int isRunning(void) {
 	// First construct the request
 	// Slave ID
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 	// The function code to read a holding register 
 	// (function code = 3)
 	buffer[1] = 0x03;
@@ -1268,7 +1462,7 @@ unsigned char * reportSlaveID(void) {
 	// ask for the slave ID
 
 	// Slave address = 1
-	buffer[0] = 0x01;
+	buffer[0] = modbusSlaveAddress;
 
 	// Function ID = 17
 	buffer[1] = 0x11;
@@ -0,0 +1,338 @@
+/*******************************************************
+ * btpty.c
+ * Host test of the logger side of the block download
+ * (src/BlockTransfer.c) against tlrget over a pseudo
+ * terminal.
+ *
+ * Build:  cc -O2 -Itools/host -Iinclude -o btpty tools/btpty.c \
+ *             src/BlockTransfer.c src/Checksum.c src/LogCompress.c
+ *         cc -O2 -Iinclude -o tlrget tools/tlrget.c src/LogCompress.c
+ * Usage:  btpty <tlrget> [log file]
+ *
+ * BlockTransfer.c is built as it is, with tools/host
+ * standing in for FSIO over a stdio file and the UART1
+ * functions here going to the pty.  First it checks that
+ * start, ack and nak frames too short for their payload
+ * are dropped, then it runs tlrget against the pty plain
+ * and compressed, from the start and resumed half way, and
+ * with a byte of the logger's output damaged every so
+ * often, and with the log closed and opened again every
+ * so often as it is for a sample, and checks each copy
+ * comes out the same as the log.  Without a log file it makes one up.
+ *******************************************************/
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "FSIO.h"
+#include "UART.h"
+#include "Checksum.h"
+#include "BlockTransfer.h"
+
+// The parser in BlockTransfer.c
+unsigned char btPollFrame(void);
+
+// The sector buffer LogFile.c shares with the transfer
+unsigned char logChunkBuffer[BT_BLOCK_SIZE];
+
+// The size of the made up log
+#define MADE_UP_SIZE		20000
+
+// The pty master and what has come in on it not yet read, and how many
+// bytes have gone out and how often one is damaged
+static int ptyFd = -1;
+static unsigned char rxRing[4096];
+static unsigned int rxHead;
+static unsigned int rxTail;
+static unsigned long txCount;
+static unsigned long damageEvery;
+
+// FSIO over a stdio file
+FSFILE *FSfopen(const char *fileName, const char *mode) {
+	// The transfer only reads, so the mode is not needed
+	(void)mode;
+	static FSFILE stream;
+	stream.file = fopen(fileName, "rb");
+	if (stream.file == NULL)
+		return NULL;
+	fseek(stream.file, 0, SEEK_END);
+	stream.size = ftell(stream.file);
+	fseek(stream.file, 0, SEEK_SET);
+	return &stream;
+}
+
+int FSfclose(FSFILE *stream) {
+	return fclose(stream->file);
+}
+
+size_t FSfread(void *ptr, size_t size, size_t n, FSFILE *stream) {
+	return fread(ptr, size, n, stream->file);
+}
+
+int FSfseek(FSFILE *stream, long offset, int whence) {
+	return fseek(stream->file, offset, whence);
+}
+
+// Every so often a sample comes due and the file is closed and opened
+// again at the offset, as logFileYield does on the logger
+static unsigned long yieldEvery;
+static unsigned long yieldCount;
+FSFILE *logFileYield(FSFILE *file, char *fileName, unsigned long offset) {
+	if ((yieldEvery == 0) || (++yieldCount % yieldEvery != 0))
+		return file;
+	FSfclose(file);
+	file = FSfopen(fileName, "r");
+	if ((file != NULL) && (FSfseek(file, offset, SEEK_SET) != 0)) {
+		FSfclose(file);
+		return NULL;
+	}
+	return file;
+}
+
+// Take whatever the pty has into the receive ring
+static void fillRx(void) {
+	struct pollfd pfd = {ptyFd, POLLIN, 0};
+	if ((ptyFd < 0) || (poll(&pfd, 1, 0) <= 0))
+		return;
+	unsigned char in[256];
+	ssize_t n = read(ptyFd, in, sizeof(in));
+	ssize_t i;
+	for (i = 0; i < n; i++) {
+		rxRing[rxHead] = in[i];
+		rxHead = (rxHead + 1) % sizeof(rxRing);
+	}
+}
+
+// The UART1 functions BlockTransfer.c uses
+int charArrivedAtUART1(void) {
+	fillRx();
+	return rxHead != rxTail;
+}
+
+int readU1(void) {
+	fillRx();
+	if (rxHead == rxTail)
+		return -1;
+	int c = rxRing[rxTail];
+	rxTail = (rxTail + 1) % sizeof(rxRing);
+	return c;
+}
+
+unsigned int spaceU1(void) {
+	return 64;
+}
+
+unsigned int writeU1(const unsigned char *data, unsigned int length) {
+	unsigned char out[64];
+	unsigned int done = 0;
+	while (done < length) {
+		unsigned int n = length - done < sizeof(out) ? length - done : sizeof(out);
+		memcpy(out, &data[done], n);
+		unsigned int i;
+		for (i = 0; i < n; i++) {
+			txCount++;
+			if ((damageEvery > 0) && (txCount % damageEvery == 0))
+				out[i] ^= 0x55;
+		}
+		if (write(ptyFd, out, n) != (ssize_t)n)
+			return done;
+		done += n;
+	}
+	return length;
+}
+
+int flushU1(void) {
+	return 0;
+}
+
+// Put a host frame straight into the receive ring
+static void queueFrame(unsigned char type, const unsigned char *payload, unsigned int length) {
+	unsigned char frame[16];
+	frame[0] = BT_SOH;
+	frame[1] = type;
+	frame[2] = length >> 8;
+	frame[3] = length;
+	memcpy(&frame[4], payload, length);
+	unsigned int crc = crc16Ccitt(CRC16_CCITT_INIT, &frame[1], 3 + length);
+	frame[4 + length] = crc >> 8;
+	frame[5 + length] = crc;
+	unsigned int i;
+	for (i = 0; i < 6 + length; i++) {
+		rxRing[rxHead] = frame[i];
+		rxHead = (rxHead + 1) % sizeof(rxRing);
+	}
+}
+
+// Frames too short for their type have to be dropped, the full ones kept
+static int checkShortFrames(void) {
+	const unsigned char payload[6] = {0, 0, 0x10, 0, 4, BT_START_COMPRESS};
+	struct {
+		unsigned char type;
+		unsigned int length;
+		unsigned char expect;
+	} cases[] = {
+		{BT_FRAME_START, 4, 0}, {BT_FRAME_START, 0, 0}, {BT_FRAME_ACK, 3, 0},
+		{BT_FRAME_NAK, 2, 0}, {BT_FRAME_START, 5, BT_FRAME_START},
+		{BT_FRAME_START, 6, BT_FRAME_START}, {BT_FRAME_ACK, 4, BT_FRAME_ACK},
+		{BT_FRAME_NAK, 4, BT_FRAME_NAK}, {BT_FRAME_QUIT, 0, BT_FRAME_QUIT},
+	};
+	int result = 0;
+	unsigned int i;
+	ptyFd = -1;
+	rxHead = rxTail = 0;
+	for (i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+		queueFrame(cases[i].type, payload, cases[i].length);
+		unsigned char got = btPollFrame();
+		if (got != cases[i].expect) {
+			fprintf(stderr, "'%c' frame of %u bytes gave %d, not %d\n", cases[i].type,
+				cases[i].length, got, cases[i].expect);
+			result = 1;
+		}
+	}
+	printf("%-24s %s\n", "short frames", result ? "FAILED" : "dropped");
+	return result;
+}
+
+// Download the log with tlrget over a fresh pty, starting with the first
+// resume bytes already there.  Returns 0 if the copy is the same.
+static int runDownload(const char *what, const char *tlrget, const char *logName,
+	const unsigned char *log, unsigned long size, int compress, unsigned long resume,
+	unsigned long damage, unsigned long reopen) {
+	char outName[64];
+	snprintf(outName, sizeof(outName), "/tmp/btpty-%d.out", (int)getpid());
+	FILE *out = fopen(outName, "wb");
+	if ((out == NULL) || (fwrite(log, 1, resume, out) != resume)) {
+		perror(outName);
+		return 1;
+	}
+	fclose(out);
+
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0)) {
+		perror("pty");
+		return 1;
+	}
+	struct termios tio;
+	tcgetattr(master, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(master, TCSANOW, &tio);
+	char slaveName[64];
+	snprintf(slaveName, sizeof(slaveName), "%s", ptsname(master));
+
+	pid_t child = fork();
+	if (child == 0) {
+		int null = open("/dev/null", O_WRONLY);
+		dup2(null, STDOUT_FILENO);
+		dup2(null, STDERR_FILENO);
+		if (compress)
+			execl(tlrget, tlrget, "-z", slaveName, outName, (char *)NULL);
+		else
+			execl(tlrget, tlrget, slaveName, outName, (char *)NULL);
+		_exit(127);
+	}
+
+	ptyFd = master;
+	rxHead = rxTail = 0;
+	txCount = 0;
+	damageEvery = damage;
+	yieldEvery = reopen;
+	yieldCount = 0;
+	long acked = sendLogFileBlocks((char *)logName);
+	int status = 0;
+	waitpid(child, &status, 0);
+	close(master);
+	ptyFd = -1;
+
+	// The copy has to be the log
+	int result = 1;
+	out = fopen(outName, "rb");
+	if (out != NULL) {
+		unsigned char *copy = malloc(size + 1);
+		size_t got = fread(copy, 1, size + 1, out);
+		result = (got != size) || (memcmp(copy, log, size) != 0);
+		free(copy);
+		fclose(out);
+	}
+	unlink(outName);
+	printf("%-24s acked %6ld, tlrget %s, copy %s\n", what, acked,
+		WIFEXITED(status) && WEXITSTATUS(status) == 0 ? "ok" : "failed",
+		result ? "DIFFERENT" : "the same");
+	return result || !WIFEXITED(status) || (WEXITSTATUS(status) != 0);
+}
+
+// Make up a log of records like the logger writes
+static unsigned long makeLog(const char *fileName) {
+	FILE *out = fopen(fileName, "wb");
+	if (out == NULL)
+		return 0;
+	unsigned long size = 0;
+	unsigned int minutes = 0;
+	srand(1);
+	while (size < MADE_UP_SIZE) {
+		int length = fprintf(out, "10/06/%02u %02u:%02u:00,%.3f,%.3f,%ld,%.1f,98,1,00\n",
+			1 + minutes / 1440, (minutes / 60) % 24, minutes % 60,
+			12.0 + rand() % 1000 / 1000.0, rand() % 100 / 1000.0, 1234567L + minutes,
+			21.0 + rand() % 40 / 10.0);
+		size += length;
+		minutes += 10;
+	}
+	fclose(out);
+	return size;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <tlrget> [log file]\n", argv[0]);
+		return 2;
+	}
+	const char *tlrget = argv[1];
+	char madeUp[64];
+	const char *logName = argv[2];
+	if (argc < 3) {
+		snprintf(madeUp, sizeof(madeUp), "/tmp/btpty-%d.log", (int)getpid());
+		logName = madeUp;
+		if (makeLog(logName) == 0) {
+			perror(logName);
+			return 1;
+		}
+	}
+
+	// Keep the log in memory to check the copies against
+	FILE *in = fopen(logName, "rb");
+	if (in == NULL) {
+		perror(logName);
+		return 1;
+	}
+	fseek(in, 0, SEEK_END);
+	unsigned long size = ftell(in);
+	fseek(in, 0, SEEK_SET);
+	unsigned char *log = malloc(size ? size : 1);
+	if ((log == NULL) || (fread(log, 1, size, in) != size)) {
+		fprintf(stderr, "could not read %s\n", logName);
+		return 1;
+	}
+	fclose(in);
+
+	int result = checkShortFrames();
+	result |= runDownload("plain", tlrget, logName, log, size, 0, 0, 0, 0);
+	result |= runDownload("compressed", tlrget, logName, log, size, 1, 0, 0, 0);
+	result |= runDownload("plain resumed", tlrget, logName, log, size, 0, size / 2, 0, 0);
+	result |= runDownload("compressed resumed", tlrget, logName, log, size, 1, size / 2, 0, 0);
+	result |= runDownload("plain damaged", tlrget, logName, log, size, 0, 0, 3001, 0);
+	result |= runDownload("compressed damaged", tlrget, logName, log, size, 1, 0, 3001, 0);
+	result |= runDownload("plain reopened", tlrget, logName, log, size, 0, 0, 0, 7);
+	result |= runDownload("compressed reopened", tlrget, logName, log, size, 1, 0, 0, 7);
+
+	if (argc < 3)
+		unlink(logName);
+	free(log);
+	printf("%s\n", result ? "FAILED" : "all passed");
+	return result;
+}
@@ -0,0 +1,137 @@
+/*******************************************************
+ * driftsim.c
+ * Host simulation of the RTCC drift trim (src/Drift.c)
+ * against a meter clock that keeps perfect time.
+ *
+ * Build:  cc -O2 -Itools/host -Iinclude -o driftsim tools/driftsim.c \
+ *             src/Drift.c src/RecordFormat.c
+ * Usage:  driftsim [ppm ...]
+ *
+ * Drift.c is built as it is.  The PIC clock runs at the
+ * ppm given (positive is fast) plus what the calibration
+ * in force adds, 2.03 ppm a step, and the logger samples
+ * every hour for eight weeks, reading the meter clock and
+ * then its own, both in whole seconds, the way
+ * readAndLogSample does.  The CLOCK.TXT rows are printed
+ * as they are written.  A run passes if the drift left at
+ * the end is within one calibration step.  Without ppm
+ * arguments it runs a PIC 15 ppm fast and one 40 ppm slow.
+ *******************************************************/
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "RTCC.h"
+#include "Config.h"
+#include "FSIO.h"
+#include "LogFile.h"
+#include "Drift.h"
+
+// The logger epoch (2000-01-01) on the host clock
+#define EPOCH_2000			946684800L
+
+// The time the runs start (2010-06-01) and how long they go on for
+#define START_EPOCH			328665600UL
+#define RUN_HOURS			(8 * 7 * 24)
+
+// The parts of the firmware Drift.c uses, with the calibration kept here
+LOGGER_CONFIG loggerConfig;
+static signed char calibration = 0;
+static int calibrationChanges = 0;
+
+signed char RTCCGetCalibration(void) {
+	return calibration;
+}
+
+void RTCCSetCalibration(signed char cal) {
+	if (cal != calibration)
+		calibrationChanges++;
+	calibration = cal;
+}
+
+int configSave(void) {
+	return 1;
+}
+
+unsigned int appendToFile(char *fileName, const void *data, unsigned int length) {
+	printf("    %s: %.*s", fileName, (int)length, (const char *)data);
+	return length;
+}
+
+// The date functions from RTCC.c, done with the C library here
+unsigned long epochFromDate(const RTCC_DATE *date) {
+	struct tm tm = {0};
+	tm.tm_year = date->year + 100;
+	tm.tm_mon = date->month - 1;
+	tm.tm_mday = date->day;
+	tm.tm_hour = date->hour;
+	tm.tm_min = date->minute;
+	tm.tm_sec = date->second;
+	return (unsigned long)(timegm(&tm) - EPOCH_2000);
+}
+
+void epochToDate(unsigned long epoch, RTCC_DATE *date) {
+	time_t t = (time_t)epoch + EPOCH_2000;
+	struct tm *tm = gmtime(&t);
+	date->year = tm->tm_year - 100;
+	date->month = tm->tm_mon + 1;
+	date->day = tm->tm_mday;
+	date->hour = tm->tm_hour;
+	date->minute = tm->tm_min;
+	date->second = tm->tm_sec;
+}
+
+int RTCCDateValid(const RTCC_DATE *date) {
+	if ((date->year > 99) || (date->month < 1) || (date->month > 12) || (date->day < 1) ||
+		(date->hour > 23) || (date->minute > 59) || (date->second > 59))
+		return 0;
+	RTCC_DATE check;
+	epochToDate(epochFromDate(date), &check);
+	return check.day == date->day;
+}
+
+// Run one PIC, returns the drift left at the end in ppm
+static double runDrift(double ppm) {
+	calibration = 0;
+	calibrationChanges = 0;
+	driftReset();
+
+	// The PIC starts 37 seconds off the meter, part way into a second
+	double meter = START_EPOCH;
+	double pic = START_EPOCH + 37.4;
+	int hour;
+	for (hour = 0; hour < RUN_HOURS; hour++) {
+		double rate = ppm + calibration * RTCC_CAL_PPM_PER_STEP;
+		meter += 3600;
+		pic += 3600 * (1 + rate * 1e-6);
+
+		// The meter clock is read, then the PIC clock a little after
+		RTCC_DATE date;
+		epochToDate((unsigned long)meter, &date);
+		unsigned char meterDate[6] = {date.year, date.month, date.day, date.hour, date.minute,
+			date.second};
+		unsigned long picEpoch = (unsigned long)(pic + 0.05);
+		if (driftDue(picEpoch))
+			driftAddReading(meterDate, picEpoch);
+	}
+	return ppm + calibration * RTCC_CAL_PPM_PER_STEP;
+}
+
+int main(int argc, char **argv) {
+	double defaults[] = {15, -40};
+	int count = argc > 1 ? argc - 1 : 2;
+	int result = 0;
+	int i;
+	for (i = 0; i < count; i++) {
+		double ppm = argc > 1 ? atof(argv[i + 1]) : defaults[i];
+		printf("PIC %+.1f ppm:\n", ppm);
+		double left = runDrift(ppm);
+		int settled = (left <= RTCC_CAL_PPM_PER_STEP) && (left >= -RTCC_CAL_PPM_PER_STEP);
+		printf("  calibration %d after %d changes, %+.2f ppm left, %s\n", calibration,
+			calibrationChanges, left, settled ? "within a step" : "NOT SETTLED");
+		if (!settled)
+			result = 1;
+	}
+	return result;
+}
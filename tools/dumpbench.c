@@ -0,0 +1,297 @@
+/*******************************************************
+ * dumpbench.c
+ * Host simulation of the log dump to the terminal
+ * (dumpLogFileFrom in src/LogFile.c and the UART1 ring in
+ * src/UART.c): the old byte a call FSfread and blocking
+ * putU1 against a sector a call read, the newline
+ * translation in place and the transmit ring drained by
+ * _U1TXInterrupt.
+ *
+ * Build:  cc -O2 -o dumpbench tools/dumpbench.c
+ * Usage:  dumpbench [baud] [sector read us]
+ *
+ * Both paths run over a made up log on a RAM card against
+ * a model of the PIC's time: each step costs the
+ * instruction cycles given below, the UART shifts a byte
+ * out every 10 bit times from its 4 deep FIFO, and the
+ * transmit interrupt runs whenever a byte leaves the FIFO
+ * while it is enabled.  It checks both paths put the same
+ * bytes on the wire and prints the bytes/s each managed
+ * against the wire rate.  The cycle counts are estimates,
+ * it is the shape of the result that matters.
+ *******************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MEDIA_SECTOR_SIZE	512
+
+// The instruction clock (32 MHz FRC with PLL, two clocks an instruction)
+#define FCY					16000000UL
+
+// What the steps cost in instruction cycles: an FSfread call (checking
+// the stream, working out where it is), each byte it copies, the byte
+// loop of the old dump, putU1's checks, translating a byte, writeU1
+// queueing a byte, and getting into and out of the interrupt plus each
+// byte it moves
+#define FSFREAD_CALL_CYCLES		400
+#define FSFREAD_BYTE_CYCLES		2
+#define OLD_LOOP_CYCLES			20
+#define PUTU1_CYCLES			30
+#define TRANSLATE_CYCLES		4
+#define WRITEU1_BYTE_CYCLES		12
+#define ISR_ENTRY_CYCLES		40
+#define ISR_BYTE_CYCLES			10
+
+// The UART1 hardware FIFO, and the ring the interrupt drains (as in
+// UART.c and LogFile.c)
+#define UART_FIFO_SIZE			4
+#define U1_TX_BUFFER_SIZE		512
+#define LOG_CHUNK_SIZE			MEDIA_SECTOR_SIZE
+
+// The made up log
+#define LOG_SIZE				(200UL * 1024)
+
+// The model of the PIC: the time in cycles, the UART's FIFO and when
+// the byte going out now is done, the ring and whether the interrupt
+// is on, and what has gone out on the wire
+static unsigned long long now;
+static unsigned long long byteCycles;
+static unsigned long long fifoDoneAt;
+static unsigned int fifoCount;
+static unsigned char ring[U1_TX_BUFFER_SIZE];
+static unsigned int ringHead;
+static unsigned int ringTail;
+static int txInterruptOn;
+static unsigned char *wire;
+static unsigned long wireCount;
+static unsigned long long sectorReadCycles;
+
+// The card, one file from the start of it
+static unsigned char *card;
+static unsigned long cardSize;
+static unsigned long sectorReads;
+
+// Clear the model down
+static void resetModel(void) {
+	now = 0;
+	fifoDoneAt = 0;
+	fifoCount = 0;
+	ringHead = 0;
+	ringTail = 0;
+	txInterruptOn = 0;
+	wireCount = 0;
+	sectorReads = 0;
+}
+
+// A byte goes into the UART FIFO (the caller has checked there is room)
+static void fifoPush(unsigned char c) {
+	if (fifoCount == 0)
+		fifoDoneAt = now + byteCycles;
+	fifoCount++;
+	wire[wireCount++] = c;
+}
+
+// The transmit interrupt, as _U1TXInterrupt: fill the FIFO from the
+// ring and turn itself off once the ring is empty
+static unsigned long long txInterrupt(void) {
+	unsigned long long cycles = ISR_ENTRY_CYCLES;
+	while ((fifoCount < UART_FIFO_SIZE) && (ringTail != ringHead)) {
+		fifoPush(ring[ringTail]);
+		ringTail = (ringTail + 1) % U1_TX_BUFFER_SIZE;
+		cycles += ISR_BYTE_CYCLES;
+	}
+	if (ringTail == ringHead)
+		txInterruptOn = 0;
+	return cycles;
+}
+
+// The PIC spends some cycles on the main line.  Bytes leave the FIFO as
+// the time goes by, and each one that does runs the interrupt if it is
+// on, which pushes the main line back by the cycles it takes.
+static void spend(unsigned long long cycles) {
+	unsigned long long until = now + cycles;
+	while ((fifoCount > 0) && (fifoDoneAt <= until)) {
+		now = fifoDoneAt;
+		fifoCount--;
+		if (fifoCount > 0)
+			fifoDoneAt = now + byteCycles;
+		if (txInterruptOn) {
+			unsigned long long isr = txInterrupt();
+			until += isr;
+			now += isr;
+		}
+	}
+	if (until > now)
+		now = until;
+}
+
+// Wait on the main line (spinning) until the next byte leaves the FIFO
+static void waitForByte(void) {
+	if (fifoCount == 0)
+		return;
+	spend(fifoDoneAt > now ? fifoDoneAt - now : 0);
+}
+
+// Read size bytes of the file at offset, the way FSfread costs: a
+// sector read whenever it moves into a sector not in the buffer
+static unsigned long lastSector = 0xFFFFFFFF;
+static unsigned int cardRead(unsigned char *dest, unsigned long offset, unsigned int size) {
+	if (offset >= cardSize)
+		return 0;
+	if (size > cardSize - offset)
+		size = cardSize - offset;
+	spend(FSFREAD_CALL_CYCLES + (unsigned long long)size * FSFREAD_BYTE_CYCLES);
+	unsigned long first = offset / MEDIA_SECTOR_SIZE;
+	unsigned long last = (offset + size - 1) / MEDIA_SECTOR_SIZE;
+	unsigned long sector;
+	for (sector = first; sector <= last; sector++) {
+		if (sector != lastSector) {
+			spend(sectorReadCycles);
+			sectorReads++;
+			lastSector = sector;
+		}
+	}
+	memcpy(dest, &card[offset], size);
+	return size;
+}
+
+// The dump as it was: one byte a FSfread call, each one through putU1
+// waiting on the FIFO
+static void oldDump(void) {
+	unsigned long offset = 0;
+	unsigned char fromFile[1];
+	lastSector = 0xFFFFFFFF;
+	while (offset < cardSize) {
+		spend(OLD_LOOP_CYCLES);
+		offset += cardRead(fromFile, offset, 1);
+		spend(PUTU1_CYCLES);
+		while (fifoCount >= UART_FIFO_SIZE)
+			waitForByte();
+		fifoPush(fromFile[0] == '\n' ? '\r' : fromFile[0]);
+	}
+	while (fifoCount > 0)
+		waitForByte();
+}
+
+// writeU1: queue the bytes on the ring, spinning while it is full
+static void writeU1(const unsigned char *data, unsigned int length) {
+	unsigned int queued;
+	for (queued = 0; queued < length; queued++) {
+		unsigned int nextHead = (ringHead + 1) % U1_TX_BUFFER_SIZE;
+		if (nextHead == ringTail) {
+			txInterruptOn = 1;
+			// A FIFO with room and the interrupt just turned on fires
+			// straight away
+			if (fifoCount < UART_FIFO_SIZE)
+				spend(txInterrupt());
+			while (nextHead == ringTail)
+				waitForByte();
+		}
+		spend(WRITEU1_BYTE_CYCLES);
+		ring[ringHead] = data[queued];
+		ringHead = nextHead;
+	}
+	txInterruptOn = 1;
+	if (fifoCount < UART_FIFO_SIZE)
+		spend(txInterrupt());
+}
+
+// The dump as it is now: a sector a call, translated in place and
+// queued on the ring, then flushU1 and the FIFO emptying
+static void newDump(void) {
+	static unsigned char logChunkBuffer[LOG_CHUNK_SIZE];
+	unsigned long offset = 0;
+	lastSector = 0xFFFFFFFF;
+	while (offset < cardSize) {
+		unsigned int bytesRead = cardRead(logChunkBuffer, offset, LOG_CHUNK_SIZE);
+		if (bytesRead == 0)
+			break;
+		offset += bytesRead;
+		unsigned int i;
+		for (i = 0; i < bytesRead; i++) {
+			if (logChunkBuffer[i] == '\n')
+				logChunkBuffer[i] = '\r';
+		}
+		spend((unsigned long long)bytesRead * TRANSLATE_CYCLES);
+		writeU1(logChunkBuffer, bytesRead);
+	}
+	while ((ringTail != ringHead) || (fifoCount > 0))
+		waitForByte();
+}
+
+// Make up a log of 10 minute records like the logger writes
+static void makeLog(void) {
+	unsigned long size = 0;
+	unsigned int minutes = 0;
+	srand(1);
+	while (size < LOG_SIZE) {
+		char record[128];
+		int length = snprintf(record, sizeof(record),
+			"10/06/%02u %02u:%02u:00,%.3f,%.3f,%.3f,%.3f,%ld,%.1f,98,1,00*%04X\n",
+			1 + minutes / 1440, (minutes / 60) % 24, minutes % 60,
+			12.0 + rand() % 1000 / 1000.0, rand() % 100 / 1000.0, 11.5, 12.5,
+			1234567L + minutes, 21.0 + rand() % 40 / 10.0, rand() & 0xFFFF);
+		if (size + length > LOG_SIZE)
+			break;
+		memcpy(&card[size], record, length);
+		size += length;
+		minutes += 10;
+	}
+	cardSize = size;
+}
+
+// One line of results
+static void report(const char *what) {
+	double rate = cardSize / ((double)now / FCY);
+	printf("  %-26s %8.0f bytes/s  %5.1f%% of the wire  %5lu sector reads\n", what, rate,
+		100.0 * rate * byteCycles / FCY, sectorReads);
+}
+
+int main(int argc, char **argv) {
+	unsigned long baud = argc > 1 ? strtoul(argv[1], NULL, 10) : 0;
+	double sectorReadUs = argc > 2 ? atof(argv[2]) : 1500;
+	unsigned long bauds[] = {9600, 115200};
+	unsigned int count = 2;
+	if (baud > 0) {
+		bauds[0] = baud;
+		count = 1;
+	}
+	sectorReadCycles = (unsigned long long)(sectorReadUs * FCY / 1e6);
+
+	card = malloc(LOG_SIZE);
+	wire = malloc(LOG_SIZE);
+	unsigned char *oldWire = malloc(LOG_SIZE);
+	if ((card == NULL) || (wire == NULL) || (oldWire == NULL))
+		return 1;
+	makeLog();
+
+	int result = 0;
+	unsigned int b;
+	for (b = 0; b < count; b++) {
+		byteCycles = 10ULL * FCY / bauds[b];
+		printf("%lu byte log at %lu baud (%.0f bytes/s on the wire), %.0f us a sector read:\n",
+			cardSize, bauds[b], (double)FCY / byteCycles, sectorReadUs);
+
+		resetModel();
+		oldDump();
+		report("byte a call, putU1");
+		memcpy(oldWire, wire, cardSize);
+		unsigned long oldCount = wireCount;
+
+		resetModel();
+		newDump();
+		report("sector a call, TX ring");
+		if ((oldCount != cardSize) || (wireCount != cardSize) ||
+			(memcmp(oldWire, wire, cardSize) != 0)) {
+			fprintf(stderr, "the two paths put different bytes on the wire\n");
+			result = 1;
+		}
+	}
+	if (result == 0)
+		printf("both paths put the same bytes on the wire\n");
+	free(card);
+	free(wire);
+	free(oldWire);
+	return result;
+}
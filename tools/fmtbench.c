@@ -0,0 +1,146 @@
+/*******************************************************
+ * fmtbench.c
+ * Host check and benchmark of the fixed point record
+ * formatters (src/RecordFormat.c) against sprintf.
+ *
+ * Build:  cc -O2 -Iinclude -o fmtbench tools/fmtbench.c src/RecordFormat.c
+ * Usage:  fmtbench [records]
+ *
+ * It first formats a spread of values both ways and counts
+ * any that come out different, then times a whole log
+ * record done each way.  The times are host cycles (or
+ * nanoseconds off x86), so they show the ratio between the
+ * two rather than what the PIC24 will take.
+ *******************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "RecordFormat.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define UNITS "cycles"
+static unsigned long long now(void) {
+	return __rdtsc();
+}
+#else
+#define UNITS "ns"
+static unsigned long long now(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+// Stop the compiler throwing away the work
+static volatile unsigned int sink;
+
+// A made up sample in the range the meter gives
+struct sample {
+	unsigned char year, month, day, hour, minute, second;
+	float mean, stdDev, min, max, temp;
+	long totalizer;
+	unsigned char battCap, powerStat;
+	unsigned int fault;
+};
+
+static float randomFloat(float range) {
+	return ((float)rand() / RAND_MAX * 2.0f - 1.0f) * range;
+}
+
+static void makeSample(struct sample *s, unsigned int i) {
+	s->year = 10;
+	s->month = 1 + (i / 86400) % 12;
+	s->day = 1 + (i / 3600) % 28;
+	s->hour = (i / 60) % 24;
+	s->minute = i % 60;
+	s->second = (i * 7) % 60;
+	s->mean = randomFloat(500.0f);
+	s->stdDev = randomFloat(5.0f);
+	s->min = randomFloat(500.0f);
+	s->max = randomFloat(500.0f);
+	s->temp = randomFloat(60.0f);
+	s->totalizer = rand() - RAND_MAX / 2;
+	s->battCap = rand() % 101;
+	s->powerStat = rand() % 4;
+	s->fault = rand() & 0xFFFF;
+}
+
+// The record the old way
+static int recordSprintf(char *out, const struct sample *s) {
+	return sprintf(out, "20%02u-%02u-%02uT%02u:%02u:%02u,%3.3f,%3.3f,%3.3f,%3.3f,%ld,%2.2f,%3u,%1u,%2o\n",
+		s->year, s->month, s->day, s->hour, s->minute, s->second,
+		s->mean, s->stdDev, s->min, s->max, s->totalizer, s->temp,
+		s->battCap, s->powerStat, s->fault);
+}
+
+// The record the new way, the same as formatLogRecord in src/LogFile.c
+static int recordFixed(char *out, const struct sample *s) {
+	char *p = formatTimestamp(out, s->year, s->month, s->day, s->hour, s->minute, s->second);
+	*p++ = ',';
+	p = formatFixed(p, s->mean, RECORD_FLOW_DECIMALS);
+	*p++ = ',';
+	p = formatFixed(p, s->stdDev, RECORD_FLOW_DECIMALS);
+	*p++ = ',';
+	p = formatFixed(p, s->min, RECORD_FLOW_DECIMALS);
+	*p++ = ',';
+	p = formatFixed(p, s->max, RECORD_FLOW_DECIMALS);
+	*p++ = ',';
+	p = formatSigned(p, s->totalizer);
+	*p++ = ',';
+	p = formatFixed(p, s->temp, RECORD_TEMP_DECIMALS);
+	*p++ = ',';
+	p = formatUnsigned(p, s->battCap, 3, ' ');
+	*p++ = ',';
+	p = formatUnsigned(p, s->powerStat, 1, ' ');
+	*p++ = ',';
+	p = formatOctal(p, s->fault, 2);
+	*p++ = '\n';
+	*p = '\0';
+	return p - out;
+}
+
+int main(int argc, char **argv) {
+	unsigned int records = argc > 1 ? atoi(argv[1]) : 100000;
+	if (records == 0)
+		records = 1;
+	struct sample *samples = malloc(records * sizeof(*samples));
+	if (samples == NULL)
+		return 1;
+	srand(1);
+	unsigned int i;
+	for (i = 0; i < records; i++)
+		makeSample(&samples[i], i);
+
+	// Check the two agree
+	char a[160], b[160];
+	unsigned int differ = 0;
+	for (i = 0; i < records; i++) {
+		recordSprintf(a, &samples[i]);
+		recordFixed(b, &samples[i]);
+		if (strcmp(a, b) != 0) {
+			if (differ < 5)
+				printf("differ:\n  sprintf %s  fixed   %s", a, b);
+			differ++;
+		}
+	}
+	printf("%u of %u records differ\n", differ, records);
+
+	// Time them
+	unsigned long long start = now();
+	for (i = 0; i < records; i++)
+		sink += recordSprintf(a, &samples[i]);
+	unsigned long long sprintfTime = now() - start;
+	start = now();
+	for (i = 0; i < records; i++)
+		sink += recordFixed(b, &samples[i]);
+	unsigned long long fixedTime = now() - start;
+
+	printf("sprintf: %.0f %s/record\n", (double)sprintfTime / records, UNITS);
+	printf("fixed:   %.0f %s/record\n", (double)fixedTime / records, UNITS);
+	printf("speedup: %.1fx\n", fixedTime ? (double)sprintfTime / fixedTime : 0.0);
+	free(samples);
+	return differ ? 1 : 0;
+}
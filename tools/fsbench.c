@@ -0,0 +1,303 @@
+/*******************************************************
+ * fsbench.c
+ * Host benchmark of the real Microchip file system
+ * (src/FSIO.c) over a RAM card: how many sector reads and
+ * writes FSfwrite and FSfread cost, and how long the
+ * copying takes on this host.
+ *
+ * Build:  cc -O2 -fno-strict-aliasing -fno-aggressive-loop-optimizations
+ *             -D__C30__ -include tools/host/mdd/MDDHost.h -Iinclude
+ *             -o fsbench tools/fsbench.c src/FSIO.c
+ * Usage:  fsbench [megabytes]
+ *
+ * FSIO.c is built as it is for the logger (FSconfig.h,
+ * the C30 paths) with tools/host/mdd/MDDHost.h putting in
+ * the MDD types at the PIC's sizes.  This file is the card:
+ * the MDD_SDSPI_xxx functions over a FAT16 image in memory,
+ * counting every sector read and written.  It writes a file
+ * in log record sized pieces and in big pieces, reads it
+ * back in record, sector and big pieces, then opens it "r+"
+ * and mixes FSfseek to odd offsets with writes that cover
+ * whole sectors, odd sized reads and an append.  Every pass
+ * is checked against a copy kept here.  The sector counts
+ * are what costs time on the card; the MB/s are only the
+ * copying on this host.  To compare with another version
+ * of the file system build a second fsbench from it, e.g.
+ * git show <commit>:src/FSIO.c > /tmp/FSIO.c
+ *******************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "FSIO.h"
+
+// The card: 64 MB of FAT16 with 4 kB clusters and no partition table,
+// the boot sector is sector 0
+#define CARD_SECTORS		(64UL * 2048)
+#define SEC_PER_CLUS		8
+#define RESERVED_SECTORS	1
+#define FAT_COUNT			2
+#define FAT_SECTORS			64
+#define ROOT_ENTRIES		512
+
+// The sizes written and read at a time: a log record, a sector, and a
+// burst of sectors like a download or a big append
+#define SMALL_PIECE			80
+#define SECTOR_PIECE		MEDIA_SECTOR_SIZE
+#define LARGE_PIECE			4096
+
+// The mixed pass: how many seeks, and the sizes rewritten, read back
+// and appended at each
+#define MIXED_ROUNDS		2000
+#define MIXED_WRITE			1500
+#define MIXED_READ			2000
+#define MIXED_APPEND		3000
+
+static unsigned char *card;
+static unsigned long sectorReads = 0;
+static unsigned long sectorWrites = 0;
+
+BYTE MDD_SDSPI_MediaDetect(void) {
+	return TRUE;
+}
+
+BYTE MDD_SDSPI_MediaInitialize(void) {
+	return TRUE;
+}
+
+void MDD_SDSPI_InitIO(void) {
+}
+
+void MDD_SDSPI_ShutdownMedia(void) {
+}
+
+BYTE MDD_SDSPI_WriteProtectState(void) {
+	return 0;
+}
+
+DWORD MDD_SDSPI_ReadCapacity(void) {
+	return CARD_SECTORS - 1;
+}
+
+WORD MDD_SDSPI_ReadSectorSize(void) {
+	return MEDIA_SECTOR_SIZE;
+}
+
+BYTE MDD_SDSPI_SectorRead(DWORD sector_addr, BYTE *buffer) {
+	if (sector_addr >= CARD_SECTORS)
+		return FALSE;
+	memcpy(buffer, &card[sector_addr * MEDIA_SECTOR_SIZE], MEDIA_SECTOR_SIZE);
+	sectorReads++;
+	return TRUE;
+}
+
+BYTE MDD_SDSPI_SectorWrite(DWORD sector_addr, BYTE *buffer, BYTE allowWriteToZero) {
+	if ((sector_addr >= CARD_SECTORS) || ((sector_addr == 0) && !allowWriteToZero))
+		return FALSE;
+	memcpy(&card[sector_addr * MEDIA_SECTOR_SIZE], buffer, MEDIA_SECTOR_SIZE);
+	sectorWrites++;
+	return TRUE;
+}
+
+static void putWord(unsigned char *p, unsigned int value) {
+	p[0] = value;
+	p[1] = value >> 8;
+}
+
+static void putDWord(unsigned char *p, unsigned long value) {
+	putWord(p, value);
+	putWord(p + 2, value >> 16);
+}
+
+// Lay out an empty FAT16 volume (FSconfig.h leaves FSformat out)
+static void formatCard(void) {
+	memset(card, 0, CARD_SECTORS * MEDIA_SECTOR_SIZE);
+	unsigned char *boot = card;
+	boot[0] = 0xEB;
+	boot[1] = 0x3C;
+	boot[2] = 0x90;
+	memcpy(&boot[3], "MSDOS5.0", 8);
+	putWord(&boot[11], MEDIA_SECTOR_SIZE);
+	boot[13] = SEC_PER_CLUS;
+	putWord(&boot[14], RESERVED_SECTORS);
+	boot[16] = FAT_COUNT;
+	putWord(&boot[17], ROOT_ENTRIES);
+	putWord(&boot[19], 0);
+	boot[21] = 0xF8;
+	putWord(&boot[22], FAT_SECTORS);
+	putDWord(&boot[32], CARD_SECTORS);
+	boot[36] = 0x80;
+	boot[38] = 0x29;
+	putDWord(&boot[39], 0x12345678UL);
+	memcpy(&boot[43], "FSBENCH    ", 11);
+	memcpy(&boot[54], "FAT16   ", 8);
+	boot[510] = 0x55;
+	boot[511] = 0xAA;
+	int f;
+	for (f = 0; f < FAT_COUNT; f++) {
+		unsigned char *fat = &card[(RESERVED_SECTORS + f * FAT_SECTORS) * MEDIA_SECTOR_SIZE];
+		putWord(&fat[0], 0xFFF8);
+		putWord(&fat[2], 0xFFFF);
+	}
+}
+
+static void startCount(void) {
+	sectorReads = 0;
+	sectorWrites = 0;
+}
+
+static double secondsSince(clock_t started) {
+	return (double)(clock() - started) / CLOCKS_PER_SEC;
+}
+
+// One line of results
+static void report(const char *what, unsigned long size, double seconds) {
+	printf("  %-26s %8.1f MB/s  %7lu sector reads  %7lu sector writes\n", what,
+		seconds > 0 ? size / seconds / 1e6 : 0.0, sectorReads, sectorWrites);
+}
+
+// Write the source to a new file in pieces, returns 0 if it went
+static int writeFile(const char *fileName, const unsigned char *source,
+	unsigned long size, size_t piece) {
+	char label[40];
+	startCount();
+	clock_t started = clock();
+	FSFILE *file = FSfopen(fileName, "w");
+	if (file == NULL)
+		return 1;
+	unsigned long done = 0;
+	while (done < size) {
+		size_t length = size - done < piece ? size - done : piece;
+		if (FSfwrite(&source[done], 1, length, file) != length) {
+			FSfclose(file);
+			return 1;
+		}
+		done += length;
+	}
+	if (FSfclose(file) != 0)
+		return 1;
+	snprintf(label, sizeof(label), "write %zu byte pieces", piece);
+	report(label, size, secondsSince(started));
+	return 0;
+}
+
+// Read a file back in pieces and check it, returns 0 if it matched
+static int readFile(const char *fileName, const unsigned char *expect,
+	unsigned char *dest, unsigned long size, size_t piece) {
+	char label[40];
+	memset(dest, 0, size);
+	startCount();
+	clock_t started = clock();
+	FSFILE *file = FSfopen(fileName, "r");
+	if (file == NULL)
+		return 1;
+	unsigned long done = 0;
+	while (done < size) {
+		size_t got = FSfread(&dest[done], 1, piece, file);
+		if (got == 0)
+			break;
+		done += got;
+	}
+	FSfclose(file);
+	snprintf(label, sizeof(label), "read %zu byte pieces", piece);
+	report(label, size, secondsSince(started));
+	if ((done != size) || (memcmp(dest, expect, size) != 0)) {
+		fprintf(stderr, "%s came back different in %zu byte pieces\n", fileName, piece);
+		return 1;
+	}
+	return 0;
+}
+
+// Rewrite and read back at odd offsets in a file opened "r+", then append,
+// keeping the shadow in step; returns 0 if every read matched
+static int mixedFile(const char *fileName, unsigned char *shadow,
+	unsigned long *size, unsigned char *dest) {
+	unsigned long moved = 0;
+	startCount();
+	clock_t started = clock();
+	FSFILE *file = FSfopen(fileName, "r+");
+	if (file == NULL)
+		return 1;
+	int round;
+	for (round = 0; round < MIXED_ROUNDS; round++) {
+		// Odd offsets, so each write has a partial sector at both ends
+		unsigned long offset = ((unsigned long)rand() * 7 + 1) % (*size - MIXED_WRITE);
+		unsigned int n;
+		for (n = 0; n < MIXED_WRITE; n++)
+			shadow[offset + n] = rand();
+		if ((FSfseek(file, offset, SEEK_SET) != 0)
+			|| (FSfwrite(&shadow[offset], 1, MIXED_WRITE, file) != MIXED_WRITE)) {
+			FSfclose(file);
+			fprintf(stderr, "rewrite at %lu failed\n", offset);
+			return 1;
+		}
+		offset = ((unsigned long)rand() * 5 + 3) % (*size - MIXED_READ);
+		if ((FSfseek(file, offset, SEEK_SET) != 0)
+			|| (FSfread(dest, 1, MIXED_READ, file) != MIXED_READ)
+			|| (memcmp(dest, &shadow[offset], MIXED_READ) != 0)) {
+			FSfclose(file);
+			fprintf(stderr, "read at %lu came back different\n", offset);
+			return 1;
+		}
+		moved += MIXED_WRITE + MIXED_READ;
+	}
+	unsigned int n;
+	for (n = 0; n < MIXED_APPEND; n++)
+		shadow[*size + n] = rand();
+	if ((FSfseek(file, 0, SEEK_END) != 0)
+		|| (FSfwrite(&shadow[*size], 1, MIXED_APPEND, file) != MIXED_APPEND)) {
+		FSfclose(file);
+		fprintf(stderr, "append failed\n");
+		return 1;
+	}
+	*size += MIXED_APPEND;
+	moved += MIXED_APPEND;
+	if (FSfclose(file) != 0)
+		return 1;
+	report("r+ seek, rewrite, read", moved, secondsSince(started));
+	return 0;
+}
+
+int main(int argc, char **argv) {
+	unsigned long megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : 8;
+	unsigned long size = megabytes * 1000000UL + 123;
+	if ((megabytes < 1) || (megabytes > 24)) {
+		fprintf(stderr, "give 1 to 24 MB\n");
+		return 2;
+	}
+	card = malloc(CARD_SECTORS * MEDIA_SECTOR_SIZE);
+	unsigned char *source = malloc(size + MIXED_APPEND);
+	unsigned char *dest = malloc(size + MIXED_APPEND + LARGE_PIECE);
+	if ((card == NULL) || (source == NULL) || (dest == NULL))
+		return 1;
+	srand(1);
+	unsigned long i;
+	for (i = 0; i < size; i++)
+		source[i] = rand();
+
+	formatCard();
+	if (!FSInit()) {
+		fprintf(stderr, "FSInit failed, error %d\n", FSerror());
+		return 1;
+	}
+	int result = 0;
+	printf("%lu bytes:\n", size);
+	result |= writeFile("SMALL.BIN", source, size, SMALL_PIECE);
+	result |= writeFile("LARGE.BIN", source, size, LARGE_PIECE);
+	result |= readFile("SMALL.BIN", source, dest, size, SMALL_PIECE);
+	result |= readFile("LARGE.BIN", source, dest, size, SMALL_PIECE);
+	result |= readFile("LARGE.BIN", source, dest, size, SECTOR_PIECE);
+	result |= readFile("LARGE.BIN", source, dest, size, LARGE_PIECE);
+	if (result == 0)
+		result |= mixedFile("LARGE.BIN", source, &size, dest);
+	if (result == 0)
+		result |= readFile("LARGE.BIN", source, dest, size, LARGE_PIECE);
+	if (result == 0)
+		printf("every pass read back what was written\n");
+	else
+		fprintf(stderr, "error %d\n", FSerror());
+	free(card);
+	free(source);
+	free(dest);
+	return result;
+}
@@ -0,0 +1,19 @@
+/***********************************************************
+ * FSIO.h (host)
+ * The few file functions the logger's transfer code uses,
+ * over a stdio file, so it can be built on a Linux host
+ * against the tools.  Put tools/host ahead of include on
+ * the include path.
+ ***********************************************************/
+#include <stdio.h>
+
+// A file open on the host, with its size as FSIO keeps it
+typedef struct {
+	FILE *file;
+	unsigned long size;
+} FSFILE;
+
+FSFILE *FSfopen(const char *fileName, const char *mode);
+int FSfclose(FSFILE *stream);
+size_t FSfread(void *ptr, size_t size, size_t n, FSFILE *stream);
+int FSfseek(FSFILE *stream, long offset, int whence);
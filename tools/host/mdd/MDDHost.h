@@ -0,0 +1,95 @@
+/***********************************************************
+ * MDDHost.h
+ * Lets the real Microchip file system (src/FSIO.c) build on
+ * a Linux host.  It is forced in ahead of everything else
+ * with -include, puts in the MDD types at the PIC's sizes
+ * (a WORD is 16 bits and a DWORD 32 on any host) and stands
+ * in for Compiler.h and HardwareProfile.h, whose guards it
+ * sets so the PIC ones are skipped.  The card is left to the
+ * tool, which supplies the MDD_SDSPI_xxx functions.
+ ***********************************************************/
+#ifndef MDD_HOST_H
+#define MDD_HOST_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Skip the PIC headers this one stands in for
+#define __GENERIC_TYPE_DEFS_H_
+#define __COMPILER_H
+#define _HARDWAREPROFILE_H_
+
+// The card is on SPI, as on the logger
+#define USE_SD_INTERFACE_WITH_SPI
+
+// The MDD types, at fixed sizes
+typedef enum _BOOL { FALSE = 0, TRUE } BOOL;
+typedef uint8_t		BYTE;
+typedef uint16_t	WORD;
+typedef uint32_t	DWORD;
+typedef uint64_t	QWORD;
+typedef int8_t		CHAR;
+typedef int16_t		SHORT;
+typedef int32_t		LONG;
+typedef int64_t		LONGLONG;
+typedef void		VOID;
+typedef char		CHAR8;
+typedef uint8_t		UCHAR8;
+typedef int			INT;
+typedef int8_t		INT8;
+typedef int16_t		INT16;
+typedef int32_t		INT32;
+typedef int64_t		INT64;
+typedef unsigned int	UINT;
+typedef uint8_t		UINT8;
+typedef uint16_t	UINT16;
+typedef uint32_t	UINT32;
+typedef uint64_t	UINT64;
+
+typedef union {
+	WORD Val;
+	BYTE v[2];
+	struct {
+		BYTE LB;
+		BYTE HB;
+	} byte;
+} WORD_VAL;
+
+typedef union {
+	DWORD Val;
+	WORD w[2];
+	BYTE v[4];
+	struct {
+		WORD LW;
+		WORD HW;
+	} word;
+	struct {
+		BYTE LB;
+		BYTE HB;
+		BYTE UB;
+		BYTE MB;
+	} byte;
+} DWORD_VAL;
+
+#define PUBLIC
+#define PROTECTED
+#define PRIVATE		static
+#define ROM			const
+
+// Nop() is a C30 builtin
+#define Nop()
+
+#define LSB(a)		((a).v[0])
+#define MSB(a)		((a).v[1])
+
+// The RTCC registers CacheTime() reads for file stamps; every
+// stamp comes out as the same fixed time
+static struct {
+	unsigned RTCPTR0:1;
+	unsigned RTCPTR1:1;
+} RCFGCALbits __attribute__((unused));
+static WORD RTCVAL __attribute__((unused)) = 0x0101;
+
+#endif
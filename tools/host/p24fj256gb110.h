@@ -0,0 +1,5 @@
+/***********************************************************
+ * p24fj256gb110.h (host)
+ * Stands in for the processor header when logger code that
+ * does not touch the registers is built on a Linux host.
+ ***********************************************************/
@@ -0,0 +1,164 @@
+/*******************************************************
+ * lzbench.c
+ * Host check of the log download compressor
+ * (src/LogCompress.c): round trips a log file through it
+ * a sector at a time the way the compressed download
+ * does, and works out the download rate at a baud rate.
+ *
+ * Build:  cc -O2 -Iinclude -o lzbench tools/lzbench.c src/LogCompress.c \
+ *             src/RecordFormat.c src/Checksum.c
+ * Usage:  lzbench [log file] [baud]
+ *
+ * Without a log file it makes up a month of 10 minute
+ * records like the logger writes.
+ *******************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Checksum.h"
+#include "RecordFormat.h"
+#include "LogCompress.h"
+
+// The sector size the download works in, and the bytes each data frame
+// adds (SOH, type, length, offset, CRC, and the raw length of a
+// compressed block)
+#define BLOCK_SIZE			512
+#define PLAIN_OVERHEAD		(4 + 4 + 2)
+#define PACKED_OVERHEAD		(PLAIN_OVERHEAD + 2)
+
+// Make up a log like the logger writes, a record every 10 minutes with
+// the flow wandering about, returns the length
+static size_t makeLog(unsigned char **log) {
+	size_t size = 0;
+	size_t room = 1 << 20;
+	unsigned char *out = malloc(room);
+	if (out == NULL)
+		return 0;
+	const char *header = "Date/Time,Flow Mean,Flow SD,Flow Min,Flow Max,Totalizer,Temp,Batt,Power,Fault\n";
+	size = strlen(header);
+	memcpy(out, header, size);
+
+	srand(1);
+	float flow = 12.0f;
+	long totalizer = 1234567;
+	unsigned int i;
+	for (i = 0; i < 30 * 144; i++) {
+		char record[160];
+		unsigned int minutes = i * 10;
+		flow += ((float)rand() / RAND_MAX - 0.5f) * 0.8f;
+		if (flow < 0)
+			flow = 0;
+		float spread = (float)rand() / RAND_MAX * 0.3f;
+		totalizer += (long)(flow * 6);
+		char *p = formatTimestamp(record, 10, 6, 1 + minutes / 1440, (minutes / 60) % 24,
+			minutes % 60, 0);
+		*p++ = ',';
+		p = formatFixed(p, flow, RECORD_FLOW_DECIMALS);
+		*p++ = ',';
+		p = formatFixed(p, spread / 3, RECORD_FLOW_DECIMALS);
+		*p++ = ',';
+		p = formatFixed(p, flow - spread, RECORD_FLOW_DECIMALS);
+		*p++ = ',';
+		p = formatFixed(p, flow + spread, RECORD_FLOW_DECIMALS);
+		*p++ = ',';
+		p = formatSigned(p, totalizer);
+		*p++ = ',';
+		p = formatFixed(p, 21.0f + (float)rand() / RAND_MAX * 4, RECORD_TEMP_DECIMALS);
+		*p++ = ',';
+		p = formatUnsigned(p, 98, 3, ' ');
+		*p++ = ',';
+		p = formatUnsigned(p, 1, 1, ' ');
+		*p++ = ',';
+		p = formatOctal(p, 0, 2);
+		unsigned int crc = crc16Ccitt(CRC16_CCITT_INIT, (unsigned char *)record, p - record);
+		*p++ = '*';
+		p = formatHex16(p, crc);
+		*p++ = '\n';
+		memcpy(&out[size], record, p - record);
+		size += p - record;
+	}
+	*log = out;
+	return size;
+}
+
+int main(int argc, char **argv) {
+	unsigned char *log = NULL;
+	size_t size = 0;
+	long baud = argc > 2 ? atol(argv[2]) : 115200;
+
+	if ((argc > 1) && (strcmp(argv[1], "-") != 0)) {
+		FILE *in = fopen(argv[1], "rb");
+		if (in == NULL) {
+			perror(argv[1]);
+			return 1;
+		}
+		fseek(in, 0, SEEK_END);
+		size = ftell(in);
+		fseek(in, 0, SEEK_SET);
+		log = malloc(size ? size : 1);
+		if ((log == NULL) || (fread(log, 1, size, in) != size)) {
+			fprintf(stderr, "could not read %s\n", argv[1]);
+			return 1;
+		}
+		fclose(in);
+	} else {
+		size = makeLog(&log);
+	}
+
+	// Go through it a sector at a time, each with the one before as history,
+	// compressing and then decompressing into a second window
+	unsigned char window[LZ_WINDOW_SIZE];
+	unsigned char check[LZ_WINDOW_SIZE];
+	unsigned char packed[LZ_MAX_OUTPUT(BLOCK_SIZE)];
+	size_t offset = 0;
+	size_t plainWire = 0;
+	size_t packedWire = 0;
+	size_t packedBytes = 0;
+	unsigned int history = 0;
+	unsigned long blocks = 0;
+	clock_t started = clock();
+	while (offset < size) {
+		unsigned int length = size - offset < BLOCK_SIZE ? size - offset : BLOCK_SIZE;
+		memcpy(&window[history], &log[offset], length);
+
+		// Compress it, and only use that if it is smaller
+		unsigned int packedLength = lzCompress(window, history, history + length, packed,
+			length);
+		plainWire += PLAIN_OVERHEAD + length;
+		if ((packedLength > 0) && (packedLength + 2 < length)) {
+			packedWire += PACKED_OVERHEAD + packedLength;
+			packedBytes += packedLength;
+			if (!lzDecompress(check, history, history + length, packed, packedLength) ||
+				memcmp(&check[history], &log[offset], length) != 0) {
+				fprintf(stderr, "block at %zu did not come back the same\n", offset);
+				return 1;
+			}
+		} else {
+			packedWire += PLAIN_OVERHEAD + length;
+			packedBytes += length;
+			memcpy(&check[history], &log[offset], length);
+		}
+
+		// This block is the history for the next one
+		memmove(window, &window[history], length);
+		memmove(check, &check[history], length);
+		history = length;
+		offset += length;
+		blocks++;
+	}
+	double seconds = (double)(clock() - started) / CLOCKS_PER_SEC;
+
+	// 10 bit times a byte on the wire
+	double plainSeconds = plainWire * 10.0 / baud;
+	double packedSeconds = packedWire * 10.0 / baud;
+	printf("%zu bytes in %lu blocks, all came back the same\n", size, blocks);
+	printf("compressed to %.1f%% (%.2f to 1), %.1f us a block on this host\n",
+		100.0 * packedBytes / size, (double)size / packedBytes, seconds * 1e6 / blocks);
+	printf("at %ld baud: plain %.0f bytes/s (%.1f s), compressed %.0f bytes/s (%.1f s), %.2fx\n",
+		baud, size / plainSeconds, plainSeconds, size / packedSeconds, packedSeconds,
+		plainSeconds / packedSeconds);
+	free(log);
+	return 0;
+}
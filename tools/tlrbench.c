@@ -0,0 +1,282 @@
+/*******************************************************
+ * tlrbench.c
+ * Round trip benchmark for the binary request/response
+ * channel (see include/HostLink.h), one request at a time
+ * and then with several requests in flight.
+ *
+ * Build:  cc -O2 -o tlrbench tools/tlrbench.c tools/tlrlink.c
+ * Usage:  tlrbench <serial device> [count] [depth] [baud]
+ *         tlrbench --pty [count] [depth] [baud]
+ *
+ * With a serial device it runs against a logger (woken up
+ * first).  With --pty it runs against an emulated logger
+ * on the other end of a pseudo terminal that answers the
+ * same frames and holds each reply for the time the bytes
+ * would take on a full duplex line at the baud rate given
+ * (0 for no delay), after a TLR> prompt that has to be
+ * skipped.  That checks the client library and shows what
+ * pipelining buys at that baud rate without the hardware.
+ *******************************************************/
+#define _DEFAULT_SOURCE
+#define _XOPEN_SOURCE 600
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "tlrlink.h"
+
+// How long to wait for any one reply
+#define REPLY_TIMEOUT_MS	2000
+
+// The ping payload, the size of a typical small reply
+static const unsigned char pingPayload[16] = "tlrbench-payload";
+
+// Microseconds on a monotonic-enough clock
+static long long nowUs(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+}
+
+// The wire time of a frame in microseconds, 10 bit times a byte
+static long long wireUs(unsigned int payloadLength, long baud) {
+	if (baud <= 0)
+		return 0;
+	return (long long)(6 + payloadLength) * 10 * 1000000 / baud;
+}
+
+// The most replies the emulated logger keeps waiting to go out
+#define EMULATOR_QUEUE	64
+
+// The emulated logger.  It answers pings and time requests the way
+// HostLink.c does.  The serial line is full duplex, so it keeps one clock
+// for when the receive side is free and one for the transmit side: a
+// request has arrived once its bytes have had time to come in, and its
+// reply goes out once it has arrived and the replies before it are sent.
+static void emulateLogger(int fd, long baud) {
+	struct tlrLink link;
+	struct tlrFrame request;
+	struct tlrFrame queue[EMULATOR_QUEUE];
+	long long due[EMULATOR_QUEUE];
+	unsigned int queueHead = 0;
+	unsigned int queueCount = 0;
+	long long rxFree = 0;
+	long long txFree = 0;
+	tlrAttach(&link, fd);
+
+	// The prompt a person would see, the client has to skip it
+	if (write(fd, "TLR>", 4) < 0)
+		return;
+
+	while (1) {
+		// Wait for a request or for the next reply to be due
+		int timeoutMs = 60000;
+		if (queueCount > 0) {
+			long long left = due[queueHead] - nowUs();
+			timeoutMs = left > 0 ? (int)((left + 999) / 1000) : 0;
+		}
+		struct pollfd pfd = {fd, POLLIN, 0};
+		int ready = poll(&pfd, 1, timeoutMs);
+		if (ready < 0 && errno != EINTR)
+			return;
+		if ((ready == 0) && (queueCount == 0))
+			return;
+
+		// Take in every request that has come
+		if (ready > 0) {
+			long long seen = nowUs();
+			if (pfd.revents & (POLLHUP | POLLERR))
+				return;
+			while (tlrReceive(&link, &request, 1) == 1) {
+				if (queueCount == EMULATOR_QUEUE)
+					break;
+				struct tlrFrame *reply = &queue[(queueHead + queueCount) % EMULATOR_QUEUE];
+				reply->id = request.id;
+				reply->type = request.type | TLR_REPLY_OK;
+				reply->length = 0;
+				switch (request.type) {
+					case TLR_REQUEST_PING:
+						reply->payload[reply->length++] = TLR_FIELD_BYTES;
+						reply->payload[reply->length++] = request.length;
+						memcpy(&reply->payload[reply->length], request.payload, request.length);
+						reply->length += request.length;
+						break;
+					case TLR_REQUEST_TIME: {
+						unsigned char date[6] = {26, 10, 19, 12, 0, 0};
+						int i;
+						for (i = 0; i < 6; i++) {
+							reply->payload[reply->length++] = TLR_FIELD_BYTE;
+							reply->payload[reply->length++] = date[i];
+						}
+						break;
+					}
+					default:
+						reply->type = TLR_REPLY_ERROR;
+						reply->payload[reply->length++] = TLR_FIELD_BYTE;
+						reply->payload[reply->length++] = 1;
+						break;
+				}
+
+				// Work out when the request was all in and the reply all out
+				rxFree = (rxFree > seen ? rxFree : seen) + wireUs(request.length, baud);
+				txFree = (txFree > rxFree ? txFree : rxFree) + wireUs(reply->length, baud);
+				due[(queueHead + queueCount) % EMULATOR_QUEUE] = txFree;
+				queueCount++;
+			}
+		}
+
+		// Send the replies that are due
+		while ((queueCount > 0) && (due[queueHead] <= nowUs())) {
+			if (tlrSendFrame(&link, &queue[queueHead]) != 0)
+				return;
+			queueHead = (queueHead + 1) % EMULATOR_QUEUE;
+			queueCount--;
+		}
+	}
+}
+
+// Start the emulated logger on a pty, returns the master side
+static int startEmulator(long baud, pid_t *child) {
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if ((master < 0) || (grantpt(master) != 0) || (unlockpt(master) != 0))
+		return -1;
+	int slave = open(ptsname(master), O_RDWR | O_NOCTTY);
+	if (slave < 0)
+		return -1;
+
+	// Both ends raw so no byte is changed on the way through
+	struct termios tio;
+	tcgetattr(slave, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(slave, TCSANOW, &tio);
+	tcgetattr(master, &tio);
+	cfmakeraw(&tio);
+	tcsetattr(master, TCSANOW, &tio);
+
+	*child = fork();
+	if (*child < 0)
+		return -1;
+	if (*child == 0) {
+		close(master);
+		emulateLogger(slave, baud);
+		_exit(0);
+	}
+	close(slave);
+	return master;
+}
+
+// Run count pings with up to depth of them in flight, returns the
+// number that came back right, or -1
+static long runPings(struct tlrLink *link, long count, int depth, double *seconds) {
+	long sent = 0;
+	long good = 0;
+	long outstanding = 0;
+	struct tlrFrame reply;
+	long long started = nowUs();
+
+	while (good < count) {
+		// Keep the pipe full
+		while ((outstanding < depth) && (sent < count)) {
+			if (tlrSend(link, TLR_REQUEST_PING, pingPayload, sizeof(pingPayload)) < 0)
+				return -1;
+			sent++;
+			outstanding++;
+		}
+
+		// Take the next reply
+		int got = tlrReceive(link, &reply, REPLY_TIMEOUT_MS);
+		if (got <= 0) {
+			fprintf(stderr, "no reply after %ld of %ld\n", good, count);
+			return -1;
+		}
+		outstanding--;
+
+		// Check it is our payload back
+		unsigned int position = 0;
+		struct tlrField field;
+		if ((reply.type == (TLR_REQUEST_PING | TLR_REPLY_OK)) &&
+			tlrNextField(&reply, &position, &field) && (field.tag == TLR_FIELD_BYTES) &&
+			(field.length == sizeof(pingPayload)) &&
+			(memcmp(field.bytes, pingPayload, sizeof(pingPayload)) == 0))
+			good++;
+		else
+			fprintf(stderr, "bad reply to id %u\n", reply.id);
+	}
+	*seconds = (nowUs() - started) / 1e6;
+	return good;
+}
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		fprintf(stderr, "usage: %s <serial device>|--pty [count] [depth] [baud]\n", argv[0]);
+		return 2;
+	}
+	long count = argc > 2 ? atol(argv[2]) : 200;
+	int depth = argc > 3 ? atoi(argv[3]) : 4;
+	long baud = argc > 4 ? atol(argv[4]) : 9600;
+	if (count < 1)
+		count = 1;
+	if (depth < 1)
+		depth = 1;
+
+	struct tlrLink link;
+	pid_t child = 0;
+	if (strcmp(argv[1], "--pty") == 0) {
+		int fd = startEmulator(baud, &child);
+		if (fd < 0) {
+			perror("pty");
+			return 1;
+		}
+		tlrAttach(&link, fd);
+	} else {
+		if (tlrOpen(&link, argv[1], baud) != 0) {
+			perror(argv[1]);
+			return 1;
+		}
+		tlrWake(&link);
+	}
+
+	// Check the other end is there and the fields decode
+	struct tlrFrame reply;
+	if (tlrRequest(&link, TLR_REQUEST_TIME, NULL, 0, &reply, REPLY_TIMEOUT_MS) != 1) {
+		fprintf(stderr, "no answer to a time request\n");
+		return 1;
+	}
+	unsigned int position = 0;
+	struct tlrField field;
+	printf("logger time:");
+	while (tlrNextField(&reply, &position, &field))
+		printf(" %02ld", field.number);
+	printf("\n");
+
+	// One at a time, then pipelined
+	double serialSeconds = 0;
+	double pipeSeconds = 0;
+	long serialGood = runPings(&link, count, 1, &serialSeconds);
+	long pipeGood = runPings(&link, count, depth, &pipeSeconds);
+
+	int result = 0;
+	if ((serialGood != count) || (pipeGood != count)) {
+		result = 1;
+	} else {
+		printf("depth 1:  %ld round trips in %.3f s, %.1f per second, %.2f ms each\n",
+			count, serialSeconds, count / serialSeconds, serialSeconds * 1000 / count);
+		printf("depth %d:  %ld round trips in %.3f s, %.1f per second, %.2f ms each\n",
+			depth, count, pipeSeconds, count / pipeSeconds, pipeSeconds * 1000 / count);
+	}
+
+	tlrClose(&link);
+	if (child > 0) {
+		kill(child, SIGTERM);
+		waitpid(child, NULL, 0);
+	}
+	return result;
+}
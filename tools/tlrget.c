@@ -0,0 +1,381 @@
+/*******************************************************
+ * tlrget.c
+ * Linux host client for the logger's binary block
+ * download protocol (see include/BlockTransfer.h).
+ *
+ * Build:  cc -O2 -Iinclude -o tlrget tools/tlrget.c src/LogCompress.c
+ * Usage:  tlrget [-z] <serial device> <local file> [baud] [window]
+ *
+ * If the local file already exists, the download resumes
+ * from its current size, so after a cable glitch just run
+ * the same command again.
+ *
+ * With -z the logger compresses the blocks on the way (it
+ * needs a logger that knows 'Z' frames, older ones drop the
+ * start frame).  At the end it prints the file bytes a
+ * second that were achieved either way.
+ *******************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "LogCompress.h"
+
+// The frame layout, these must match BlockTransfer.h
+#define BT_SOH				0x01
+#define BT_FRAME_START		'S'
+#define BT_FRAME_ACK		'A'
+#define BT_FRAME_NAK		'N'
+#define BT_FRAME_QUIT		'Q'
+#define BT_FRAME_INFO		'I'
+#define BT_FRAME_DATA		'D'
+#define BT_FRAME_PACKED		'Z'
+#define BT_FRAME_END		'E'
+#define BT_BLOCK_SIZE		512
+#define BT_MAX_WINDOW		8
+#define BT_START_COMPRESS	0x01
+
+// How long to wait with no frames before asking the logger to restart
+// from what we have (milliseconds), and how many times to do that
+#define FRAME_TIMEOUT_MS	5000
+#define MAX_RESTARTS		5
+
+// The largest frame payload the logger sends (offset + block)
+#define MAX_PAYLOAD			(4 + BT_BLOCK_SIZE)
+
+// The CRC-16/CCITT nibble table, the same as src/Checksum.c
+static const unsigned int crcTable[16] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+// Add bytes to a running CRC-16/CCITT
+static unsigned int crc16Ccitt(unsigned int crc, const unsigned char *data, size_t length) {
+	while (length > 0) {
+		crc = ((crc << 4) & 0xFFFF) ^ crcTable[((crc >> 12) ^ (*data >> 4)) & 0x0F];
+		crc = ((crc << 4) & 0xFFFF) ^ crcTable[((crc >> 12) ^ (*data & 0x0F)) & 0x0F];
+		data++;
+		length--;
+	}
+	return crc;
+}
+
+// Milliseconds on a monotonic-enough clock
+static long long nowMs(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// Read a 4 byte MSB first number
+static unsigned long getLong(const unsigned char *from) {
+	return ((unsigned long)from[0] << 24) | ((unsigned long)from[1] << 16) |
+		((unsigned long)from[2] << 8) | from[3];
+}
+
+// Write a 4 byte MSB first number
+static void putLong(unsigned char *to, unsigned long value) {
+	to[0] = value >> 24;
+	to[1] = value >> 16;
+	to[2] = value >> 8;
+	to[3] = value;
+}
+
+// Write everything or fail
+static int writeAll(int fd, const unsigned char *data, size_t length) {
+	while (length > 0) {
+		ssize_t n = write(fd, data, length);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return -1;
+		}
+		data += n;
+		length -= n;
+	}
+	return 0;
+}
+
+// Send one frame to the logger
+static int sendFrame(int fd, unsigned char type, const unsigned char *payload, unsigned int length) {
+	unsigned char frame[4 + 8 + 2];
+	frame[0] = BT_SOH;
+	frame[1] = type;
+	frame[2] = length >> 8;
+	frame[3] = length;
+	memcpy(&frame[4], payload, length);
+	unsigned int crc = crc16Ccitt(0xFFFF, &frame[1], 3 + length);
+	frame[4 + length] = crc >> 8;
+	frame[5 + length] = crc;
+	return writeAll(fd, frame, 6 + length);
+}
+
+// Send an offset frame (ack or nak)
+static int sendOffset(int fd, unsigned char type, unsigned long offset) {
+	unsigned char payload[4];
+	putLong(payload, offset);
+	return sendFrame(fd, type, payload, 4);
+}
+
+// Send a start frame, the flags only go on when there are any so older
+// loggers still take it
+static int sendStart(int fd, unsigned long offset, unsigned char window, unsigned char flags) {
+	unsigned char payload[6];
+	putLong(payload, offset);
+	payload[4] = window;
+	payload[5] = flags;
+	return sendFrame(fd, BT_FRAME_START, payload, flags ? 6 : 5);
+}
+
+// The history compressed blocks are sent against, the block size bytes
+// of the file before the next block (fewer at the start of the file),
+// with room after it for the block
+static unsigned char history[LZ_WINDOW_SIZE];
+static unsigned int historyLength;
+
+// Put a block that arrived after the history, and keep the last block
+// size bytes as the history for the next one
+static void addHistory(const unsigned char *data, unsigned int length) {
+	if (data != &history[historyLength])
+		memcpy(&history[historyLength], data, length);
+	historyLength += length;
+	if (historyLength > BT_BLOCK_SIZE) {
+		memmove(history, &history[historyLength - BT_BLOCK_SIZE], BT_BLOCK_SIZE);
+		historyLength = BT_BLOCK_SIZE;
+	}
+}
+
+// The receive frame parser
+struct frameParser {
+	int state;
+	unsigned char frame[3 + MAX_PAYLOAD];
+	unsigned int length;
+	unsigned int index;
+	unsigned int crc;
+};
+
+// Feed one byte to the parser, returns the frame type when a good frame
+// is complete (payload at frame + 3), -1 on a bad CRC, or 0
+static int parseByte(struct frameParser *p, unsigned char c) {
+	switch (p->state) {
+		case 0:
+			if (c == BT_SOH)
+				p->state = 1;
+			return 0;
+		case 1:
+			p->frame[0] = c;
+			p->state = 2;
+			return 0;
+		case 2:
+			p->frame[1] = c;
+			p->length = (unsigned int)c << 8;
+			p->state = 3;
+			return 0;
+		case 3:
+			p->frame[2] = c;
+			p->length |= c;
+			p->index = 0;
+			if (p->length > MAX_PAYLOAD)
+				p->state = 0;
+			else
+				p->state = p->length ? 4 : 5;
+			return 0;
+		case 4:
+			p->frame[3 + p->index++] = c;
+			if (p->index == p->length)
+				p->state = 5;
+			return 0;
+		case 5:
+			p->crc = (unsigned int)c << 8;
+			p->state = 6;
+			return 0;
+		default:
+			p->crc |= c;
+			p->state = 0;
+			if (p->crc == crc16Ccitt(0xFFFF, p->frame, 3 + p->length))
+				return p->frame[0];
+			return -1;
+	}
+}
+
+// Open and set up the serial port (8 data bits, no parity, raw)
+static int openPort(const char *device, speed_t speed) {
+	int fd = open(device, O_RDWR | O_NOCTTY);
+	if (fd < 0)
+		return -1;
+	struct termios tio;
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, speed);
+		cfsetospeed(&tio, speed);
+		tio.c_cflag |= CLOCAL | CREAD;
+		tio.c_cc[VMIN] = 0;
+		tio.c_cc[VTIME] = 1;
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	return fd;
+}
+
+// Map a baud rate number to a termios speed
+static speed_t toSpeed(long baud) {
+	switch (baud) {
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		default: return B9600;
+	}
+}
+
+int main(int argc, char **argv) {
+	unsigned char flags = 0;
+	if ((argc > 1) && (strcmp(argv[1], "-z") == 0)) {
+		flags |= BT_START_COMPRESS;
+		argv++;
+		argc--;
+	}
+	if (argc < 3) {
+		fprintf(stderr, "usage: %s [-z] <serial device> <local file> [baud] [window]\n", argv[0]);
+		return 2;
+	}
+	long baud = argc > 3 ? atol(argv[3]) : 9600;
+	int window = argc > 4 ? atoi(argv[4]) : 4;
+	if (window < 1)
+		window = 1;
+	if (window > BT_MAX_WINDOW)
+		window = BT_MAX_WINDOW;
+
+	// Resume from whatever we already have, the end of it is the history
+	// for the first compressed block
+	FILE *out = fopen(argv[2], "a+b");
+	if (out == NULL) {
+		perror(argv[2]);
+		return 1;
+	}
+	struct stat st;
+	fstat(fileno(out), &st);
+	unsigned long expected = st.st_size;
+	historyLength = expected < BT_BLOCK_SIZE ? expected : BT_BLOCK_SIZE;
+	if ((fseek(out, expected - historyLength, SEEK_SET) != 0) ||
+		(fread(history, 1, historyLength, out) != historyLength)) {
+		fprintf(stderr, "could not read the end of %s\n", argv[2]);
+		return 1;
+	}
+	fseek(out, 0, SEEK_END);
+
+	int fd = openPort(argv[1], toSpeed(baud));
+	if (fd < 0) {
+		perror(argv[1]);
+		return 1;
+	}
+
+	// Wake the logger up, give it time to get to the prompt, and ask for
+	// a binary download.  Anything it prints is skipped by the parser.
+	writeAll(fd, (const unsigned char *)"\r", 1);
+	sleep(2);
+	writeAll(fd, (const unsigned char *)"gpbd\r", 5);
+	usleep(200000);
+	sendStart(fd, expected, window, flags);
+
+	struct frameParser parser;
+	memset(&parser, 0, sizeof(parser));
+	unsigned long fileSize = 0;
+	unsigned long lastNak = (unsigned long)-1;
+	unsigned long startOffset = expected;
+	unsigned long wireBytes = 0;
+	int restarts = 0;
+	int done = 0;
+	long long started = nowMs();
+	long long lastFrame = started;
+
+	while (!done) {
+		unsigned char in[256];
+		ssize_t n = read(fd, in, sizeof(in));
+		if (n < 0 && errno != EINTR && errno != EAGAIN) {
+			perror("read");
+			break;
+		}
+
+		ssize_t i;
+		for (i = 0; i < n && !done; i++) {
+			int type = parseByte(&parser, in[i]);
+			if (type == 0)
+				continue;
+			lastFrame = nowMs();
+			if (type < 0) {
+				// Damaged frame, ask for everything from where we are
+				if (lastNak != expected) {
+					sendOffset(fd, BT_FRAME_NAK, expected);
+					lastNak = expected;
+				}
+				continue;
+			}
+			const unsigned char *payload = &parser.frame[3];
+			if (type == BT_FRAME_INFO && parser.length >= 6) {
+				fileSize = getLong(payload);
+				fprintf(stderr, "log file is %lu bytes, have %lu\n", fileSize, expected);
+			} else if ((type == BT_FRAME_DATA && parser.length >= 4) ||
+				(type == BT_FRAME_PACKED && parser.length >= 6)) {
+				unsigned long offset = getLong(payload);
+				if (offset == expected) {
+					// Unpack it after the history if it came compressed
+					const unsigned char *data = payload + 4;
+					unsigned int length = parser.length - 4;
+					if (type == BT_FRAME_PACKED) {
+						length = ((unsigned int)payload[4] << 8) | payload[5];
+						if ((length > BT_BLOCK_SIZE) || !lzDecompress(history, historyLength,
+							historyLength + length, payload + 6, parser.length - 6)) {
+							if (lastNak != expected) {
+								sendOffset(fd, BT_FRAME_NAK, expected);
+								lastNak = expected;
+							}
+							continue;
+						}
+						data = &history[historyLength];
+					}
+					fwrite(data, 1, length, out);
+					addHistory(data, length);
+					expected += length;
+					wireBytes += parser.length + 6;
+					sendOffset(fd, BT_FRAME_ACK, expected);
+					lastNak = (unsigned long)-1;
+				} else if (offset > expected && lastNak != expected) {
+					// We missed a block, go back for it once
+					sendOffset(fd, BT_FRAME_NAK, expected);
+					lastNak = expected;
+				}
+			} else if (type == BT_FRAME_END) {
+				done = 1;
+			}
+		}
+
+		// If the logger has gone quiet, ask it to start again from what we have
+		if (!done && nowMs() - lastFrame > FRAME_TIMEOUT_MS) {
+			if (++restarts > MAX_RESTARTS) {
+				fprintf(stderr, "no response, giving up at %lu (run again to resume)\n", expected);
+				break;
+			}
+			sendStart(fd, expected, window, flags);
+			lastFrame = nowMs();
+		}
+	}
+
+	fclose(out);
+	close(fd);
+
+	double seconds = (nowMs() - started) / 1000.0;
+	if (seconds > 0)
+		fprintf(stderr, "%lu bytes in %.1f s (%.0f bytes/s)\n", expected - startOffset, seconds,
+			(expected - startOffset) / seconds);
+	if (wireBytes > 0)
+		fprintf(stderr, "%lu bytes of data frames, %.2f file bytes for each\n", wireBytes,
+			(double)(expected - startOffset) / wireBytes);
+	return done ? 0 : 1;
+}
@@ -0,0 +1,264 @@
+/*******************************************************
+ * tlrlink.c
+ * Linux host library for the logger's binary request/
+ * response channel (see tlrlink.h)
+ *******************************************************/
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/time.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "tlrlink.h"
+
+// The CRC-16/CCITT nibble table, the same as src/Checksum.c
+static const unsigned int crcTable[16] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
+
+// Add bytes to a running CRC-16/CCITT
+unsigned int tlrCrc16(unsigned int crc, const unsigned char *data, unsigned int length) {
+	while (length > 0) {
+		crc = ((crc << 4) & 0xFFFF) ^ crcTable[((crc >> 12) ^ (*data >> 4)) & 0x0F];
+		crc = ((crc << 4) & 0xFFFF) ^ crcTable[((crc >> 12) ^ (*data & 0x0F)) & 0x0F];
+		data++;
+		length--;
+	}
+	return crc;
+}
+
+// Milliseconds on a monotonic-enough clock
+static long long nowMs(void) {
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+}
+
+// Write everything or fail
+static int writeAll(int fd, const unsigned char *data, size_t length) {
+	while (length > 0) {
+		ssize_t n = write(fd, data, length);
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return -1;
+		}
+		data += n;
+		length -= n;
+	}
+	return 0;
+}
+
+// Map a baud rate number to a termios speed
+static speed_t toSpeed(long baud) {
+	switch (baud) {
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		default: return B9600;
+	}
+}
+
+void tlrAttach(struct tlrLink *link, int fd) {
+	memset(link, 0, sizeof(*link));
+	link->fd = fd;
+}
+
+int tlrOpen(struct tlrLink *link, const char *device, long baud) {
+	int fd = open(device, O_RDWR | O_NOCTTY);
+	if (fd < 0)
+		return -1;
+	struct termios tio;
+	if (tcgetattr(fd, &tio) == 0) {
+		cfmakeraw(&tio);
+		cfsetispeed(&tio, toSpeed(baud));
+		cfsetospeed(&tio, toSpeed(baud));
+		tio.c_cflag |= CLOCAL | CREAD;
+		tio.c_cc[VMIN] = 0;
+		tio.c_cc[VTIME] = 0;
+		tcsetattr(fd, TCSANOW, &tio);
+	}
+	tlrAttach(link, fd);
+	return 0;
+}
+
+void tlrClose(struct tlrLink *link) {
+	if (link->fd >= 0)
+		close(link->fd);
+	link->fd = -1;
+}
+
+void tlrWake(struct tlrLink *link) {
+	// The first byte only wakes the UART up, give it time to get to the
+	// prompt.  The welcome text is skipped by the frame parser.
+	writeAll(link->fd, (const unsigned char *)"\r", 1);
+	sleep(2);
+}
+
+int tlrSendFrame(struct tlrLink *link, const struct tlrFrame *frame) {
+	unsigned char out[4 + 255 + 2];
+	out[0] = TLR_ESCAPE;
+	out[1] = frame->id;
+	out[2] = frame->type;
+	out[3] = frame->length;
+	memcpy(&out[4], frame->payload, frame->length);
+	unsigned int crc = tlrCrc16(0xFFFF, &out[1], 3 + frame->length);
+	out[4 + frame->length] = crc >> 8;
+	out[5 + frame->length] = crc;
+	return writeAll(link->fd, out, 6 + frame->length);
+}
+
+int tlrSend(struct tlrLink *link, unsigned char type, const void *payload, unsigned int length) {
+	if (length > TLR_MAX_REQUEST) {
+		errno = EINVAL;
+		return -1;
+	}
+	struct tlrFrame frame;
+	frame.id = link->nextId++;
+	frame.type = type;
+	frame.length = length;
+	if (length > 0)
+		memcpy(frame.payload, payload, length);
+	if (tlrSendFrame(link, &frame) != 0)
+		return -1;
+	return frame.id;
+}
+
+// Feed one byte to the parser, returns 1 when a good frame is complete
+static int parseByte(struct tlrLink *link, unsigned char c) {
+	switch (link->state) {
+		case 0:
+			// Skip text until a frame starts
+			if (c == TLR_ESCAPE)
+				link->state = 1;
+			return 0;
+		case 1:
+		case 2:
+			link->frame[link->state - 1] = c;
+			link->state++;
+			return 0;
+		case 3:
+			link->frame[2] = c;
+			link->index = 0;
+			link->state = c ? 4 : 5;
+			return 0;
+		case 4:
+			link->frame[3 + link->index++] = c;
+			if (link->index == link->frame[2])
+				link->state = 5;
+			return 0;
+		case 5:
+			link->crc = (unsigned int)c << 8;
+			link->state = 6;
+			return 0;
+		default:
+			link->crc |= c;
+			link->state = 0;
+			return link->crc == tlrCrc16(0xFFFF, link->frame, 3 + link->frame[2]);
+	}
+}
+
+int tlrReceive(struct tlrLink *link, struct tlrFrame *frame, int timeoutMs) {
+	long long deadline = nowMs() + timeoutMs;
+	while (1) {
+		// Use up what was already read before waiting for more
+		while (link->rxIndex < link->rxCount) {
+			if (parseByte(link, link->rx[link->rxIndex++])) {
+				frame->id = link->frame[0];
+				frame->type = link->frame[1];
+				frame->length = link->frame[2];
+				memcpy(frame->payload, &link->frame[3], frame->length);
+				return 1;
+			}
+		}
+
+		long long left = deadline - nowMs();
+		if (left <= 0)
+			return 0;
+		struct pollfd pfd = {link->fd, POLLIN, 0};
+		int ready = poll(&pfd, 1, (int)left);
+		if (ready < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		if (ready == 0)
+			return 0;
+		ssize_t n = read(link->fd, link->rx, sizeof(link->rx));
+		if (n < 0) {
+			if (errno == EINTR || errno == EAGAIN)
+				continue;
+			return -1;
+		}
+		link->rxIndex = 0;
+		link->rxCount = n;
+	}
+}
+
+int tlrRequest(struct tlrLink *link, unsigned char type, const void *payload,
+	unsigned int length, struct tlrFrame *reply, int timeoutMs) {
+	int id = tlrSend(link, type, payload, length);
+	if (id < 0)
+		return -1;
+	while (1) {
+		int got = tlrReceive(link, reply, timeoutMs);
+		if (got <= 0)
+			return got;
+		if (reply->id == id)
+			return 1;
+	}
+}
+
+int tlrNextField(const struct tlrFrame *reply, unsigned int *position, struct tlrField *field) {
+	unsigned int at = *position;
+	if (at >= reply->length)
+		return 0;
+	const unsigned char *p = &reply->payload[at];
+	unsigned int left = reply->length - at;
+	memset(field, 0, sizeof(*field));
+	field->tag = p[0];
+	switch (p[0]) {
+		case TLR_FIELD_BYTE:
+			if (left < 2)
+				return 0;
+			field->number = p[1];
+			*position = at + 2;
+			return 1;
+		case TLR_FIELD_WORD:
+			if (left < 3)
+				return 0;
+			field->number = ((unsigned int)p[1] << 8) | p[2];
+			*position = at + 3;
+			return 1;
+		case TLR_FIELD_LONG:
+		case TLR_FIELD_FLOAT: {
+			if (left < 5)
+				return 0;
+			unsigned long bits = ((unsigned long)p[1] << 24) | ((unsigned long)p[2] << 16) |
+				((unsigned long)p[3] << 8) | p[4];
+			if (p[0] == TLR_FIELD_LONG) {
+				field->number = (int32_t)(uint32_t)bits;
+			} else {
+				uint32_t bits32 = (uint32_t)bits;
+				memcpy(&field->value, &bits32, 4);
+			}
+			*position = at + 5;
+			return 1;
+		}
+		case TLR_FIELD_BYTES:
+			if ((left < 2) || (left - 2 < p[1]))
+				return 0;
+			field->bytes = &p[2];
+			field->length = p[1];
+			*position = at + 2 + p[1];
+			return 1;
+		default:
+			return 0;
+	}
+}
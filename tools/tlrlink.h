@@ -0,0 +1,99 @@
+/*******************************************************
+ * tlrlink.h
+ * Linux host library for the logger's binary request/
+ * response channel (see include/HostLink.h).
+ *
+ * Build it in with the tool that uses it, i.e.
+ *   cc -O2 -o tlrbench tools/tlrbench.c tools/tlrlink.c
+ *******************************************************/
+#ifndef TLRLINK_H
+#define TLRLINK_H
+
+// The frame layout, these must match HostLink.h
+#define TLR_ESCAPE			0x02
+#define TLR_REQUEST_PING		'P'
+#define TLR_REQUEST_TIME		'T'
+#define TLR_REQUEST_SNAPSHOT	'S'
+#define TLR_REQUEST_REGISTERS	'R'
+#define TLR_REQUEST_LOGGER		'L'
+#define TLR_REPLY_OK			0x80
+#define TLR_REPLY_ERROR			'X'
+#define TLR_FIELD_BYTE			'c'
+#define TLR_FIELD_WORD			'w'
+#define TLR_FIELD_LONG			'l'
+#define TLR_FIELD_FLOAT			'f'
+#define TLR_FIELD_BYTES			's'
+#define TLR_MAX_REQUEST			32
+#define TLR_MAX_REGISTERS		100
+
+// One frame, a request or a reply
+struct tlrFrame {
+	unsigned char id;
+	unsigned char type;
+	unsigned char length;
+	unsigned char payload[255];
+};
+
+// One typed field from a reply payload
+struct tlrField {
+	unsigned char tag;
+	long number;				// 'c', 'w' and 'l'
+	float value;				// 'f'
+	const unsigned char *bytes;	// 's'
+	unsigned int length;		// 's'
+};
+
+// The receive side of a link, a frame parser that skips any text
+// from the prompt in between frames
+struct tlrLink {
+	int fd;
+	int state;
+	unsigned char frame[3 + 255];
+	unsigned int index;
+	unsigned int crc;
+	unsigned char nextId;
+	// Bytes read from the port that the parser has not used yet
+	unsigned char rx[256];
+	unsigned int rxIndex;
+	unsigned int rxCount;
+};
+
+// Open a serial port raw at a baud rate and set up the link.  Returns
+// 0, or -1 with errno set.
+int tlrOpen(struct tlrLink *link, const char *device, long baud);
+
+// Set up a link on a file descriptor that is already open (a pty)
+void tlrAttach(struct tlrLink *link, int fd);
+
+// Close the link
+void tlrClose(struct tlrLink *link);
+
+// Send the byte that wakes the logger up and wait for it to come to the
+// prompt.  Only needed if it may be asleep.
+void tlrWake(struct tlrLink *link);
+
+// Send a request.  Returns the id it was sent with, or -1.  Several can
+// be sent before reading any of the replies.
+int tlrSend(struct tlrLink *link, unsigned char type, const void *payload, unsigned int length);
+
+// Send any frame (the id and type given), used by the emulated logger
+// in tlrbench to send replies.  Returns 0 or -1.
+int tlrSendFrame(struct tlrLink *link, const struct tlrFrame *frame);
+
+// Wait up to timeoutMs for the next good frame.  Returns 1 with the
+// frame filled in, 0 on a timeout, or -1 on an error.
+int tlrReceive(struct tlrLink *link, struct tlrFrame *frame, int timeoutMs);
+
+// Send a request and wait for its reply (replies to other ids are
+// skipped).  Returns 1 with the reply, 0 on a timeout, or -1.
+int tlrRequest(struct tlrLink *link, unsigned char type, const void *payload,
+	unsigned int length, struct tlrFrame *reply, int timeoutMs);
+
+// Take the next typed field out of a reply, starting with *position 0.
+// Returns 1 with the field, or 0 at the end (or on a damaged payload).
+int tlrNextField(const struct tlrFrame *reply, unsigned int *position, struct tlrField *field);
+
+// Add bytes to a running CRC-16/CCITT (start with 0xFFFF)
+unsigned int tlrCrc16(unsigned int crc, const unsigned char *data, unsigned int length);
+
+#endif